@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "LoxArena.h"
+
+//every allocation is aligned for any value the compiler keeps in the arena
+#define ARENA_ALIGN 16
+
+void initArena(LoxArena* arena) {
+    arena->blocks = NULL;
+    arena->last = NULL;
+}
+
+void freeArena(LoxArena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    initArena(arena);
+}
+
+void* arenaAllocate(LoxArena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + blockSize);
+        if (block == NULL) exit(1);
+        block->size = blockSize;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void* result = block->data + block->used;
+    block->used += size;
+    arena->last = result;
+    return result;
+}
+
+//the latest allocation is extended where it is if its block has room,
+//anything else is copied to a new allocation and the old space left behind
+void* arenaGrow(LoxArena* arena, void* pointer, size_t oldSize, size_t newSize) {
+    if (pointer != NULL && pointer == arena->last) {
+        ArenaBlock* block = arena->blocks;
+        size_t start = (size_t)((char*)pointer - block->data);
+        size_t size = (newSize + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+        if (block->size - start >= size) {
+            block->used = start + size;
+            return pointer;
+        }
+    }
+
+    void* result = arenaAllocate(arena, newSize);
+    if (oldSize > 0) memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    return result;
+}
+
+ArenaMark arenaSave(LoxArena* arena) {
+    ArenaMark mark;
+    mark.block = arena->blocks;
+    mark.used = arena->blocks != NULL ? arena->blocks->used : 0;
+    return mark;
+}
+
+//give back everything allocated since the mark was taken
+void arenaRestore(LoxArena* arena, ArenaMark mark) {
+    while (arena->blocks != mark.block) {
+        ArenaBlock* block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+    if (arena->blocks != NULL) arena->blocks->used = mark.used;
+    arena->last = NULL;
+}
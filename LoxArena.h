@@ -0,0 +1,40 @@
+#ifndef lox_LoxArena_h
+#define lox_LoxArena_h
+
+#include "common.h"
+
+//scratch memory that is handed out by bumping a pointer and given back all at once,
+//nothing in it is counted by the collector or can be freed on its own
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(16) char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;
+    //the most recent allocation, which can still grow in place
+    void* last;
+} LoxArena;
+
+#define ArenaGrowArr(arena, type, pointer, oldCount, newCount) \
+    (type*)arenaGrow(arena, pointer, sizeof(type) * (oldCount), \
+        sizeof(type) * (newCount))
+
+//a point to roll the arena back to
+typedef struct {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+void initArena(LoxArena* arena);
+void freeArena(LoxArena* arena);
+void* arenaAllocate(LoxArena* arena, size_t size);
+void* arenaGrow(LoxArena* arena, void* pointer, size_t oldSize, size_t newSize);
+ArenaMark arenaSave(LoxArena* arena);
+void arenaRestore(LoxArena* arena, ArenaMark mark);
+
+#endif
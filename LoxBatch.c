@@ -0,0 +1,512 @@
+//fork, pipes, poll and the directory walk are POSIX
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "LoxBatch.h"
+
+//how much of a script's output is read from its pipe at a time
+#define BATCH_READ_SIZE 4096
+//the slowest scripts are listed again under the summary
+#define BATCH_SLOWEST 5
+
+typedef struct {
+    char* chars;
+    size_t length;
+    size_t capacity;
+} BatchBuffer;
+
+//what a script's expect comments say it should do, see readExpectations
+typedef struct {
+    BatchBuffer output;
+    BatchBuffer errors;
+    BatchBuffer runtimeError;
+    int exitCode;
+} BatchExpectation;
+
+//one script, its process while it runs and what it did once it has exited
+//fds are the read ends of its stdout and stderr, -1 once they are drained
+typedef struct {
+    char* path;
+    pid_t pid;
+    int fds[2];
+    BatchBuffer output[2];
+    double start;
+    double seconds;
+    int status;
+    bool passed;
+} BatchJob;
+
+typedef struct {
+    BatchJob* jobs;
+    int count;
+    int capacity;
+    //paths left out because their expectations do not hold for this interpreter, one indented line each
+    int skipped;
+    BatchBuffer skippedPaths;
+} BatchJobList;
+
+//parts of the test suite an --expect run leaves out: the scanning and expressions
+//directories are written for the tree-walking interpreter and the benchmarks print timings
+static const char* expectSkips[] = {
+    "/scanning",
+    "/expressions",
+    "/benchmark",
+};
+
+static double batchClock() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void initBuffer(BatchBuffer* buffer) {
+    buffer->chars = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+//the contents are always terminated, so a buffer can be compared as a string
+static void appendBuffer(BatchBuffer* buffer, const char* chars, size_t length) {
+    if (buffer->capacity < buffer->length + length + 1) {
+        size_t capacity = buffer->capacity < 64 ? 64 : buffer->capacity;
+        while (capacity < buffer->length + length + 1) capacity *= 2;
+        buffer->chars = (char*)realloc(buffer->chars, capacity);
+        if (buffer->chars == NULL) exit(1);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->chars + buffer->length, chars, length);
+    buffer->length += length;
+    buffer->chars[buffer->length] = '\0';
+}
+
+static void appendLine(BatchBuffer* buffer, const char* chars, size_t length) {
+    appendBuffer(buffer, chars, length);
+    appendBuffer(buffer, "\n", 1);
+}
+
+static const char* bufferText(BatchBuffer* buffer) {
+    return buffer->chars != NULL ? buffer->chars : "";
+}
+
+static void freeBuffer(BatchBuffer* buffer) {
+    free(buffer->chars);
+    initBuffer(buffer);
+}
+
+static void addScript(BatchJobList* list, const char* path) {
+    if (list->capacity < list->count + 1) {
+        list->capacity = list->capacity < 8 ? 8 : list->capacity * 2;
+        list->jobs = (BatchJob*)realloc(list->jobs, sizeof(BatchJob) * list->capacity);
+        if (list->jobs == NULL) exit(1);
+    }
+
+    BatchJob* job = &list->jobs[list->count++];
+    job->path = strdup(path);
+    if (job->path == NULL) exit(1);
+    job->pid = -1;
+    job->fds[0] = job->fds[1] = -1;
+    initBuffer(&job->output[0]);
+    initBuffer(&job->output[1]);
+    job->start = 0;
+    job->seconds = 0;
+    job->status = 0;
+    job->passed = false;
+}
+
+static bool isScript(const char* name) {
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".lox") == 0;
+}
+
+static bool isSkipped(const char* path) {
+    size_t length = strlen(path);
+    for (size_t i = 0; i < sizeof(expectSkips) / sizeof(expectSkips[0]); i++) {
+        size_t skipLength = strlen(expectSkips[i]);
+        if (length >= skipLength && strcmp(path + length - skipLength, expectSkips[i]) == 0) return true;
+    }
+    return false;
+}
+
+//every .lox file under directory, subdirectories included, less the skipped ones when checking
+static bool collectScripts(BatchJobList* list, const char* directory, bool checkExpect) {
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open directory \"%s\".\n", directory);
+        return false;
+    }
+
+    size_t length = strlen(directory);
+    bool separated = length > 0 && directory[length - 1] == '/';
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char* path = (char*)malloc(length + strlen(entry->d_name) + 2);
+        if (path == NULL) exit(1);
+        sprintf(path, separated ? "%s%s" : "%s/%s", directory, entry->d_name);
+
+        struct stat info;
+        if (stat(path, &info) != 0) {
+            free(path);
+            continue;
+        }
+
+        bool script = S_ISREG(info.st_mode) && isScript(entry->d_name);
+        if (checkExpect && (S_ISDIR(info.st_mode) || script) && isSkipped(path)) {
+            list->skipped++;
+            appendBuffer(&list->skippedPaths, "  ", 2);
+            appendLine(&list->skippedPaths, path, strlen(path));
+        }
+        else if (S_ISDIR(info.st_mode)) collectScripts(list, path, checkExpect);
+        else if (script) addScript(list, path);
+        free(path);
+    }
+    closedir(dir);
+    return true;
+}
+
+static int compareJobs(const void* a, const void* b) {
+    return strcmp(((const BatchJob*)a)->path, ((const BatchJob*)b)->path);
+}
+
+static int compareTimes(const void* a, const void* b) {
+    double left = (*(BatchJob* const*)a)->seconds;
+    double right = (*(BatchJob* const*)b)->seconds;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+//the child never returns, it runs the script with its stdout and stderr going down the pipes
+static bool startJob(BatchJobList* list, BatchJob* job, BatchRunner runner) {
+    int out[2];
+    int err[2];
+    if (pipe(out) != 0) return false;
+    if (pipe(err) != 0) {
+        close(out[0]);
+        close(out[1]);
+        return false;
+    }
+
+    //anything still buffered would otherwise be written again by the child
+    fflush(stdout);
+    fflush(stderr);
+
+    job->start = batchClock();
+    job->pid = fork();
+    if (job->pid < 0) {
+        close(out[0]);
+        close(out[1]);
+        close(err[0]);
+        close(err[1]);
+        return false;
+    }
+
+    if (job->pid == 0) {
+        for (int i = 0; i < list->count; i++) {
+            if (list->jobs[i].fds[0] >= 0) close(list->jobs[i].fds[0]);
+            if (list->jobs[i].fds[1] >= 0) close(list->jobs[i].fds[1]);
+        }
+        close(out[0]);
+        close(err[0]);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        close(out[1]);
+        close(err[1]);
+        exit(runner(job->path));
+    }
+
+    close(out[1]);
+    close(err[1]);
+    job->fds[0] = out[0];
+    job->fds[1] = err[0];
+    return true;
+}
+
+static void readJob(BatchJob* job, int stream) {
+    char chunk[BATCH_READ_SIZE];
+    ssize_t count = read(job->fds[stream], chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) return;
+    if (count <= 0) {
+        close(job->fds[stream]);
+        job->fds[stream] = -1;
+        return;
+    }
+    appendBuffer(&job->output[stream], chunk, (size_t)count);
+}
+
+//keep up to jobs scripts running, draining their pipes as they write so none of them
+//blocks on a full pipe, a script is done once both pipes are closed and it has exited
+static void runJobs(BatchJobList* list, int jobs, BatchRunner runner) {
+    struct pollfd* polls = (struct pollfd*)malloc(sizeof(struct pollfd) * jobs * 2);
+    BatchJob** pollJobs = (BatchJob**)malloc(sizeof(BatchJob*) * jobs * 2);
+    if (polls == NULL || pollJobs == NULL) exit(1);
+
+    int next = 0;
+    int running = 0;
+    int finished = 0;
+    while (finished < list->count) {
+        while (running < jobs && next < list->count) {
+            BatchJob* job = &list->jobs[next++];
+            if (startJob(list, job, runner)) {
+                running++;
+            }
+            else {
+                appendLine(&job->output[1], "Could not start the script.", 27);
+                job->status = -1;
+                finished++;
+            }
+        }
+
+        int pollCount = 0;
+        for (int i = 0; i < next; i++) {
+            BatchJob* job = &list->jobs[i];
+            for (int stream = 0; stream < 2; stream++) {
+                if (job->fds[stream] < 0) continue;
+                polls[pollCount].fd = job->fds[stream];
+                polls[pollCount].events = POLLIN;
+                pollJobs[pollCount++] = job;
+            }
+        }
+
+        if (pollCount > 0 && poll(polls, pollCount, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+
+        for (int i = 0; i < pollCount; i++) {
+            if (polls[i].revents == 0) continue;
+            BatchJob* job = pollJobs[i];
+            readJob(job, polls[i].fd == job->fds[0] ? 0 : 1);
+            if (job->fds[0] >= 0 || job->fds[1] >= 0) continue;
+
+            //both pipes closed, the script has exited or is about to
+            waitpid(job->pid, &job->status, 0);
+            job->seconds = batchClock() - job->start;
+            job->pid = -1;
+            running--;
+            finished++;
+        }
+    }
+
+    free(polls);
+    free(pollJobs);
+}
+
+//the comments the test suite writes its expectations in:
+//"// expect: text" is a line of output, "// expect runtime error: message" is the
+//first line of a runtime error, "// Error..." and "// [line n] Error..." are compile errors
+static bool readExpectations(const char* path, BatchExpectation* expect) {
+    initBuffer(&expect->output);
+    initBuffer(&expect->errors);
+    initBuffer(&expect->runtimeError);
+    expect->exitCode = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    char line[1024];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        lineNumber++;
+
+        const char* comment = strstr(line, "// ");
+        if (comment == NULL) continue;
+        comment += 3;
+
+        if (strncmp(comment, "expect: ", 8) == 0) {
+            appendLine(&expect->output, comment + 8, strlen(comment + 8));
+        }
+        else if (strncmp(comment, "expect runtime error: ", 22) == 0) {
+            appendBuffer(&expect->runtimeError, comment + 22, strlen(comment + 22));
+            expect->exitCode = BATCH_EXIT_RUNTIME_ERROR;
+        }
+        else if (strncmp(comment, "Error", 5) == 0) {
+            char error[1100];
+            int written = snprintf(error, sizeof(error), "[line %d] %s", lineNumber, comment);
+            appendLine(&expect->errors, error, (size_t)written < sizeof(error) ? (size_t)written : sizeof(error) - 1);
+            expect->exitCode = BATCH_EXIT_COMPILE_ERROR;
+        }
+        else if (comment[0] == '[') {
+            //errors only another implementation reports are marked "[java line n]"
+            const char* error = strncmp(comment, "[c line ", 8) == 0 ? comment + 3 : comment + 1;
+            int errorLine;
+            if (strncmp(error, "line ", 5) != 0 || sscanf(error, "line %d]", &errorLine) != 1) continue;
+            const char* message = strchr(error, ']') + 1;
+            if (strncmp(message, " Error", 6) != 0) continue;
+
+            char text[1100];
+            int written = snprintf(text, sizeof(text), "[line %d]%s", errorLine, message);
+            appendLine(&expect->errors, text, (size_t)written < sizeof(text) ? (size_t)written : sizeof(text) - 1);
+            expect->exitCode = BATCH_EXIT_COMPILE_ERROR;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void freeExpectations(BatchExpectation* expect) {
+    freeBuffer(&expect->output);
+    freeBuffer(&expect->errors);
+    freeBuffer(&expect->runtimeError);
+}
+
+static int exitCode(BatchJob* job) {
+    if (job->status < 0 || !WIFEXITED(job->status)) return -1;
+    return WEXITSTATUS(job->status);
+}
+
+static void describeExit(BatchJob* job, char* text, size_t size) {
+    if (job->status < 0) snprintf(text, size, "not started");
+    else if (WIFSIGNALED(job->status)) snprintf(text, size, "killed by signal %d", WTERMSIG(job->status));
+    else snprintf(text, size, "exit %d", WEXITSTATUS(job->status));
+}
+
+//print the lines of a captured stream indented under the script
+static void printIndented(const char* label, const char* text) {
+    if (text[0] == '\0') return;
+    printf("    %s:\n", label);
+    while (*text != '\0') {
+        size_t length = strcspn(text, "\n");
+        printf("      %.*s\n", (int)length, text);
+        text += length;
+        if (*text == '\n') text++;
+    }
+}
+
+//point out the first line where the expected and the actual output differ
+static void compareOutput(const char* expected, const char* actual) {
+    int line = 1;
+    while (*expected != '\0' || *actual != '\0') {
+        size_t expectedLength = strcspn(expected, "\n");
+        size_t actualLength = strcspn(actual, "\n");
+        if (expectedLength != actualLength || memcmp(expected, actual, expectedLength) != 0 ||
+            (expected[expectedLength] == '\0') != (actual[actualLength] == '\0')) {
+            if (*expected == '\0') printf("    line %d: expected no more output but got '%.*s'\n", line, (int)actualLength, actual);
+            else if (*actual == '\0') printf("    line %d: expected '%.*s' but got no more output\n", line, (int)expectedLength, expected);
+            else printf("    line %d: expected '%.*s' but got '%.*s'\n", line, (int)expectedLength, expected, (int)actualLength, actual);
+            return;
+        }
+        expected += expectedLength;
+        actual += actualLength;
+        if (*expected == '\n') expected++;
+        if (*actual == '\n') actual++;
+        line++;
+    }
+}
+
+//a script passes when it exits the way its comments say, prints exactly the expected output
+//and reports exactly the expected errors, failures are explained as they are found
+static bool checkJob(BatchJob* job) {
+    BatchExpectation expect;
+    if (!readExpectations(job->path, &expect)) {
+        printf("FAIL %9.2f ms  %s\n    could not read the script\n", job->seconds * 1000, job->path);
+        return false;
+    }
+
+    const char* output = bufferText(&job->output[0]);
+    const char* errors = bufferText(&job->output[1]);
+    bool passed = exitCode(job) == expect.exitCode && strcmp(output, bufferText(&expect.output)) == 0;
+    if (expect.exitCode == BATCH_EXIT_COMPILE_ERROR) {
+        passed = passed && strcmp(errors, bufferText(&expect.errors)) == 0;
+    }
+    else if (expect.exitCode == BATCH_EXIT_RUNTIME_ERROR) {
+        size_t length = strcspn(errors, "\n");
+        passed = passed && length == expect.runtimeError.length &&
+                 memcmp(errors, expect.runtimeError.chars, length) == 0;
+    }
+    else {
+        passed = passed && errors[0] == '\0';
+    }
+
+    printf("%s %9.2f ms  %s\n", passed ? "PASS" : "FAIL", job->seconds * 1000, job->path);
+    if (!passed) {
+        char status[64];
+        describeExit(job, status, sizeof(status));
+        if (exitCode(job) != expect.exitCode) printf("    %s, expected exit %d\n", status, expect.exitCode);
+        compareOutput(bufferText(&expect.output), output);
+        if (expect.exitCode == BATCH_EXIT_RUNTIME_ERROR) {
+            printf("    expected runtime error '%s'\n", bufferText(&expect.runtimeError));
+        }
+        printIndented("expected errors", bufferText(&expect.errors));
+        printIndented("stderr", errors);
+    }
+
+    freeExpectations(&expect);
+    return passed;
+}
+
+int runBatch(const char* directory, int jobs, bool checkExpect, BatchRunner runner) {
+    BatchJobList list;
+    list.jobs = NULL;
+    list.count = 0;
+    list.capacity = 0;
+    list.skipped = 0;
+    initBuffer(&list.skippedPaths);
+    if (!collectScripts(&list, directory, checkExpect)) return 1;
+    if (list.count == 0) {
+        fprintf(stderr, "No .lox files under \"%s\".\n", directory);
+        return 1;
+    }
+    qsort(list.jobs, list.count, sizeof(BatchJob), compareJobs);
+    if (jobs > list.count) jobs = list.count;
+
+    double start = batchClock();
+    runJobs(&list, jobs, runner);
+    double wall = batchClock() - start;
+
+    //results are reported in path order, whatever order the scripts finished in
+    int passed = 0;
+    double scriptTime = 0;
+    for (int i = 0; i < list.count; i++) {
+        BatchJob* job = &list.jobs[i];
+        scriptTime += job->seconds;
+        if (checkExpect) {
+            job->passed = checkJob(job);
+        }
+        else {
+            char status[64];
+            describeExit(job, status, sizeof(status));
+            job->passed = exitCode(job) == 0;
+            printf("== %s (%s, %.2f ms)\n", job->path, status, job->seconds * 1000);
+            fputs(bufferText(&job->output[0]), stdout);
+            fputs(bufferText(&job->output[1]), stdout);
+        }
+        if (job->passed) passed++;
+    }
+
+    BatchJob** slowest = (BatchJob**)malloc(sizeof(BatchJob*) * list.count);
+    if (slowest == NULL) exit(1);
+    for (int i = 0; i < list.count; i++) slowest[i] = &list.jobs[i];
+    qsort(slowest, list.count, sizeof(BatchJob*), compareTimes);
+
+    printf("\n%d passed, %d failed, %d scripts in %.2f s on %d worker%s (%.2f s of script time)\n",
+           passed, list.count - passed, list.count, wall, jobs, jobs == 1 ? "" : "s", scriptTime);
+    if (list.skipped > 0) {
+        printf("skipped %d path%s not written for this interpreter:\n", list.skipped, list.skipped == 1 ? "" : "s");
+        fputs(bufferText(&list.skippedPaths), stdout);
+    }
+    printf("slowest:\n");
+    for (int i = 0; i < list.count && i < BATCH_SLOWEST; i++) {
+        printf("  %9.2f ms  %s\n", slowest[i]->seconds * 1000, slowest[i]->path);
+    }
+    free(slowest);
+
+    for (int i = 0; i < list.count; i++) {
+        free(list.jobs[i].path);
+        freeBuffer(&list.jobs[i].output[0]);
+        freeBuffer(&list.jobs[i].output[1]);
+    }
+    free(list.jobs);
+    freeBuffer(&list.skippedPaths);
+    return passed == list.count ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef lox_LoxBatch_h
+#define lox_LoxBatch_h
+
+#include "common.h"
+
+//exit statuses of a script run, as clox reports them
+#define BATCH_EXIT_COMPILE_ERROR 65
+#define BATCH_EXIT_RUNTIME_ERROR 70
+
+//runs one script in a freshly forked process and returns its exit status,
+//whatever it writes to stdout and stderr is captured by the batch
+typedef int (*BatchRunner)(const char* path);
+
+//runs every .lox file under directory on up to jobs processes at a time,
+//checking each one against its expect comments if checkExpect is set,
+//returns 0 if every script passed
+int runBatch(const char* directory, int jobs, bool checkExpect, BatchRunner runner);
+
+#endif
@@ -1,45 +1,74 @@
-#include <stdlib.h>
-
-#include "LoxChunk.h"
-#include "memory.h"
-#include "LoxVM.h"
-
-void initChunk(LoxChunk* chunk) {
-  chunk->count = 0;
-  chunk->capacity = 0;
-  chunk->code = NULL;
-  chunk->lines = NULL;
-
-  initLoxValueArray(&chunk->constants);
-}
-
-void freeChunk(LoxChunk* chunk) {
-  FreeArr(uint8_t, chunk->code, chunk->capacity);
-  FreeArr(int, chunk->lines, chunk->capacity);
-
-  freeLoxValueArray(&chunk->constants);
-//< chunk-free-constants
-  initChunk(chunk);
-}
-
-void writeChunk(LoxChunk* chunk, uint8_t byte, int line) {
-  if (chunk->capacity < chunk->count + 1) {
-    int oldCap = chunk->capacity;
-    chunk->capacity = GrowCap(oldCap);
-    chunk->code = GrowArr(uint8_t, chunk->code,
-        oldCap, chunk->capacity);
-    chunk->lines = GrowArr(int, chunk->lines,
-        oldCap, chunk->capacity);
-  }
-
-  chunk->code[chunk->count] = byte;
-  chunk->lines[chunk->count] = line;
-  chunk->count++;
-}
-
-int addConstant(LoxChunk* chunk, LoxValue value) {
-  push(value);
-  writeLoxValueArray(&chunk->constants, value);
-  pop();
-  return chunk->constants.count - 1;
-}
+#include <stdlib.h>
+#include <string.h>
+
+#include "LoxChunk.h"
+#include "memory.h"
+#include "LoxVM.h"
+
+void initChunk(LoxChunk* chunk) {
+  chunk->count = 0;
+  chunk->capacity = 0;
+  chunk->code = NULL;
+  chunk->lines = NULL;
+
+  initLoxValueArray(&chunk->constants);
+}
+
+void freeChunk(LoxVM* vm, LoxChunk* chunk) {
+  FreeArr(vm, uint8_t, chunk->code, chunk->capacity);
+  FreeArr(vm, int, chunk->lines, chunk->capacity);
+
+  freeLoxValueArray(vm, &chunk->constants);
+//< chunk-free-constants
+  initChunk(chunk);
+}
+
+//while a function is being compiled its chunk grows in the compiler's arena
+void writeChunk(LoxChunk* chunk, uint8_t byte, int line, LoxArena* arena) {
+  if (chunk->capacity < chunk->count + 1) {
+    int oldCap = chunk->capacity;
+    chunk->capacity = GrowCap(oldCap);
+    chunk->code = ArenaGrowArr(arena, uint8_t, chunk->code,
+        oldCap, chunk->capacity);
+    chunk->lines = ArenaGrowArr(arena, int, chunk->lines,
+        oldCap, chunk->capacity);
+  }
+
+  chunk->code[chunk->count] = byte;
+  chunk->lines[chunk->count] = line;
+  chunk->count++;
+}
+
+int addConstant(LoxChunk* chunk, LoxValue value, LoxArena* arena) {
+  LoxValueArray* constants = &chunk->constants;
+  if (constants->capacity < constants->count + 1) {
+    int oldCap = constants->capacity;
+    constants->capacity = GrowCap(oldCap);
+    constants->values = ArenaGrowArr(arena, LoxValue, constants->values,
+        oldCap, constants->capacity);
+  }
+
+  constants->values[constants->count] = value;
+  return constants->count++;
+}
+
+//once the function is complete, copy its chunk out of the arena into
+//arrays of exactly its size that the chunk owns from then on
+void commitChunk(LoxVM* vm, LoxChunk* chunk) {
+  uint8_t* code = ALLOCATE(vm, uint8_t, chunk->count);
+  int* lines = ALLOCATE(vm, int, chunk->count);
+  LoxValue* values = ALLOCATE(vm, LoxValue, chunk->constants.count);
+  if (chunk->count > 0) {
+    memcpy(code, chunk->code, chunk->count);
+    memcpy(lines, chunk->lines, sizeof(int) * chunk->count);
+  }
+  if (chunk->constants.count > 0) {
+    memcpy(values, chunk->constants.values, sizeof(LoxValue) * chunk->constants.count);
+  }
+
+  chunk->code = code;
+  chunk->lines = lines;
+  chunk->capacity = chunk->count;
+  chunk->constants.values = values;
+  chunk->constants.capacity = chunk->constants.count;
+}
@@ -1,62 +1,71 @@
-#ifndef lox_LoxChunk_h
-#define lox_LoxChunk_h
-
-#include "common.h"
-#include "LoxValue.h"
-
-//the type of instructions we will see within the bytes of opcode 
-typedef enum {
-  OP_CONSTANT,
-  OP_NIL,
-  OP_TRUE,
-  OP_FALSE,
-  OP_POP,
-  OP_GET_LOCAL,
-  OP_SET_LOCAL,
-  OP_GET_GLOBAL,
-  OP_DEFINE_GLOBAL,
-  OP_SET_GLOBAL,
-  OP_GET_UPVALUE,
-  OP_SET_UPVALUE,
-  OP_GET_PROPERTY,
-  OP_SET_PROPERTY,
-  OP_GET_SUPER,
-  OP_EQUAL,
-  OP_GREATER,
-  OP_LESS,
-  OP_ADD,
-  OP_SUBTRACT,
-  OP_MULTIPLY,
-  OP_DIVIDE,
-  OP_NOT,
-  OP_NEGATE,
-  OP_PRINT,
-  OP_JUMP,
-  OP_JUMP_IF_FALSE,
-  OP_LOOP,
-  OP_CALL,
-  OP_INVOKE,
-  OP_SUPER_INVOKE,
-  OP_CLOSURE,
-  OP_CLOSE_UPVALUE,
-  OP_RETURN,
-  OP_CLASS,
-  OP_INHERIT,
-  OP_METHOD
-} OpCode;
-
-typedef struct {
-  int count;
-  int capacity;
-  uint8_t* code;
-  int* lines;
-  LoxValueArray constants;
-} LoxChunk;
-
-//functions to declare and set chunks of byte code instructions
-void initChunk(LoxChunk* chunk);
-void freeChunk(LoxChunk* chunk);
-void writeChunk(LoxChunk* chunk, uint8_t byte, int line);
-int addConstant(LoxChunk* chunk, LoxValue value);
-
+#ifndef lox_LoxChunk_h
+#define lox_LoxChunk_h
+
+#include "common.h"
+#include "LoxArena.h"
+#include "LoxValue.h"
+
+//the type of instructions we will see within the bytes of opcode 
+typedef enum {
+  OP_CONSTANT,
+  OP_CONSTANT_LONG,
+  OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
+  OP_POP,
+  OP_GET_LOCAL,
+  OP_SET_LOCAL,
+  OP_GET_GLOBAL,
+  OP_DEFINE_GLOBAL,
+  OP_SET_GLOBAL,
+  OP_GET_UPVALUE,
+  OP_SET_UPVALUE,
+  OP_GET_PROPERTY,
+  OP_SET_PROPERTY,
+  OP_GET_SUPER,
+  OP_EQUAL,
+  OP_GREATER,
+  OP_LESS,
+  OP_ADD,
+  OP_SUBTRACT,
+  OP_MULTIPLY,
+  OP_DIVIDE,
+  OP_NOT,
+  OP_NEGATE,
+  OP_PRINT,
+  OP_JUMP,
+  OP_JUMP_IF_FALSE,
+  OP_LOOP,
+  OP_CALL,
+  OP_INVOKE,
+  OP_SUPER_INVOKE,
+  OP_CLOSURE,
+  OP_CLOSE_UPVALUE,
+  OP_RETURN,
+  OP_CLASS,
+  OP_INHERIT,
+  OP_METHOD,
+  OP_WIDE
+} OpCode;
+
+//flag bits of the upvalue descriptors that follow OP_CLOSURE
+//UPVALUE_LONG means the index is 3 bytes instead of 1
+#define UPVALUE_LOCAL 0x1
+#define UPVALUE_LONG  0x2
+
+typedef struct {
+  int count;
+  int capacity;
+  uint8_t* code;
+  int* lines;
+  LoxValueArray constants;
+} LoxChunk;
+
+//functions to declare and set chunks of byte code instructions
+void initChunk(LoxChunk* chunk);
+void freeChunk(LoxVM* vm, LoxChunk* chunk);
+void writeChunk(LoxChunk* chunk, uint8_t byte, int line, LoxArena* arena);
+int addConstant(LoxChunk* chunk, LoxValue value, LoxArena* arena);
+void commitChunk(LoxVM* vm, LoxChunk* chunk);
+
 #endif
\ No newline at end of file
@@ -1,992 +1,1094 @@
-    #include <stdio.h>
-    #include <stdlib.h>
-    #include <string.h>
-
-    #include "common.h"
-    #include "LoxCompiler.h"
-    #include "memory.h"
-    #include "LoxScanner.h"
-
-    #ifdef DEBUG_PRINT_CODE
-    #include "LoxDebugger.h"
-    #endif
-
-
-    typedef struct {
-        LoxToken current;
-        LoxToken previous;
-        bool hadError;
-        bool resync;
-    } LoxParser;
-
-    typedef enum {
-        PREC_NONE,
-        PREC_ASSIGNMENT,  // =
-        PREC_OR,          // or
-        PREC_AND,         // and
-        PREC_EQUALITY,    // == !=
-        PREC_COMPARISON,  // < > <= >=
-        PREC_TERM,        // + -
-        PREC_FACTOR,      // * /
-        PREC_UNARY,       // ! -
-        PREC_CALL,        // . ()
-        PREC_PRIMARY
-    } LoxPrecedence;
-  
-    typedef void (*ParseFunc)(bool assignable);
-
-
-    typedef struct {
-        ParseFunc prefix;
-        ParseFunc infix;
-        LoxPrecedence precedence;
-    } LoxParsePrecRule;
-
-
-    typedef struct {
-        LoxToken name;
-        int depth;
-        bool isCaptured;
-    } Local;
-
-    typedef struct {
-        uint8_t index;
-        bool isLocal;
-    } Upvalue;
-  
-    typedef enum {
-        TYPE_FUNCTION,
-        TYPE_INITIALIZER,
-        TYPE_METHOD,
-        TYPE_SCRIPT
-    } FunctionType;
-
-    typedef struct Compiler {
-        struct Compiler* enclosing;
-
-        LoxObjFunction* function;
-        FunctionType type;
-
-        Local locals[UINT8_COUNT];
-        int localCount;
-        Upvalue upvalues[UINT8_COUNT];
-        int scopeDepth;
-    } LoxCompiler;
-
-
-    typedef struct ClassCompiler {
-        struct ClassCompiler* enclosing;
-        bool hasSuperclass;
-    } ClassCompiler;
-
-    LoxParser parser;
-  
-    LoxCompiler* current = NULL;
-
-    ClassCompiler* currentClass = NULL;
-
-    static LoxChunk* currentChunk() {
-        return &current->function->chunk;
-    }
-   
-    static void errorAt(LoxToken* token, const char* msg) {
-        if (parser.resync) return;
-
-        parser.resync = true;
-        fprintf(stderr, "[line %d] Error", token->line);
-
-        if (token->type == TOKEN_EOF) {
-            fprintf(stderr, " at end");
-        } else if (token->type == TOKEN_ERROR) {
-            // do nothing, already handling error
-        } 
-        else{
-            fprintf(stderr, " at '%.*s'", token->length, token->start);
-        }
-
-        fprintf(stderr, ": %s\n", msg);
-        parser.hadError = true;
-    }
-
-    static void parseError(const char* msg){
-        errorAt(&parser.previous, msg);
-    }
-   
-    static void parseErrorAtCurrent(const char* msg) {
-        errorAt(&parser.current, msg);
-    }
-  
-    static void advance() {
-        parser.previous = parser.current;
-
-        for (;;){
-            parser.current = scanToken();
-            if (parser.current.type != TOKEN_ERROR) break;
-
-            parseErrorAtCurrent(parser.current.start);
-        }
-    }
-  
-    static void consumeToken(TokenType type, const char* message) {
-        if (parser.current.type == type) {
-            advance();
-            return;
-        }
-
-        parseErrorAtCurrent(message);
-    }
-
-    static bool check(TokenType type) {
-        return parser.current.type == type;
-    }
-
-    static bool match(TokenType type) {
-        if (!check(type)) return false;
-        advance();
-        return true;
-    }
-   
-    static void emitByte(uint8_t byte) {
-        writeChunk(currentChunk(), byte, parser.previous.line);
-    }
-
-    static void emitBytes(uint8_t byte1, uint8_t byte2) {
-        emitByte(byte1);
-        emitByte(byte2);
-    }
-    
-    static void emitLoop(int loopStart) {
-        emitByte(OP_LOOP);
-
-        int offset = currentChunk()->count - loopStart + 2;
-        if (offset > UINT16_MAX) parseError("Loop body too large.");
-
-        emitByte((offset >> 8) & 0xff);
-        emitByte(offset & 0xff);
-    }
-    
-    static int emitJump(uint8_t instruction) {
-        emitByte(instruction);
-        emitByte(0xff);
-        emitByte(0xff);
-        return (currentChunk()->count - 2);
-    }
-   
-    static void emitReturn() {
-        if (current->type == TYPE_INITIALIZER){
-            emitBytes(OP_GET_LOCAL, 0);
-        } 
-        else{
-            emitByte(OP_NIL);
-        }
-
-        emitByte(OP_RETURN);
-    }
-  
-    static uint8_t makeConstant(LoxValue value){
-        int constant = addConstant(currentChunk(), value);
-        if (constant > UINT8_MAX){
-            parseError("Too many constants in one chunk");
-            return 0;
-        }
-
-        return (uint8_t)constant;
-    }
-
-    static void emitConstant(LoxValue value) {
-        emitBytes(OP_CONSTANT, makeConstant(value));
-    }
-
-    static void patchJump(int offset) {
-        int jump = currentChunk()->count - offset - 2;
-
-        if (jump > UINT16_MAX) {
-            parseError("Too much code to jump over");
-        }
-
-        currentChunk()->code[offset] = (jump >> 8) & 0xff;
-        currentChunk()->code[offset + 1] = jump & 0xff;
-    }
-  
-    //initialize the compiler for the lox code, sets scope values, environments, etc
-    static void initCompiler(LoxCompiler* compiler, FunctionType type) {
-        compiler->enclosing = current;
-        compiler->function = NULL;
-        compiler->type = type;
-        compiler->localCount = 0;
-        compiler->scopeDepth = 0;
-        compiler->function = newFunction();
-        current = compiler;
-        if (type != TYPE_SCRIPT) {
-            current->function->name = copyString(parser.previous.start, parser.previous.length);
-        }
-
-        Local* local = &current->locals[current->localCount++];
-        local->depth = 0;
-        local->isCaptured = false;
-        if (type != TYPE_FUNCTION) {
-            local->name.start = "this";
-            local->name.length = 4;
-        } 
-        else {
-            local->name.start = "";
-            local->name.length = 0;
-        }
-}
-  
-    static LoxObjFunction* endCompiler() {
-        emitReturn();
-        LoxObjFunction* function = current->function;
-
-        #ifdef DEBUG_PRINT_CODE
-        if (!parser.hadError) {
-            disassembleChunk(currentChunk(), function->name != NULL ? function->name->chars : "<script>");
-    }
-        #endif
-
-        current = current->enclosing;
-        return function;
-    }
-
-    //create new scope for any new classes, funcs, loops, etc
-    static void beginScope() {
-        current->scopeDepth++;
-    }
-   
-    //close the scope of the current Lox environments - functions, classes, loops, etc
-    static void endScope() {
-        current->scopeDepth--;
-        while (current->localCount > 0 && current->locals[current->localCount - 1].depth > current->scopeDepth) {
-            if (current->locals[current->localCount - 1].isCaptured) {
-            emitByte(OP_CLOSE_UPVALUE);
-            } 
-            else {
-                emitByte(OP_POP);
-            }
-            current->localCount--;
-        }
-    }
-
-    //declare functions here to avoid any undeclared/unreferenced errors
-    static void handleExpression();
-    static void handleStatement();
-    static void handleDeclaration();
-    static LoxParsePrecRule* getRule(TokenType type);
-    static void parserPrecedence(LoxPrecedence precedence);
-
-
-    static uint8_t identifierConstant(LoxToken* name) {
-        return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
-    }
-  
-    static bool identifiersEqual(LoxToken* left, LoxToken* right) {
-        if (left->length != right->length) return false;
-        return memcmp(left->start, right->start, left->length) == 0;
-    }
-   
-    static int resolveLocal(LoxCompiler* compiler, LoxToken* name) {
-    for (int i = compiler->localCount - 1; i >= 0; i--) {
-        Local* local = &compiler->locals[i];
-        if (identifiersEqual(name, &local->name)) {
-        if (local->depth == -1) {
-            parseError("Can't read local variable in its own initializer");
-        }
-        return i;
-        }
-    }
-    return -1;
-}
-
-    static int addUpvalue(LoxCompiler* compiler, uint8_t index, bool isLocal) {
-        int upvalueCount = compiler->function->upvalueCount;
-
-        for (int i = 0; i < upvalueCount; i++) {
-            Upvalue* upvalue = &compiler->upvalues[i];
-            if (upvalue->index == index && upvalue->isLocal == isLocal) {
-            return i;
-            }
-        }
-
-
-        if (upvalueCount == UINT8_COUNT) {
-            parseError("Too many closure variables in function.");
-            return 0;
-        }
-
-        compiler->upvalues[upvalueCount].isLocal = isLocal;
-        compiler->upvalues[upvalueCount].index = index;
-        return compiler->function->upvalueCount++;
-}
-
-    static int resolveUpvalue(LoxCompiler* compiler, LoxToken* name) {
-        if (compiler->enclosing == NULL) return -1;
-
-        int local = resolveLocal(compiler->enclosing, name);
-        if (local != -1) {
-            compiler->enclosing->locals[local].isCaptured = true;
-            return addUpvalue(compiler, (uint8_t)local, true);
-        }
-
-        int upvalue = resolveUpvalue(compiler->enclosing, name);
-        if (upvalue != -1) {
-            return addUpvalue(compiler, (uint8_t)upvalue, false);
-        }
-        
-        return -1;
-    }
-
-    static void addLocal(LoxToken name) {
-        if (current->localCount == UINT8_COUNT) {
-            parseError("Too many local variables in function.");
-            return;
-        }
-
-        Local* local = &current->locals[current->localCount++];
-        local->name = name;
-        local->depth = -1;
-        local->isCaptured = false;
-    }
-
-    //parse through the local variables of the current scope, 
-    //add the variable if it is unique within a non-zero scope
-    static void declareVariable() {
-        if (current->scopeDepth == 0) return;
-
-        LoxToken* name = &parser.previous;
-
-        for (int i = current->localCount - 1; i >= 0; i--) {
-            Local* local = &current->locals[i];
-            if (local->depth != -1 && local->depth < current->scopeDepth) {
-                break; 
-            }
-
-            //check for variables with same name already in the scope
-            if (identifiersEqual(name, &local->name)) {
-                parseError("Already a variable with this name in this scope");
-            }
-        }
-
-        addLocal(*name);
-    }
-    
-    static uint8_t parseVariable(const char* errorMessage) {
-        consumeToken(TOKEN_IDENTIFIER, errorMessage);
-
-        declareVariable();
-        if (current->scopeDepth > 0) return 0;
-
-        return identifierConstant(&parser.previous);
-    }
- 
-    //mark the variable as initialized to avoid conflict of declaration
-    static void markInitialized() {
-        if (current->scopeDepth == 0) return;
-        current->locals[current->localCount - 1].depth =
-            current->scopeDepth;
-    }
-
-
-    static void defineVariable(uint8_t global) {
-        if (current->scopeDepth > 0) {
-            markInitialized();
-            return;
-        }
-
-        emitBytes(OP_DEFINE_GLOBAL, global);
-    }
-
-    //checking the arguments passed to a func, process the list of arguments for each declared functions
-    static uint8_t argumentList() {
-        uint8_t argCount = 0;
-        if (!check(TOKEN_RIGHT_PAREN)) {
-            //while there are more arguments to process, use expression func to handle each one
-            do {
-                handleExpression();
-                if (argCount == 255) {
-                    parseError("Can't have more than 255 arguments");
-            }
-                argCount++;
-            } while (match(TOKEN_COMMA));
-        }
-        consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after arguments");
-        return argCount;
-    }
-    
-    static void and_(bool canAssign) {
-        int endJump = emitJump(OP_JUMP_IF_FALSE);
-
-        emitByte(OP_POP);
-        parserPrecedence(PREC_AND);
-
-        patchJump(endJump);
-    }
-
-    static void binaryOps(bool assignable) {
-        TokenType operatorType = parser.previous.type;
-        LoxParsePrecRule* rule = getRule(operatorType);
-        parserPrecedence((LoxPrecedence)(rule->precedence + 1));
-
-        //handle each type of binary operations
-        switch (operatorType) {
-            case TOKEN_BANG_EQUAL:    emitBytes(OP_EQUAL, OP_NOT); break;
-            case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
-            case TOKEN_GREATER:       emitByte(OP_GREATER); break;
-            case TOKEN_GREATER_EQUAL: emitBytes(OP_LESS, OP_NOT); break;
-            case TOKEN_LESS:          emitByte(OP_LESS); break;
-            case TOKEN_LESS_EQUAL:    emitBytes(OP_GREATER, OP_NOT); break;
-            case TOKEN_PLUS:          emitByte(OP_ADD); break;
-            case TOKEN_MINUS:         emitByte(OP_SUBTRACT); break;
-            case TOKEN_STAR:          emitByte(OP_MULTIPLY); break;
-            case TOKEN_SLASH:         emitByte(OP_DIVIDE); break;
-            default: 
-                return;
-        }
-    }
-  
-    static void call(bool assignable) {
-        uint8_t argCount = argumentList();
-        emitBytes(OP_CALL, argCount);
-    }
-
-    static void dot(bool assignable) {
-        consumeToken(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-        uint8_t name = identifierConstant(&parser.previous);
-
-        if (assignable && match(TOKEN_EQUAL)) {
-            handleExpression();
-            emitBytes(OP_SET_PROPERTY, name);
-        } 
-        else if (match(TOKEN_LEFT_PAREN)) {
-            uint8_t argCount = argumentList();
-            emitBytes(OP_INVOKE, name);
-            emitByte(argCount);
-        } 
-        else {
-            emitBytes(OP_GET_PROPERTY, name);
-        }
-    }
-
-    static void handleLiterals(bool assignable) {
-        switch (parser.previous.type) {
-            case TOKEN_FALSE: emitByte(OP_FALSE); break;
-            case TOKEN_NIL: emitByte(OP_NIL); break;
-            case TOKEN_TRUE: emitByte(OP_TRUE); break;
-            default: 
-                return; 
-        }
-    }
-
-    static void handleGrouping(bool canAssign) {
-        handleExpression();
-        consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
-    }
-
-    static void handleNumbers(bool canAssign) {
-        double value = strtod(parser.previous.start, NULL);
-
-        emitConstant(NUMBER_VAL(value));
-    }
-   
-    static void or_(bool canAssign) {
-        int elseJump = emitJump(OP_JUMP_IF_FALSE);
-        int endJump = emitJump(OP_JUMP);
-
-        patchJump(elseJump);
-        emitByte(OP_POP);
-
-        parserPrecedence(PREC_OR);
-        patchJump(endJump);
-    }
-
-    static void handleStr(bool canAssign) {
-        emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
-    }
-
-    static void namedVariable(LoxToken name, bool assignable) {
-        uint8_t getOp, setOp;
-        int arg = resolveLocal(current, &name);
-        if (arg != -1) {
-            getOp = OP_GET_LOCAL;
-            setOp = OP_SET_LOCAL;
-        } 
-        else if ((arg = resolveUpvalue(current, &name)) != -1) {
-            getOp = OP_GET_UPVALUE;
-            setOp = OP_SET_UPVALUE;
-        } 
-        else {
-            arg = identifierConstant(&name);
-            getOp = OP_GET_GLOBAL;
-            setOp = OP_SET_GLOBAL;
-        }
-        if (assignable && match(TOKEN_EQUAL)){
-            handleExpression();
-            emitBytes(setOp, (uint8_t)arg);
-        } 
-        else{
-            emitBytes(getOp, (uint8_t)arg);
-        }
-    }
-
-    static void handleVariables(bool assignable) {
-        namedVariable(parser.previous, assignable);
-    }
-
-    static LoxToken syntheticToken(const char* text) {
-        LoxToken token;
-        token.start = text;
-        token.length = (int)strlen(text);
-        return token;
-    }
-
-
-    static void super_(bool canAssign) {
-        if (currentClass == NULL) {
-            parseError("Can't use 'super' outside of a class");
-        } 
-        else if (!currentClass->hasSuperclass) {
-            parseError("Can't use 'super' in a class with no superclass");
-        }
-
-        consumeToken(TOKEN_DOT, "Expect '.' after 'super'");
-        consumeToken(TOKEN_IDENTIFIER, "Expect superclass method name");
-        uint8_t name = identifierConstant(&parser.previous);
-        
-        namedVariable(syntheticToken("this"), false);
-
-        if (match(TOKEN_LEFT_PAREN)) {
-            uint8_t argCount = argumentList();
-            namedVariable(syntheticToken("super"), false);
-            emitBytes(OP_SUPER_INVOKE, name);
-            emitByte(argCount);
-        } 
-        else {
-            namedVariable(syntheticToken("super"), false);
-            emitBytes(OP_GET_SUPER, name);
-        }
-    }
-    
-    static void this_(bool canAssign) {
-        if (currentClass == NULL) {
-            parseError("Can't use 'this' outside of a class");
-            return;
-        }
-        
-        handleVariables(false);
-    } 
-
-    static void unaryOps(bool canAssign) {
-        TokenType operatorType = parser.previous.type;
-
-        parserPrecedence(PREC_UNARY);
-
-            switch (operatorType) {
-                case TOKEN_BANG: emitByte(OP_NOT); break;
-                case TOKEN_MINUS: emitByte(OP_NEGATE); break;
-                default: 
-                    return;
-            }
-    }
-    
-    //dict of parse rules to assign each type of token to a certain order of precedence
-    LoxParsePrecRule rules[] = {
-        [TOKEN_LEFT_PAREN]    = {handleGrouping, call,   PREC_CALL},
-        [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, 
-        [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_DOT]           = {NULL,     dot,    PREC_CALL},
-        [TOKEN_MINUS]         = {unaryOps, binaryOps, PREC_TERM},
-        [TOKEN_PLUS]          = {NULL,     binaryOps, PREC_TERM},
-        [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_SLASH]         = {NULL,     binaryOps, PREC_FACTOR},
-        [TOKEN_STAR]          = {NULL,     binaryOps, PREC_FACTOR},
-        [TOKEN_BANG]          = {unaryOps,    NULL,   PREC_NONE},
-        [TOKEN_BANG_EQUAL]    = {NULL,     binaryOps, PREC_EQUALITY},
-        [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_EQUAL_EQUAL]   = {NULL,     binaryOps, PREC_EQUALITY},
-        [TOKEN_GREATER]       = {NULL,     binaryOps, PREC_COMPARISON},
-        [TOKEN_GREATER_EQUAL] = {NULL,     binaryOps, PREC_COMPARISON},
-        [TOKEN_LESS]          = {NULL,     binaryOps, PREC_COMPARISON},
-        [TOKEN_LESS_EQUAL]    = {NULL,     binaryOps, PREC_COMPARISON},
-        [TOKEN_IDENTIFIER]    = {handleVariables, NULL,   PREC_NONE},
-        [TOKEN_STRING]        = {handleStr,   NULL,   PREC_NONE},
-        [TOKEN_NUMBER]        = {handleNumbers,   NULL,   PREC_NONE},
-        [TOKEN_AND]           = {NULL,     and_,   PREC_AND},
-        [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_FALSE]         = {handleLiterals,  NULL,   PREC_NONE},
-        [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_FUN]           = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_NIL]           = {handleLiterals,  NULL,   PREC_NONE},
-        [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
-        [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_SUPER]         = {super_,   NULL,   PREC_NONE},
-        [TOKEN_THIS]          = {this_,    NULL,   PREC_NONE},
-        [TOKEN_TRUE]          = {handleLiterals,  NULL,   PREC_NONE},
-        [TOKEN_VAR]           = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
-        [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
-    };
-    
-    static void parserPrecedence(LoxPrecedence precedence) {
-        advance();
-
-        ParseFunc prefixRule = getRule(parser.previous.type)->prefix;
-
-        if (prefixRule == NULL) {
-            parseError("Expect expression");
-            return;
-}
-
-        bool canAssign = precedence <= PREC_ASSIGNMENT;
-        prefixRule(canAssign);
-
-        while (precedence <= getRule(parser.current.type)->precedence) {
-            advance();
-            ParseFunc infixRule = getRule(parser.previous.type)->infix;
-            infixRule(canAssign);
-        }
-
-        if (canAssign && match(TOKEN_EQUAL)) {
-            parseError("Invalid assignment target.");
-        }
- 
-    }
-   
-    static LoxParsePrecRule* getRule(TokenType type) {
-        return &rules[type];
-    }
-
-    static void handleExpression() {
-        parserPrecedence(PREC_ASSIGNMENT);
-    }
-
-    static void block() {
-        while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-            handleDeclaration();
-        }
-
-        consumeToken(TOKEN_RIGHT_BRACE, "Expect '}' after block");
-    }
-   
-    static void function(FunctionType type) {
-        LoxCompiler compiler;
-        initCompiler(&compiler, type);
-        //create new scope for function variables, expressions, etc
-        beginScope(); 
-
-        consumeToken(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
-        if (!check(TOKEN_RIGHT_PAREN)) {
-            do {
-            current->function->arity++;
-            if (current->function->arity > 255) {
-                parseErrorAtCurrent("Can't have more than 255 parameters.");
-            }
-            uint8_t constant = parseVariable("Expect parameter name.");
-            defineVariable(constant);
-            } while (match(TOKEN_COMMA));
-        }
-        consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
-        consumeToken(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
-        block();
-
-        LoxObjFunction* function = endCompiler();
-
-        emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
-
-        for (int i = 0; i < function->upvalueCount; i++) {
-            emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
-            emitByte(compiler.upvalues[i].index);
-        }
-
-}
-    static void handleMethods() {
-        consumeToken(TOKEN_IDENTIFIER, "Expect method name.");
-        uint8_t constant = identifierConstant(&parser.previous);
-
-        FunctionType type = TYPE_METHOD;
-
-        if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
-            type = TYPE_INITIALIZER;
-        }
-        
-        function(type);
-        emitBytes(OP_METHOD, constant);
-    }
- 
-    static void classDeclaration() {
-        consumeToken(TOKEN_IDENTIFIER, "Expect class name");
-        LoxToken className = parser.previous;
-        uint8_t nameConstant = identifierConstant(&parser.previous);
-        declareVariable();
-
-        emitBytes(OP_CLASS, nameConstant);
-        defineVariable(nameConstant);
-
-        ClassCompiler classCompiler;
-        classCompiler.hasSuperclass = false;
-        classCompiler.enclosing = currentClass;
-        currentClass = &classCompiler;
-
-        if (match(TOKEN_LESS)) {
-            consumeToken(TOKEN_IDENTIFIER, "Expect superclass name");
-            handleVariables(false);
-
-            if (identifiersEqual(&className, &parser.previous)) {
-                parseError("A class can't inherit from itself");
-            }
-
-            beginScope();
-            addLocal(syntheticToken("super"));
-            defineVariable(0);
-            
-            namedVariable(className, false);
-            emitByte(OP_INHERIT);
-            classCompiler.hasSuperclass = true;
-        }
-        
-        namedVariable(className, false);
-
-        consumeToken(TOKEN_LEFT_BRACE, "Expect '{' before class body");
-
-        while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-            handleMethods();
-        }
-
-        consumeToken(TOKEN_RIGHT_BRACE, "Expect '}' after class body");
-        emitByte(OP_POP);
-
-        if (classCompiler.hasSuperclass) {
-            endScope();
-        }
-
-        currentClass = currentClass->enclosing;
-    }
-    
-    static void funDeclaration() {
-        uint8_t global = parseVariable("Expecting function name");
-        markInitialized();
-        function(TYPE_FUNCTION);
-        defineVariable(global);
-    }
-
-    static void varDeclaration() {
-    uint8_t global = parseVariable("Expect variable name.");
-    if (match(TOKEN_EQUAL)) {
-        handleExpression();
-    } 
-    else {
-        emitByte(OP_NIL);
-    }
-    consumeToken(TOKEN_SEMICOLON,
-            "Expect ';' after variable declaration.");
-    defineVariable(global);
-    }
-
-    static void expressionStatement() {
-        handleExpression();
-        consumeToken(TOKEN_SEMICOLON, "Expect ';' after expression.");
-        emitByte(OP_POP);
-    }
-
-    //handle the possible tokens/environments within for loops
-    static void forStatement() {
-        //open new scope for the new vars, expressions of the for loop
-        beginScope();
-
-        consumeToken(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
-        if (match(TOKEN_SEMICOLON)) {
-            // for(;;), nothing important
-        } 
-        else if (match(TOKEN_VAR)) {
-            varDeclaration();
-        } 
-        else {
-            expressionStatement();
-        }
-
-        int loopStart = currentChunk()->count;
-
-        int exitJump = -1;
-        if (!match(TOKEN_SEMICOLON)) {
-            handleExpression();
-            consumeToken(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
-
-            exitJump = emitJump(OP_JUMP_IF_FALSE);
-            emitByte(OP_POP); 
-        }
-
-        if (!match(TOKEN_RIGHT_PAREN)) {
-            int bodyJump = emitJump(OP_JUMP);
-            int incrementStart = currentChunk()->count;
-            handleExpression();
-            emitByte(OP_POP);
-            consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
-
-            emitLoop(loopStart);
-            loopStart = incrementStart;
-            patchJump(bodyJump);
-        }
-
-        handleStatement();
-        emitLoop(loopStart);
-
-        if (exitJump != -1) {
-            patchJump(exitJump);
-            emitByte(OP_POP); 
-        }
-
-        //close the current scope for the for loop's variables, expressions, etc
-        endScope();
-}
-  
-    static void ifStatement() {
-        consumeToken(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
-        handleExpression();
-        consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after condition."); 
-
-        int thenJump = emitJump(OP_JUMP_IF_FALSE);
-        emitByte(OP_POP);
-        handleStatement();
-
-        int elseJump = emitJump(OP_JUMP);
-
-        patchJump(thenJump);
-        emitByte(OP_POP);
-
-        if (match(TOKEN_ELSE)) handleStatement();
-        patchJump(elseJump);
-    }
-        
-    static void printStatement() {
-        handleExpression();
-        consumeToken(TOKEN_SEMICOLON, "Expect ';' after value.");
-        emitByte(OP_PRINT);
-        }
-    
-        static void returnStatement() {
-        if (current->type == TYPE_SCRIPT) {
-            parseError("Can't return from top-level code.");
-        }
-
-        //< return-from-script
-        if (match(TOKEN_SEMICOLON)) {
-            emitReturn();
-        } else {
-            if (current->type == TYPE_INITIALIZER) {
-                parseError("Can't return a value from an initializer.");
-            }
-
-            handleExpression();
-            consumeToken(TOKEN_SEMICOLON, "Expect ';' after return value.");
-            emitByte(OP_RETURN);
-        }
-    }
-    static void whileStatement() {
-        int loopStart = currentChunk()->count;
-        consumeToken(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
-        handleExpression();
-        consumeToken(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
-
-        int exitJump = emitJump(OP_JUMP_IF_FALSE);
-
-        emitByte(OP_POP);
-        handleStatement();
-        emitLoop(loopStart);
-        patchJump(exitJump);
-        emitByte(OP_POP);
-
-    }
-    static void synchronize() {
-        parser.resync = false;
-
-        while (parser.current.type != TOKEN_EOF) {
-            if (parser.previous.type == TOKEN_SEMICOLON) return;
-            switch (parser.current.type) {
-            case TOKEN_CLASS:
-            case TOKEN_FUN:
-            case TOKEN_VAR:
-            case TOKEN_FOR:
-            case TOKEN_IF:
-            case TOKEN_WHILE:
-            case TOKEN_PRINT:
-            case TOKEN_RETURN:
-                return;
-            default:
-                ; 
-            }
-            advance();
-        }
-    }
-
-static void handleDeclaration() {
-    if (match(TOKEN_CLASS)) {
-        classDeclaration();
-    } 
-    else if (match(TOKEN_FUN)) {
-        funDeclaration();
-    } 
-    else if (match(TOKEN_VAR)) {
-        varDeclaration();
-    } 
-    else {
-        handleStatement();
-    }
-        //similar to the sync() from c#
-        //use the resync bool since we have no exceptions
-        if (parser.resync) synchronize();
-    }
-
-    static void handleStatement() {
-    if (match(TOKEN_PRINT)) {
-        printStatement();
-    } 
-    else if (match(TOKEN_FOR)) {
-        forStatement();
-    } 
-    else if (match(TOKEN_IF)) {
-        ifStatement();
-    } 
-    else if (match(TOKEN_RETURN)) {
-        returnStatement();
-    } 
-    else if (match(TOKEN_WHILE)) {
-        whileStatement();
-    } 
-    else if (match(TOKEN_LEFT_BRACE)) {
-        beginScope();
-        block();
-        endScope();
-    } else {
-        expressionStatement();
-    }
-    }
-
-    LoxObjFunction* compileCode(const char* sourceCode) {
-    initScanner(sourceCode);
-    LoxCompiler compiler;
-    initCompiler(&compiler, TYPE_SCRIPT);
-
-    //reset errors for compiler processing
-    parser.hadError = false;
-    parser.resync = false;
-
-    advance();
-
-    while (!match(TOKEN_EOF)) {
-        handleDeclaration();
-    }
-
-    LoxObjFunction* function = endCompiler();
-    return parser.hadError ? NULL : function;
-    }
-    void markCompilerRoots() {
-    LoxCompiler* compiler = current;
-    while (compiler != NULL) {
-        markObject((LoxObject*)compiler->function);
-        compiler = compiler->enclosing;
-    }
-    }
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+
+    #include "common.h"
+    #include "LoxCompiler.h"
+    #include "memory.h"
+    #include "LoxScanner.h"
+
+    #ifdef DEBUG_PRINT_CODE
+    #include "LoxDebugger.h"
+    #endif
+
+
+    typedef struct LoxParser LoxParser;
+
+    typedef enum {
+        PREC_NONE,
+        PREC_ASSIGNMENT,  // =
+        PREC_OR,          // or
+        PREC_AND,         // and
+        PREC_EQUALITY,    // == !=
+        PREC_COMPARISON,  // < > <= >=
+        PREC_TERM,        // + -
+        PREC_FACTOR,      // * /
+        PREC_UNARY,       // ! -
+        PREC_CALL,        // . ()
+        PREC_PRIMARY
+    } LoxPrecedence;
+  
+    typedef void (*ParseFunc)(LoxParser* parser, bool assignable);
+
+
+    typedef struct {
+        ParseFunc prefix;
+        ParseFunc infix;
+        LoxPrecedence precedence;
+    } LoxParsePrecRule;
+
+
+    typedef struct {
+        LoxToken name;
+        int depth;
+        bool isCaptured;
+    } Local;
+
+    typedef struct {
+        int index;
+        bool isLocal;
+    } Upvalue;
+  
+    typedef enum {
+        TYPE_FUNCTION,
+        TYPE_INITIALIZER,
+        TYPE_METHOD,
+        TYPE_SCRIPT
+    } FunctionType;
+
+    typedef struct Compiler {
+        struct Compiler* enclosing;
+
+        LoxObjFunction* function;
+        FunctionType type;
+
+        //arena space in use before this function started
+        ArenaMark arenaMark;
+        Local* locals;
+        int localCount;
+        int localCapacity;
+        Upvalue* upvalues;
+        int upvalueCapacity;
+        int scopeDepth;
+    } LoxCompiler;
+
+
+    typedef struct ClassCompiler {
+        struct ClassCompiler* enclosing;
+        bool hasSuperclass;
+    } ClassCompiler;
+
+    //everything one compilation works with, compileCode keeps it on its stack so
+    //several compilations, each for its own VM, can run at the same time
+    struct LoxParser {
+        LoxVM* vm;
+        LoxScanner scanner;
+        LoxToken current;
+        LoxToken previous;
+        bool hadError;
+        bool resync;
+
+        LoxCompiler* compiler;
+        ClassCompiler* currentClass;
+
+        //growing chunks and locals of the functions being compiled, what a function
+        //used is given back when it ends and the rest when compileCode returns
+        LoxArena arena;
+    };
+
+    static LoxChunk* currentChunk(LoxParser* parser) {
+        return &parser->compiler->function->chunk;
+    }
+   
+    static void errorAt(LoxParser* parser, LoxToken* token, const char* msg) {
+        if (parser->resync) return;
+
+        parser->resync = true;
+        fprintf(stderr, "[line %d] Error", token->line);
+
+        if (token->type == TOKEN_EOF) {
+            fprintf(stderr, " at end");
+        } else if (token->type == TOKEN_ERROR) {
+            // do nothing, already handling error
+        } 
+        else{
+            fprintf(stderr, " at '%.*s'", token->length, token->start);
+        }
+
+        fprintf(stderr, ": %s\n", msg);
+        parser->hadError = true;
+    }
+
+    static void parseError(LoxParser* parser, const char* msg){
+        errorAt(parser, &parser->previous, msg);
+    }
+   
+    static void parseErrorAtCurrent(LoxParser* parser, const char* msg) {
+        errorAt(parser, &parser->current, msg);
+    }
+  
+    static void advance(LoxParser* parser) {
+        parser->previous = parser->current;
+
+        for (;;){
+            parser->current = scanToken(&parser->scanner);
+            if (parser->current.type != TOKEN_ERROR) break;
+
+            parseErrorAtCurrent(parser, parser->current.start);
+        }
+    }
+  
+    static void consumeToken(LoxParser* parser, TokenType type, const char* message) {
+        if (parser->current.type == type) {
+            advance(parser);
+            return;
+        }
+
+        parseErrorAtCurrent(parser, message);
+    }
+
+    static bool check(LoxParser* parser, TokenType type) {
+        return parser->current.type == type;
+    }
+
+    static bool match(LoxParser* parser, TokenType type) {
+        if (!check(parser, type)) return false;
+        advance(parser);
+        return true;
+    }
+   
+    static void emitByte(LoxParser* parser, uint8_t byte) {
+        writeChunk(currentChunk(parser), byte, parser->previous.line, &parser->arena);
+    }
+
+    static void emitBytes(LoxParser* parser, uint8_t byte1, uint8_t byte2) {
+        emitByte(parser, byte1);
+        emitByte(parser, byte2);
+    }
+
+    //write a 24 bit operand, high byte first
+    static void emitLong(LoxParser* parser, int operand) {
+        emitByte(parser, (operand >> 16) & 0xff);
+        emitByte(parser, (operand >> 8) & 0xff);
+        emitByte(parser, operand & 0xff);
+    }
+
+    //emit an instruction with a single index operand
+    //operands that do not fit in a byte get the OP_WIDE prefix and 3 bytes instead
+    static void emitOperand(LoxParser* parser, uint8_t instruction, int operand) {
+        if (operand <= UINT8_MAX) {
+            emitBytes(parser, instruction, (uint8_t)operand);
+            return;
+        }
+
+        emitBytes(parser, OP_WIDE, instruction);
+        emitLong(parser, operand);
+    }
+    
+    static void emitLoop(LoxParser* parser, int loopStart) {
+        emitByte(parser, OP_LOOP);
+
+        int offset = currentChunk(parser)->count - loopStart + 2;
+        if (offset > UINT16_MAX) parseError(parser, "Loop body too large.");
+
+        emitByte(parser, (offset >> 8) & 0xff);
+        emitByte(parser, offset & 0xff);
+    }
+    
+    static int emitJump(LoxParser* parser, uint8_t instruction) {
+        emitByte(parser, instruction);
+        emitByte(parser, 0xff);
+        emitByte(parser, 0xff);
+        return (currentChunk(parser)->count - 2);
+    }
+   
+    static void emitReturn(LoxParser* parser) {
+        if (parser->compiler->type == TYPE_INITIALIZER){
+            emitBytes(parser, OP_GET_LOCAL, 0);
+        } 
+        else{
+            emitByte(parser, OP_NIL);
+        }
+
+        emitByte(parser, OP_RETURN);
+    }
+  
+    static int makeConstant(LoxParser* parser, LoxValue value){
+        lockHeap(parser->vm);
+        int constant = addConstant(currentChunk(parser), value, &parser->arena);
+        unlockHeap(parser->vm);
+        writeBarrier(parser->vm, (LoxObject*)parser->compiler->function, value);
+        if (constant > UINT24_MAX){
+            parseError(parser, "Too many constants in one chunk.");
+            return 0;
+        }
+
+        return constant;
+    }
+
+    static void emitConstant(LoxParser* parser, LoxValue value) {
+        int constant = makeConstant(parser, value);
+        if (constant <= UINT8_MAX) {
+            emitBytes(parser, OP_CONSTANT, (uint8_t)constant);
+        }
+        else {
+            emitByte(parser, OP_CONSTANT_LONG);
+            emitLong(parser, constant);
+        }
+    }
+
+    static void patchJump(LoxParser* parser, int offset) {
+        int jump = currentChunk(parser)->count - offset - 2;
+
+        if (jump > UINT16_MAX) {
+            parseError(parser, "Too much code to jump over.");
+        }
+
+        currentChunk(parser)->code[offset] = (jump >> 8) & 0xff;
+        currentChunk(parser)->code[offset + 1] = jump & 0xff;
+    }
+  
+    //initialize the compiler for the lox code, sets scope values, environments, etc
+    static void initCompiler(LoxParser* parser, LoxCompiler* compiler, FunctionType type) {
+        compiler->enclosing = parser->compiler;
+        compiler->function = NULL;
+        compiler->type = type;
+        compiler->locals = NULL;
+        compiler->localCount = 0;
+        compiler->localCapacity = 0;
+        compiler->upvalues = NULL;
+        compiler->upvalueCapacity = 0;
+        compiler->scopeDepth = 0;
+        compiler->arenaMark = arenaSave(&parser->arena);
+        compiler->function = newFunction(parser->vm);
+        parser->compiler = compiler;
+        if (type != TYPE_SCRIPT) {
+            LoxObjString* name = copyString(parser->vm, parser->previous.start, parser->previous.length);
+            lockHeap(parser->vm);
+            parser->compiler->function->name = name;
+            unlockHeap(parser->vm);
+            writeBarrier(parser->vm, (LoxObject*)parser->compiler->function, OBJ_VAL(parser->compiler->function->name));
+        }
+
+        parser->compiler->localCapacity = GrowCap(0);
+        parser->compiler->locals = ArenaGrowArr(&parser->arena, Local, NULL, 0, parser->compiler->localCapacity);
+
+        Local* local = &parser->compiler->locals[parser->compiler->localCount++];
+        local->depth = 0;
+        local->isCaptured = false;
+        if (type != TYPE_FUNCTION) {
+            local->name.start = "this";
+            local->name.length = 4;
+        } 
+        else {
+            local->name.start = "";
+            local->name.length = 0;
+        }
+}
+  
+    static LoxObjFunction* endCompiler(LoxParser* parser) {
+        emitReturn(parser);
+        LoxObjFunction* function = parser->compiler->function;
+        //the function's code is complete, move its chunk out of the arena
+        lockHeap(parser->vm);
+        commitChunk(parser->vm, &function->chunk);
+        unlockHeap(parser->vm);
+        //everything allocated since the function started was its own, an enclosing
+        //function's arrays only grow while that function is the one being compiled
+        arenaRestore(&parser->arena, parser->compiler->arenaMark);
+
+        #ifdef DEBUG_PRINT_CODE
+        if (!parser->hadError) {
+            disassembleChunk(currentChunk(parser), function->name != NULL ? function->name->chars : "<script>");
+    }
+        #endif
+
+        parser->compiler = parser->compiler->enclosing;
+        return function;
+    }
+
+    //create new scope for any new classes, funcs, loops, etc
+    static void beginScope(LoxParser* parser) {
+        parser->compiler->scopeDepth++;
+    }
+   
+    //close the scope of the current Lox environments - functions, classes, loops, etc
+    static void endScope(LoxParser* parser) {
+        parser->compiler->scopeDepth--;
+        while (parser->compiler->localCount > 0 && parser->compiler->locals[parser->compiler->localCount - 1].depth > parser->compiler->scopeDepth) {
+            if (parser->compiler->locals[parser->compiler->localCount - 1].isCaptured) {
+            emitByte(parser, OP_CLOSE_UPVALUE);
+            } 
+            else {
+                emitByte(parser, OP_POP);
+            }
+            parser->compiler->localCount--;
+        }
+    }
+
+    //declare functions here to avoid any undeclared/unreferenced errors
+    static void handleExpression(LoxParser* parser);
+    static void handleStatement(LoxParser* parser);
+    static void handleDeclaration(LoxParser* parser);
+    static LoxParsePrecRule* getRule(TokenType type);
+    static void parserPrecedence(LoxParser* parser, LoxPrecedence precedence);
+
+
+    static int identifierConstant(LoxParser* parser, LoxToken* name) {
+        return makeConstant(parser, OBJ_VAL(copyString(parser->vm, name->start, name->length)));
+    }
+
+    //invokes name their method by selector, the VM keeps the name itself alive
+    static int identifierSelector(LoxParser* parser, LoxToken* name) {
+        int selector = methodSelector(parser->vm, copyString(parser->vm, name->start, name->length));
+        if (selector > UINT24_MAX) {
+            parseError(parser, "Too many method names.");
+            return 0;
+        }
+        return selector;
+    }
+  
+    static bool identifiersEqual(LoxToken* left, LoxToken* right) {
+        if (left->length != right->length) return false;
+        return memcmp(left->start, right->start, left->length) == 0;
+    }
+   
+    static int resolveLocal(LoxParser* parser, LoxCompiler* compiler, LoxToken* name) {
+    for (int i = compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &compiler->locals[i];
+        if (identifiersEqual(name, &local->name)) {
+        if (local->depth == -1) {
+            parseError(parser, "Can't read local variable in its own initializer.");
+        }
+        return i;
+        }
+    }
+    return -1;
+}
+
+    static int addUpvalue(LoxParser* parser, LoxCompiler* compiler, int index, bool isLocal) {
+        int upvalueCount = compiler->function->upvalueCount;
+
+        for (int i = 0; i < upvalueCount; i++) {
+            Upvalue* upvalue = &compiler->upvalues[i];
+            if (upvalue->index == index && upvalue->isLocal == isLocal) {
+            return i;
+            }
+        }
+
+
+        if (upvalueCount == UINT16_COUNT) {
+            parseError(parser, "Too many closure variables in function.");
+            return 0;
+        }
+
+        if (compiler->upvalueCapacity < upvalueCount + 1) {
+            int oldCap = compiler->upvalueCapacity;
+            compiler->upvalueCapacity = GrowCap(oldCap);
+            compiler->upvalues = GrowArr(parser->vm, Upvalue, compiler->upvalues, oldCap, compiler->upvalueCapacity);
+        }
+
+        compiler->upvalues[upvalueCount].isLocal = isLocal;
+        compiler->upvalues[upvalueCount].index = index;
+        return compiler->function->upvalueCount++;
+}
+
+    static int resolveUpvalue(LoxParser* parser, LoxCompiler* compiler, LoxToken* name) {
+        if (compiler->enclosing == NULL) return -1;
+
+        int local = resolveLocal(parser, compiler->enclosing, name);
+        if (local != -1) {
+            compiler->enclosing->locals[local].isCaptured = true;
+            return addUpvalue(parser, compiler, local, true);
+        }
+
+        int upvalue = resolveUpvalue(parser, compiler->enclosing, name);
+        if (upvalue != -1) {
+            return addUpvalue(parser, compiler, upvalue, false);
+        }
+        
+        return -1;
+    }
+
+    static void addLocal(LoxParser* parser, LoxToken name) {
+        if (parser->compiler->localCount == UINT16_COUNT) {
+            parseError(parser, "Too many local variables in function.");
+            return;
+        }
+
+        if (parser->compiler->localCapacity < parser->compiler->localCount + 1) {
+            int oldCap = parser->compiler->localCapacity;
+            parser->compiler->localCapacity = GrowCap(oldCap);
+            parser->compiler->locals = ArenaGrowArr(&parser->arena, Local, parser->compiler->locals, oldCap, parser->compiler->localCapacity);
+        }
+
+        Local* local = &parser->compiler->locals[parser->compiler->localCount++];
+        local->name = name;
+        local->depth = -1;
+        local->isCaptured = false;
+
+        if (parser->compiler->localCount > parser->compiler->function->slotCount) {
+            parser->compiler->function->slotCount = parser->compiler->localCount;
+        }
+    }
+
+    //parse through the local variables of the current scope, 
+    //add the variable if it is unique within a non-zero scope
+    static void declareVariable(LoxParser* parser) {
+        if (parser->compiler->scopeDepth == 0) return;
+
+        LoxToken* name = &parser->previous;
+
+        for (int i = parser->compiler->localCount - 1; i >= 0; i--) {
+            Local* local = &parser->compiler->locals[i];
+            if (local->depth != -1 && local->depth < parser->compiler->scopeDepth) {
+                break; 
+            }
+
+            //check for variables with same name already in the scope
+            if (identifiersEqual(name, &local->name)) {
+                parseError(parser, "Already a variable with this name in this scope.");
+            }
+        }
+
+        addLocal(parser, *name);
+    }
+    
+    static int parseVariable(LoxParser* parser, const char* errorMessage) {
+        consumeToken(parser, TOKEN_IDENTIFIER, errorMessage);
+
+        declareVariable(parser);
+        if (parser->compiler->scopeDepth > 0) return 0;
+
+        return identifierConstant(parser, &parser->previous);
+    }
+ 
+    //mark the variable as initialized to avoid conflict of declaration
+    static void markInitialized(LoxParser* parser) {
+        if (parser->compiler->scopeDepth == 0) return;
+        parser->compiler->locals[parser->compiler->localCount - 1].depth =
+            parser->compiler->scopeDepth;
+    }
+
+
+    static void defineVariable(LoxParser* parser, int global) {
+        if (parser->compiler->scopeDepth > 0) {
+            markInitialized(parser);
+            return;
+        }
+
+        emitOperand(parser, OP_DEFINE_GLOBAL, global);
+    }
+
+    //checking the arguments passed to a func, process the list of arguments for each declared functions
+    static uint8_t argumentList(LoxParser* parser) {
+        uint8_t argCount = 0;
+        if (!check(parser, TOKEN_RIGHT_PAREN)) {
+            //while there are more arguments to process, use expression func to handle each one
+            do {
+                handleExpression(parser);
+                if (argCount == 255) {
+                    parseError(parser, "Can't have more than 255 arguments.");
+            }
+                argCount++;
+            } while (match(parser, TOKEN_COMMA));
+        }
+        consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+        return argCount;
+    }
+    
+    static void and_(LoxParser* parser, bool canAssign) {
+        int endJump = emitJump(parser, OP_JUMP_IF_FALSE);
+
+        emitByte(parser, OP_POP);
+        parserPrecedence(parser, PREC_AND);
+
+        patchJump(parser, endJump);
+    }
+
+    static void binaryOps(LoxParser* parser, bool assignable) {
+        TokenType operatorType = parser->previous.type;
+        LoxParsePrecRule* rule = getRule(operatorType);
+        parserPrecedence(parser, (LoxPrecedence)(rule->precedence + 1));
+
+        //handle each type of binary operations
+        switch (operatorType) {
+            case TOKEN_BANG_EQUAL:    emitBytes(parser, OP_EQUAL, OP_NOT); break;
+            case TOKEN_EQUAL_EQUAL:   emitByte(parser, OP_EQUAL); break;
+            case TOKEN_GREATER:       emitByte(parser, OP_GREATER); break;
+            case TOKEN_GREATER_EQUAL: emitBytes(parser, OP_LESS, OP_NOT); break;
+            case TOKEN_LESS:          emitByte(parser, OP_LESS); break;
+            case TOKEN_LESS_EQUAL:    emitBytes(parser, OP_GREATER, OP_NOT); break;
+            case TOKEN_PLUS:          emitByte(parser, OP_ADD); break;
+            case TOKEN_MINUS:         emitByte(parser, OP_SUBTRACT); break;
+            case TOKEN_STAR:          emitByte(parser, OP_MULTIPLY); break;
+            case TOKEN_SLASH:         emitByte(parser, OP_DIVIDE); break;
+            default: 
+                return;
+        }
+    }
+  
+    static void call(LoxParser* parser, bool assignable) {
+        uint8_t argCount = argumentList(parser);
+        emitBytes(parser, OP_CALL, argCount);
+    }
+
+    static void dot(LoxParser* parser, bool assignable) {
+        consumeToken(parser, TOKEN_IDENTIFIER, "Expect property name after '.'.");
+        LoxToken name = parser->previous;
+
+        if (assignable && match(parser, TOKEN_EQUAL)) {
+            handleExpression(parser);
+            emitOperand(parser, OP_SET_PROPERTY, identifierConstant(parser, &name));
+        } 
+        else if (match(parser, TOKEN_LEFT_PAREN)) {
+            uint8_t argCount = argumentList(parser);
+            emitOperand(parser, OP_INVOKE, identifierSelector(parser, &name));
+            emitByte(parser, argCount);
+        } 
+        else {
+            emitOperand(parser, OP_GET_PROPERTY, identifierConstant(parser, &name));
+        }
+    }
+
+    static void handleLiterals(LoxParser* parser, bool assignable) {
+        switch (parser->previous.type) {
+            case TOKEN_FALSE: emitByte(parser, OP_FALSE); break;
+            case TOKEN_NIL: emitByte(parser, OP_NIL); break;
+            case TOKEN_TRUE: emitByte(parser, OP_TRUE); break;
+            default: 
+                return; 
+        }
+    }
+
+    static void handleGrouping(LoxParser* parser, bool canAssign) {
+        handleExpression(parser);
+        consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+    }
+
+    static void handleNumbers(LoxParser* parser, bool canAssign) {
+        double value = strtod(parser->previous.start, NULL);
+
+        emitConstant(parser, NUMBER_VAL(value));
+    }
+   
+    static void or_(LoxParser* parser, bool canAssign) {
+        int elseJump = emitJump(parser, OP_JUMP_IF_FALSE);
+        int endJump = emitJump(parser, OP_JUMP);
+
+        patchJump(parser, elseJump);
+        emitByte(parser, OP_POP);
+
+        parserPrecedence(parser, PREC_OR);
+        patchJump(parser, endJump);
+    }
+
+    static void handleStr(LoxParser* parser, bool canAssign) {
+        emitConstant(parser, OBJ_VAL(copyString(parser->vm, parser->previous.start + 1, parser->previous.length - 2)));
+    }
+
+    static void namedVariable(LoxParser* parser, LoxToken name, bool assignable) {
+        uint8_t getOp, setOp;
+        int arg = resolveLocal(parser, parser->compiler, &name);
+        if (arg != -1) {
+            getOp = OP_GET_LOCAL;
+            setOp = OP_SET_LOCAL;
+        } 
+        else if ((arg = resolveUpvalue(parser, parser->compiler, &name)) != -1) {
+            getOp = OP_GET_UPVALUE;
+            setOp = OP_SET_UPVALUE;
+        } 
+        else {
+            arg = identifierConstant(parser, &name);
+            getOp = OP_GET_GLOBAL;
+            setOp = OP_SET_GLOBAL;
+        }
+        if (assignable && match(parser, TOKEN_EQUAL)){
+            handleExpression(parser);
+            emitOperand(parser, setOp, arg);
+        } 
+        else{
+            emitOperand(parser, getOp, arg);
+        }
+    }
+
+    static void handleVariables(LoxParser* parser, bool assignable) {
+        namedVariable(parser, parser->previous, assignable);
+    }
+
+    static LoxToken syntheticToken(const char* text) {
+        LoxToken token;
+        token.start = text;
+        token.length = (int)strlen(text);
+        return token;
+    }
+
+
+    static void super_(LoxParser* parser, bool canAssign) {
+        if (parser->currentClass == NULL) {
+            parseError(parser, "Can't use 'super' outside of a class.");
+        } 
+        else if (!parser->currentClass->hasSuperclass) {
+            parseError(parser, "Can't use 'super' in a class with no superclass.");
+        }
+
+        consumeToken(parser, TOKEN_DOT, "Expect '.' after 'super'.");
+        consumeToken(parser, TOKEN_IDENTIFIER, "Expect superclass method name.");
+        int name = identifierConstant(parser, &parser->previous);
+        
+        namedVariable(parser, syntheticToken("this"), false);
+
+        if (match(parser, TOKEN_LEFT_PAREN)) {
+            uint8_t argCount = argumentList(parser);
+            namedVariable(parser, syntheticToken("super"), false);
+            emitOperand(parser, OP_SUPER_INVOKE, name);
+            emitByte(parser, argCount);
+        } 
+        else {
+            namedVariable(parser, syntheticToken("super"), false);
+            emitOperand(parser, OP_GET_SUPER, name);
+        }
+    }
+    
+    static void this_(LoxParser* parser, bool canAssign) {
+        if (parser->currentClass == NULL) {
+            parseError(parser, "Can't use 'this' outside of a class.");
+            return;
+        }
+        
+        handleVariables(parser, false);
+    } 
+
+    static void unaryOps(LoxParser* parser, bool canAssign) {
+        TokenType operatorType = parser->previous.type;
+
+        parserPrecedence(parser, PREC_UNARY);
+
+            switch (operatorType) {
+                case TOKEN_BANG: emitByte(parser, OP_NOT); break;
+                case TOKEN_MINUS: emitByte(parser, OP_NEGATE); break;
+                default: 
+                    return;
+            }
+    }
+    
+    //dict of parse rules to assign each type of token to a certain order of precedence
+    LoxParsePrecRule rules[] = {
+        [TOKEN_LEFT_PAREN]    = {handleGrouping, call,   PREC_CALL},
+        [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, 
+        [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_DOT]           = {NULL,     dot,    PREC_CALL},
+        [TOKEN_MINUS]         = {unaryOps, binaryOps, PREC_TERM},
+        [TOKEN_PLUS]          = {NULL,     binaryOps, PREC_TERM},
+        [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_SLASH]         = {NULL,     binaryOps, PREC_FACTOR},
+        [TOKEN_STAR]          = {NULL,     binaryOps, PREC_FACTOR},
+        [TOKEN_BANG]          = {unaryOps,    NULL,   PREC_NONE},
+        [TOKEN_BANG_EQUAL]    = {NULL,     binaryOps, PREC_EQUALITY},
+        [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_EQUAL_EQUAL]   = {NULL,     binaryOps, PREC_EQUALITY},
+        [TOKEN_GREATER]       = {NULL,     binaryOps, PREC_COMPARISON},
+        [TOKEN_GREATER_EQUAL] = {NULL,     binaryOps, PREC_COMPARISON},
+        [TOKEN_LESS]          = {NULL,     binaryOps, PREC_COMPARISON},
+        [TOKEN_LESS_EQUAL]    = {NULL,     binaryOps, PREC_COMPARISON},
+        [TOKEN_IDENTIFIER]    = {handleVariables, NULL,   PREC_NONE},
+        [TOKEN_STRING]        = {handleStr,   NULL,   PREC_NONE},
+        [TOKEN_NUMBER]        = {handleNumbers,   NULL,   PREC_NONE},
+        [TOKEN_AND]           = {NULL,     and_,   PREC_AND},
+        [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_FALSE]         = {handleLiterals,  NULL,   PREC_NONE},
+        [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_FUN]           = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_NIL]           = {handleLiterals,  NULL,   PREC_NONE},
+        [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
+        [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_SUPER]         = {super_,   NULL,   PREC_NONE},
+        [TOKEN_THIS]          = {this_,    NULL,   PREC_NONE},
+        [TOKEN_TRUE]          = {handleLiterals,  NULL,   PREC_NONE},
+        [TOKEN_VAR]           = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
+    };
+    
+    static void parserPrecedence(LoxParser* parser, LoxPrecedence precedence) {
+        advance(parser);
+
+        ParseFunc prefixRule = getRule(parser->previous.type)->prefix;
+
+        if (prefixRule == NULL) {
+            parseError(parser, "Expect expression.");
+            return;
+}
+
+        bool canAssign = precedence <= PREC_ASSIGNMENT;
+        prefixRule(parser, canAssign);
+
+        while (precedence <= getRule(parser->current.type)->precedence) {
+            advance(parser);
+            ParseFunc infixRule = getRule(parser->previous.type)->infix;
+            infixRule(parser, canAssign);
+        }
+
+        if (canAssign && match(parser, TOKEN_EQUAL)) {
+            parseError(parser, "Invalid assignment target.");
+        }
+ 
+    }
+   
+    static LoxParsePrecRule* getRule(TokenType type) {
+        return &rules[type];
+    }
+
+    static void handleExpression(LoxParser* parser) {
+        parserPrecedence(parser, PREC_ASSIGNMENT);
+    }
+
+    static void block(LoxParser* parser) {
+        while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+            handleDeclaration(parser);
+        }
+
+        consumeToken(parser, TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+    }
+   
+    static void function(LoxParser* parser, FunctionType type) {
+        LoxCompiler compiler;
+        initCompiler(parser, &compiler, type);
+        //create new scope for function variables, expressions, etc
+        beginScope(parser); 
+
+        consumeToken(parser, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+        if (!check(parser, TOKEN_RIGHT_PAREN)) {
+            do {
+            parser->compiler->function->arity++;
+            if (parser->compiler->function->arity > 255) {
+                parseErrorAtCurrent(parser, "Can't have more than 255 parameters.");
+            }
+            int constant = parseVariable(parser, "Expect parameter name.");
+            defineVariable(parser, constant);
+            } while (match(parser, TOKEN_COMMA));
+        }
+        consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+        consumeToken(parser, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+        block(parser);
+
+        LoxObjFunction* function = endCompiler(parser);
+
+        emitOperand(parser, OP_CLOSURE, makeConstant(parser, OBJ_VAL(function)));
+
+        for (int i = 0; i < function->upvalueCount; i++) {
+            int index = compiler.upvalues[i].index;
+            uint8_t flags = compiler.upvalues[i].isLocal ? UPVALUE_LOCAL : 0;
+
+            if (index <= UINT8_MAX) {
+                emitBytes(parser, flags, (uint8_t)index);
+            }
+            else {
+                emitByte(parser, flags | UPVALUE_LONG);
+                emitLong(parser, index);
+            }
+        }
+
+        FreeArr(parser->vm, Upvalue, compiler.upvalues, compiler.upvalueCapacity);
+
+}
+    static void handleMethods(LoxParser* parser) {
+        consumeToken(parser, TOKEN_IDENTIFIER, "Expect method name.");
+        int constant = identifierConstant(parser, &parser->previous);
+        //the name gets its selector here unless an invoke compiled earlier already gave it one
+        methodSelector(parser->vm, AS_STRING(currentChunk(parser)->constants.values[constant]));
+
+        FunctionType type = TYPE_METHOD;
+
+        if (parser->previous.length == 4 && memcmp(parser->previous.start, "init", 4) == 0) {
+            type = TYPE_INITIALIZER;
+        }
+        
+        function(parser, type);
+        emitOperand(parser, OP_METHOD, constant);
+    }
+ 
+    static void classDeclaration(LoxParser* parser) {
+        consumeToken(parser, TOKEN_IDENTIFIER, "Expect class name.");
+        LoxToken className = parser->previous;
+        int nameConstant = identifierConstant(parser, &parser->previous);
+        declareVariable(parser);
+
+        emitOperand(parser, OP_CLASS, nameConstant);
+        defineVariable(parser, nameConstant);
+
+        ClassCompiler classCompiler;
+        classCompiler.hasSuperclass = false;
+        classCompiler.enclosing = parser->currentClass;
+        parser->currentClass = &classCompiler;
+
+        if (match(parser, TOKEN_LESS)) {
+            consumeToken(parser, TOKEN_IDENTIFIER, "Expect superclass name.");
+            handleVariables(parser, false);
+
+            if (identifiersEqual(&className, &parser->previous)) {
+                parseError(parser, "A class can't inherit from itself.");
+            }
+
+            beginScope(parser);
+            addLocal(parser, syntheticToken("super"));
+            defineVariable(parser, 0);
+            
+            namedVariable(parser, className, false);
+            emitByte(parser, OP_INHERIT);
+            classCompiler.hasSuperclass = true;
+        }
+        
+        namedVariable(parser, className, false);
+
+        consumeToken(parser, TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+
+        while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+            handleMethods(parser);
+        }
+
+        consumeToken(parser, TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+        emitByte(parser, OP_POP);
+
+        if (classCompiler.hasSuperclass) {
+            endScope(parser);
+        }
+
+        parser->currentClass = parser->currentClass->enclosing;
+    }
+    
+    static void funDeclaration(LoxParser* parser) {
+        int global = parseVariable(parser, "Expect function name.");
+        markInitialized(parser);
+        function(parser, TYPE_FUNCTION);
+        defineVariable(parser, global);
+    }
+
+    static void varDeclaration(LoxParser* parser) {
+    int global = parseVariable(parser, "Expect variable name.");
+    if (match(parser, TOKEN_EQUAL)) {
+        handleExpression(parser);
+    } 
+    else {
+        emitByte(parser, OP_NIL);
+    }
+    consumeToken(parser, TOKEN_SEMICOLON,
+            "Expect ';' after variable declaration.");
+    defineVariable(parser, global);
+    }
+
+    static void expressionStatement(LoxParser* parser) {
+        handleExpression(parser);
+        consumeToken(parser, TOKEN_SEMICOLON, "Expect ';' after expression.");
+        emitByte(parser, OP_POP);
+    }
+
+    //handle the possible tokens/environments within for loops
+    static void forStatement(LoxParser* parser) {
+        //open new scope for the new vars, expressions of the for loop
+        beginScope(parser);
+
+        consumeToken(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+        if (match(parser, TOKEN_SEMICOLON)) {
+            // for(;;), nothing important
+        } 
+        else if (match(parser, TOKEN_VAR)) {
+            varDeclaration(parser);
+        } 
+        else {
+            expressionStatement(parser);
+        }
+
+        int loopStart = currentChunk(parser)->count;
+
+        int exitJump = -1;
+        if (!match(parser, TOKEN_SEMICOLON)) {
+            handleExpression(parser);
+            consumeToken(parser, TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+
+            exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
+            emitByte(parser, OP_POP); 
+        }
+
+        if (!match(parser, TOKEN_RIGHT_PAREN)) {
+            int bodyJump = emitJump(parser, OP_JUMP);
+            int incrementStart = currentChunk(parser)->count;
+            handleExpression(parser);
+            emitByte(parser, OP_POP);
+            consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+            emitLoop(parser, loopStart);
+            loopStart = incrementStart;
+            patchJump(parser, bodyJump);
+        }
+
+        handleStatement(parser);
+        emitLoop(parser, loopStart);
+
+        if (exitJump != -1) {
+            patchJump(parser, exitJump);
+            emitByte(parser, OP_POP); 
+        }
+
+        //close the current scope for the for loop's variables, expressions, etc
+        endScope(parser);
+}
+  
+    static void ifStatement(LoxParser* parser) {
+        consumeToken(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+        handleExpression(parser);
+        consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition."); 
+
+        int thenJump = emitJump(parser, OP_JUMP_IF_FALSE);
+        emitByte(parser, OP_POP);
+        handleStatement(parser);
+
+        int elseJump = emitJump(parser, OP_JUMP);
+
+        patchJump(parser, thenJump);
+        emitByte(parser, OP_POP);
+
+        if (match(parser, TOKEN_ELSE)) handleStatement(parser);
+        patchJump(parser, elseJump);
+    }
+        
+    static void printStatement(LoxParser* parser) {
+        handleExpression(parser);
+        consumeToken(parser, TOKEN_SEMICOLON, "Expect ';' after value.");
+        emitByte(parser, OP_PRINT);
+        }
+    
+        static void returnStatement(LoxParser* parser) {
+        if (parser->compiler->type == TYPE_SCRIPT) {
+            parseError(parser, "Can't return from top-level code.");
+        }
+
+        //< return-from-script
+        if (match(parser, TOKEN_SEMICOLON)) {
+            emitReturn(parser);
+        } else {
+            if (parser->compiler->type == TYPE_INITIALIZER) {
+                parseError(parser, "Can't return a value from an initializer.");
+            }
+
+            handleExpression(parser);
+            consumeToken(parser, TOKEN_SEMICOLON, "Expect ';' after return value.");
+            emitByte(parser, OP_RETURN);
+        }
+    }
+    static void whileStatement(LoxParser* parser) {
+        int loopStart = currentChunk(parser)->count;
+        consumeToken(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+        handleExpression(parser);
+        consumeToken(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+        int exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
+
+        emitByte(parser, OP_POP);
+        handleStatement(parser);
+        emitLoop(parser, loopStart);
+        patchJump(parser, exitJump);
+        emitByte(parser, OP_POP);
+
+    }
+    static void synchronize(LoxParser* parser) {
+        parser->resync = false;
+
+        while (parser->current.type != TOKEN_EOF) {
+            if (parser->previous.type == TOKEN_SEMICOLON) return;
+            switch (parser->current.type) {
+            case TOKEN_CLASS:
+            case TOKEN_FUN:
+            case TOKEN_VAR:
+            case TOKEN_FOR:
+            case TOKEN_IF:
+            case TOKEN_WHILE:
+            case TOKEN_PRINT:
+            case TOKEN_RETURN:
+                return;
+            default:
+                ; 
+            }
+            advance(parser);
+        }
+    }
+
+static void handleDeclaration(LoxParser* parser) {
+    if (match(parser, TOKEN_CLASS)) {
+        classDeclaration(parser);
+    } 
+    else if (match(parser, TOKEN_FUN)) {
+        funDeclaration(parser);
+    } 
+    else if (match(parser, TOKEN_VAR)) {
+        varDeclaration(parser);
+    } 
+    else {
+        handleStatement(parser);
+    }
+        //similar to the sync() from c#
+        //use the resync bool since we have no exceptions
+        if (parser->resync) synchronize(parser);
+    }
+
+    static void handleStatement(LoxParser* parser) {
+    if (match(parser, TOKEN_PRINT)) {
+        printStatement(parser);
+    } 
+    else if (match(parser, TOKEN_FOR)) {
+        forStatement(parser);
+    } 
+    else if (match(parser, TOKEN_IF)) {
+        ifStatement(parser);
+    } 
+    else if (match(parser, TOKEN_RETURN)) {
+        returnStatement(parser);
+    } 
+    else if (match(parser, TOKEN_WHILE)) {
+        whileStatement(parser);
+    } 
+    else if (match(parser, TOKEN_LEFT_BRACE)) {
+        beginScope(parser);
+        block(parser);
+        endScope(parser);
+    } else {
+        expressionStatement(parser);
+    }
+    }
+
+    //the functions being compiled are only reachable from the compiler, so the
+    //collector is held off until they are all finished and handed to the caller
+    LoxObjFunction* compileCode(LoxVM* vm, const char* sourceCode) {
+    LoxParser context;
+    LoxParser* parser = &context;
+    parser->vm = vm;
+    parser->compiler = NULL;
+    parser->currentClass = NULL;
+
+    vm->gcSuppressed = true;
+    initArena(&parser->arena);
+    initScanner(&parser->scanner, sourceCode);
+    LoxCompiler compiler;
+    initCompiler(parser, &compiler, TYPE_SCRIPT);
+
+    //reset errors for compiler processing
+    parser->hadError = false;
+    parser->resync = false;
+
+    advance(parser);
+
+    while (!match(parser, TOKEN_EOF)) {
+        handleDeclaration(parser);
+    }
+
+    LoxObjFunction* function = endCompiler(parser);
+    freeArena(&parser->arena);
+    vm->gcSuppressed = false;
+    return parser->hadError ? NULL : function;
+    }
@@ -1,11 +1,9 @@
-#ifndef lox_LoxCompiler_h
-#define lox_LoxCompiler_h
-
-#include "LoxObject.h"
-#include "LoxVM.h"
-
-LoxObjFunction* compileCode(const char* source);
-
-void markCompilerRoots();
-
+#ifndef lox_LoxCompiler_h
+#define lox_LoxCompiler_h
+
+#include "LoxObject.h"
+#include "LoxVM.h"
+
+LoxObjFunction* compileCode(LoxVM* vm, const char* source);
+
 #endif
\ No newline at end of file
@@ -1,230 +1,309 @@
-// #include <stdio.h>
-// #include "LoxDebugger.h"
-// #include "LoxValue.h"
-// //iterate through chunk of bytecode and disassemble each instruction/byte to print out the value being passed
-// void disassembleChunk(LoxChunk* chunk, const char* chunkName) {
-//     printf("== %s ==\n", chunkName);
-//     int index;
-//     for (index = 0; index < chunk->count;) {
-//         index = disassembleInstruction(chunk, index);
-//     }
-// }
-
-// static int constInstruction(const char* name, LoxChunk* chunk, int index) {
-//     uint8_t constVal = chunk->code[index + 1];
-//     printf("%-16s %4d '", name, constVal);
-//     printLoxValue(chunk->constants.values[constVal]);
-//     printf("'\n");
-//     //return +2 because our constants are two bytes, where as the OP_RETURN is only one byte
-//     return (index+2);
-// }
-
-
-// // reads in single byte from bytecode as we switch on the instruction code in DI function
-// static int simpleInstruction(const char* name, int index){
-//     printf("%s\n", name);
-//     return index+1;
-// }
-
-// //break down code from the struct after we have disassmebled the chunk
-// //will disassemble each byte of the instruction as we iterate through the chunk
-// int disassembleInstruction(LoxChunk* chunk, int index){
-
-//     printf("%04d ", index);
-//     if (index > 0 && chunk->lines[index] == chunk->lines[index - 1]) {
-//         printf(" | ");
-//     } 
-//     else{
-//         printf("%4d ", chunk->lines[index]);
-//     }
-
-//     uint8_t instruction = chunk->code[index];
-
-//     switch (instruction) {
-//         case OP_RETURN:
-//             return simpleInstruction("OP_RETURN", index);
-//         case OP_CONSTANT:
-//             return constInstruction("OP_CONSTANT", chunk, index);
-//         case OP_NIL:
-//             return simpleInstruction("OP_NIL", index);
-//         case OP_TRUE:
-//             return simpleInstruction("OP_TRUE", index);
-//         case OP_FALSE:
-//             return simpleInstruction("OP_FALSE", index);
-//         case OP_EQUAL:
-//             return simpleInstruction("OP_EQUAL", index);
-//         case OP_GREATER:
-//             return simpleInstruction("OP_GREATER", index);
-//         case OP_LESS:
-//             return simpleInstruction("OP_LESS", index);
-//         case OP_NEGATE:
-//             return simpleInstruction("OP_NEGATE", index);
-//         case OP_ADD:
-//             return simpleInstruction("OP_ADD", index);
-//         case OP_SUB:
-//             return simpleInstruction("OP_SUB", index);
-//         case OP_MULTIPLY:
-//             return simpleInstruction("OP_MULTIPLY", index);
-//         case OP_DIVIDE:
-//             return simpleInstruction("OP_DIVIDE", index);
-//         case OP_NOT:
-//             return simpleInstruction("OP_NOT", index);
-//         default:
-//             printf("Unknown opcode %d\n", instruction);
-//             return index + 1;
-// }
-// }
-
-#include <stdio.h>
-#include "LoxDebugger.h"
-#include "LoxObject.h"
-#include "LoxValue.h"
-
-void disassembleChunk(LoxChunk* chunk, const char* name) {
-  printf("== %s ==\n", name);
-  
-  for (int index = 0; index < chunk->count;) {
-    index = disassembleInstruction(chunk, index);
-  }
-}
-
-static int constantInstruction(const char* name, LoxChunk* chunk, int index) {
-  uint8_t constant = chunk->code[index + 1];
-  printf("%-16s %4d '", name, constant);
-  printLoxValue(chunk->constants.values[constant]);
-  printf("'\n");
-  return index + 2;
-}
-
-static int invokeInstruction(const char* name, LoxChunk* chunk, int index) {
-  uint8_t constant = chunk->code[index + 1];
-  uint8_t argCount = chunk->code[index + 2];
-  printf("%-16s (%d args) %4d '", name, argCount, constant);
-  printLoxValue(chunk->constants.values[constant]);
-  printf("'\n");
-  return index + 3;
-}
-
-static int simpleInstruction(const char* name, int index) {
-  printf("%s\n", name);
-  return index + 1;
-}
-
-static int byteInstruction(const char* name, LoxChunk* chunk, int index) {
-  uint8_t slot = chunk->code[index + 1];
-  printf("%-16s %4d\n", name, slot);
-  return index + 2; 
-}
-static int jumpInstruction(const char* name, int sign, LoxChunk* chunk, int index) {
-  uint16_t jump = (uint16_t)(chunk->code[index + 1] << 8);
-  jump |= chunk->code[index + 2];
-  printf("%-16s %4d -> %d\n", name, index, index + 3 + sign * jump);
-  return index + 3;
-}
-
-int disassembleInstruction(LoxChunk* chunk, int index) {
-  printf("%04d ", index);
-  if (index > 0 &&
-      chunk->lines[index] == chunk->lines[index - 1]) {
-    printf("   | ");
-  } else {
-    printf("%4d ", chunk->lines[index]);
-  }
-  
-  uint8_t instruction = chunk->code[index];
-  switch (instruction) {
-    case OP_CONSTANT:
-      return constantInstruction("OP_CONSTANT", chunk, index);
-    case OP_NIL:
-      return simpleInstruction("OP_NIL", index);
-    case OP_TRUE:
-      return simpleInstruction("OP_TRUE", index);
-    case OP_FALSE:
-      return simpleInstruction("OP_FALSE", index);
-    case OP_POP:
-      return simpleInstruction("OP_POP", index);
-    case OP_GET_LOCAL:
-      return byteInstruction("OP_GET_LOCAL", chunk, index);
-    case OP_SET_LOCAL:
-      return byteInstruction("OP_SET_LOCAL", chunk, index);
-    case OP_GET_GLOBAL:
-      return constantInstruction("OP_GET_GLOBAL", chunk, index);
-    case OP_DEFINE_GLOBAL:
-      return constantInstruction("OP_DEFINE_GLOBAL", chunk, index);
-    case OP_SET_GLOBAL:
-      return constantInstruction("OP_SET_GLOBAL", chunk, index);
-    case OP_GET_UPVALUE:
-      return byteInstruction("OP_GET_UPVALUE", chunk, index);
-    case OP_SET_UPVALUE:
-      return byteInstruction("OP_SET_UPVALUE", chunk, index);
-    case OP_GET_PROPERTY:
-      return constantInstruction("OP_GET_PROPERTY", chunk, index);
-    case OP_SET_PROPERTY:
-      return constantInstruction("OP_SET_PROPERTY", chunk, index);
-    case OP_GET_SUPER:
-      return constantInstruction("OP_GET_SUPER", chunk, index);
-    case OP_EQUAL:
-      return simpleInstruction("OP_EQUAL", index);
-    case OP_GREATER:
-      return simpleInstruction("OP_GREATER", index);
-    case OP_LESS:
-      return simpleInstruction("OP_LESS", index);
-    case OP_ADD:
-      return simpleInstruction("OP_ADD", index);
-    case OP_SUBTRACT:
-      return simpleInstruction("OP_SUBTRACT", index);
-    case OP_MULTIPLY:
-      return simpleInstruction("OP_MULTIPLY", index);
-    case OP_DIVIDE:
-      return simpleInstruction("OP_DIVIDE", index);
-    case OP_NOT:
-      return simpleInstruction("OP_NOT", index);
-    case OP_NEGATE:
-      return simpleInstruction("OP_NEGATE", index);
-    case OP_PRINT:
-      return simpleInstruction("OP_PRINT", index);
-    case OP_JUMP:
-      return jumpInstruction("OP_JUMP", 1, chunk, index);
-    case OP_JUMP_IF_FALSE:
-      return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, index);
-    case OP_LOOP:
-      return jumpInstruction("OP_LOOP", -1, chunk, index);
-    case OP_CALL:
-      return byteInstruction("OP_CALL", chunk, index);
-    case OP_INVOKE:
-      return invokeInstruction("OP_INVOKE", chunk, index);
-    case OP_SUPER_INVOKE:
-      return invokeInstruction("OP_SUPER_INVOKE", chunk, index);
-    case OP_CLOSURE: {
-      index++;
-      uint8_t constant = chunk->code[index++];
-      printf("%-16s %4d ", "OP_CLOSURE", constant);
-      printLoxValue(chunk->constants.values[constant]);
-      printf("\n");
-
-      LoxObjFunction* function = AS_FUNCTION(
-          chunk->constants.values[constant]);
-      for (int j = 0; j < function->upvalueCount; j++) {
-        int isLocal = chunk->code[index++];
-        int index = chunk->code[index++];
-        printf("%04d      |                     %s %d\n",
-               index - 2, isLocal ? "local" : "upvalue", index);
-      }
-      return index;
-    }
-    case OP_CLOSE_UPVALUE:
-      return simpleInstruction("OP_CLOSE_UPVALUE", index);
-    case OP_RETURN:
-      return simpleInstruction("OP_RETURN", index);
-    case OP_CLASS:
-      return constantInstruction("OP_CLASS", chunk, index);
-    case OP_INHERIT:
-      return simpleInstruction("OP_INHERIT", index);
-    case OP_METHOD:
-        return constantInstruction("OP_METHOD", chunk, index);
-    //not a known instruction, probably input error
-    default:
-      printf("Unknown opcode %d\n", instruction);
-      return index + 1;
-  }
-}
+// #include <stdio.h>
+// #include "LoxDebugger.h"
+// #include "LoxValue.h"
+// //iterate through chunk of bytecode and disassemble each instruction/byte to print out the value being passed
+// void disassembleChunk(LoxChunk* chunk, const char* chunkName) {
+//     printf("== %s ==\n", chunkName);
+//     int index;
+//     for (index = 0; index < chunk->count;) {
+//         index = disassembleInstruction(chunk, index);
+//     }
+// }
+
+// static int constInstruction(const char* name, LoxChunk* chunk, int index) {
+//     uint8_t constVal = chunk->code[index + 1];
+//     printf("%-16s %4d '", name, constVal);
+//     printLoxValue(chunk->constants.values[constVal]);
+//     printf("'\n");
+//     //return +2 because our constants are two bytes, where as the OP_RETURN is only one byte
+//     return (index+2);
+// }
+
+
+// // reads in single byte from bytecode as we switch on the instruction code in DI function
+// static int simpleInstruction(const char* name, int index){
+//     printf("%s\n", name);
+//     return index+1;
+// }
+
+// //break down code from the struct after we have disassmebled the chunk
+// //will disassemble each byte of the instruction as we iterate through the chunk
+// int disassembleInstruction(LoxChunk* chunk, int index){
+
+//     printf("%04d ", index);
+//     if (index > 0 && chunk->lines[index] == chunk->lines[index - 1]) {
+//         printf(" | ");
+//     } 
+//     else{
+//         printf("%4d ", chunk->lines[index]);
+//     }
+
+//     uint8_t instruction = chunk->code[index];
+
+//     switch (instruction) {
+//         case OP_RETURN:
+//             return simpleInstruction("OP_RETURN", index);
+//         case OP_CONSTANT:
+//             return constInstruction("OP_CONSTANT", chunk, index);
+//         case OP_NIL:
+//             return simpleInstruction("OP_NIL", index);
+//         case OP_TRUE:
+//             return simpleInstruction("OP_TRUE", index);
+//         case OP_FALSE:
+//             return simpleInstruction("OP_FALSE", index);
+//         case OP_EQUAL:
+//             return simpleInstruction("OP_EQUAL", index);
+//         case OP_GREATER:
+//             return simpleInstruction("OP_GREATER", index);
+//         case OP_LESS:
+//             return simpleInstruction("OP_LESS", index);
+//         case OP_NEGATE:
+//             return simpleInstruction("OP_NEGATE", index);
+//         case OP_ADD:
+//             return simpleInstruction("OP_ADD", index);
+//         case OP_SUB:
+//             return simpleInstruction("OP_SUB", index);
+//         case OP_MULTIPLY:
+//             return simpleInstruction("OP_MULTIPLY", index);
+//         case OP_DIVIDE:
+//             return simpleInstruction("OP_DIVIDE", index);
+//         case OP_NOT:
+//             return simpleInstruction("OP_NOT", index);
+//         default:
+//             printf("Unknown opcode %d\n", instruction);
+//             return index + 1;
+// }
+// }
+
+#include <stdio.h>
+#include "LoxDebugger.h"
+#include "LoxObject.h"
+#include "LoxValue.h"
+
+void disassembleChunk(LoxChunk* chunk, const char* name) {
+  printf("== %s ==\n", name);
+  
+  for (int index = 0; index < chunk->count;) {
+    index = disassembleInstruction(chunk, index);
+  }
+}
+
+static int constantInstruction(const char* name, LoxChunk* chunk, int index) {
+  uint8_t constant = chunk->code[index + 1];
+  printf("%-16s %4d '", name, constant);
+  printLoxValue(chunk->constants.values[constant]);
+  printf("'\n");
+  return index + 2;
+}
+
+static int readLong(LoxChunk* chunk, int index) {
+  return (chunk->code[index] << 16) | (chunk->code[index + 1] << 8) |
+      chunk->code[index + 2];
+}
+
+static int constantLongInstruction(const char* name, LoxChunk* chunk, int index) {
+  int constant = readLong(chunk, index + 1);
+  printf("%-16s %4d '", name, constant);
+  printLoxValue(chunk->constants.values[constant]);
+  printf("'\n");
+  return index + 4;
+}
+
+static int invokeInstruction(const char* name, LoxChunk* chunk, int index) {
+  uint8_t constant = chunk->code[index + 1];
+  uint8_t argCount = chunk->code[index + 2];
+  printf("%-16s (%d args) %4d '", name, argCount, constant);
+  printLoxValue(chunk->constants.values[constant]);
+  printf("'\n");
+  return index + 3;
+}
+
+//the operand is a VM-wide selector, the chunk has no constant for the name
+static int selectorInstruction(const char* name, LoxChunk* chunk, int index) {
+  uint8_t selector = chunk->code[index + 1];
+  uint8_t argCount = chunk->code[index + 2];
+  printf("%-16s (%d args) selector %d\n", name, argCount, selector);
+  return index + 3;
+}
+
+static int simpleInstruction(const char* name, int index) {
+  printf("%s\n", name);
+  return index + 1;
+}
+
+static int byteInstruction(const char* name, LoxChunk* chunk, int index) {
+  uint8_t slot = chunk->code[index + 1];
+  printf("%-16s %4d\n", name, slot);
+  return index + 2; 
+}
+//print the upvalue descriptors that follow an OP_CLOSURE, index is the first descriptor
+static int closureInstruction(const char* name, LoxChunk* chunk, int constant, int index) {
+  printf("%-16s %4d ", name, constant);
+  printLoxValue(chunk->constants.values[constant]);
+  printf("\n");
+
+  LoxObjFunction* function = AS_FUNCTION(
+      chunk->constants.values[constant]);
+  for (int j = 0; j < function->upvalueCount; j++) {
+    int offset = index;
+    int flags = chunk->code[index++];
+    int slot;
+    if (flags & UPVALUE_LONG) {
+      slot = readLong(chunk, index);
+      index += 3;
+    } else {
+      slot = chunk->code[index++];
+    }
+    printf("%04d      |                     %s %d\n",
+           offset, (flags & UPVALUE_LOCAL) ? "local" : "upvalue", slot);
+  }
+  return index;
+}
+
+//OP_WIDE is followed by the real instruction and its 3 byte operand
+static int wideInstruction(LoxChunk* chunk, int index) {
+  uint8_t instruction = chunk->code[index + 1];
+  int operand = readLong(chunk, index + 2);
+  int next = index + 5;
+  const char* name;
+  bool isConstant = true;
+
+  switch (instruction) {
+    case OP_GET_LOCAL:     name = "OP_GET_LOCAL"; isConstant = false; break;
+    case OP_SET_LOCAL:     name = "OP_SET_LOCAL"; isConstant = false; break;
+    case OP_GET_UPVALUE:   name = "OP_GET_UPVALUE"; isConstant = false; break;
+    case OP_SET_UPVALUE:   name = "OP_SET_UPVALUE"; isConstant = false; break;
+    case OP_GET_GLOBAL:    name = "OP_GET_GLOBAL"; break;
+    case OP_DEFINE_GLOBAL: name = "OP_DEFINE_GLOBAL"; break;
+    case OP_SET_GLOBAL:    name = "OP_SET_GLOBAL"; break;
+    case OP_GET_PROPERTY:  name = "OP_GET_PROPERTY"; break;
+    case OP_SET_PROPERTY:  name = "OP_SET_PROPERTY"; break;
+    case OP_GET_SUPER:     name = "OP_GET_SUPER"; break;
+    case OP_CLASS:         name = "OP_CLASS"; break;
+    case OP_METHOD:        name = "OP_METHOD"; break;
+    case OP_INVOKE:        name = "OP_INVOKE"; isConstant = false; break;
+    case OP_SUPER_INVOKE:  name = "OP_SUPER_INVOKE"; break;
+    case OP_CLOSURE:
+      printf("OP_WIDE ");
+      return closureInstruction("OP_CLOSURE", chunk, operand, next);
+    default:
+      printf("OP_WIDE with unknown opcode %d\n", instruction);
+      return next;
+  }
+
+  printf("OP_WIDE %-16s", name);
+  if (instruction == OP_INVOKE || instruction == OP_SUPER_INVOKE) {
+    printf(" (%d args)", chunk->code[next++]);
+  }
+  printf(" %4d", operand);
+  if (isConstant) {
+    printf(" '");
+    printLoxValue(chunk->constants.values[operand]);
+    printf("'");
+  }
+  printf("\n");
+  return next;
+}
+
+static int jumpInstruction(const char* name, int sign, LoxChunk* chunk, int index) {
+  uint16_t jump = (uint16_t)(chunk->code[index + 1] << 8);
+  jump |= chunk->code[index + 2];
+  printf("%-16s %4d -> %d\n", name, index, index + 3 + sign * jump);
+  return index + 3;
+}
+
+int disassembleInstruction(LoxChunk* chunk, int index) {
+  printf("%04d ", index);
+  if (index > 0 &&
+      chunk->lines[index] == chunk->lines[index - 1]) {
+    printf("   | ");
+  } else {
+    printf("%4d ", chunk->lines[index]);
+  }
+  
+  uint8_t instruction = chunk->code[index];
+  switch (instruction) {
+    case OP_CONSTANT:
+      return constantInstruction("OP_CONSTANT", chunk, index);
+    case OP_CONSTANT_LONG:
+      return constantLongInstruction("OP_CONSTANT_LONG", chunk, index);
+    case OP_NIL:
+      return simpleInstruction("OP_NIL", index);
+    case OP_TRUE:
+      return simpleInstruction("OP_TRUE", index);
+    case OP_FALSE:
+      return simpleInstruction("OP_FALSE", index);
+    case OP_POP:
+      return simpleInstruction("OP_POP", index);
+    case OP_GET_LOCAL:
+      return byteInstruction("OP_GET_LOCAL", chunk, index);
+    case OP_SET_LOCAL:
+      return byteInstruction("OP_SET_LOCAL", chunk, index);
+    case OP_GET_GLOBAL:
+      return constantInstruction("OP_GET_GLOBAL", chunk, index);
+    case OP_DEFINE_GLOBAL:
+      return constantInstruction("OP_DEFINE_GLOBAL", chunk, index);
+    case OP_SET_GLOBAL:
+      return constantInstruction("OP_SET_GLOBAL", chunk, index);
+    case OP_GET_UPVALUE:
+      return byteInstruction("OP_GET_UPVALUE", chunk, index);
+    case OP_SET_UPVALUE:
+      return byteInstruction("OP_SET_UPVALUE", chunk, index);
+    case OP_GET_PROPERTY:
+      return constantInstruction("OP_GET_PROPERTY", chunk, index);
+    case OP_SET_PROPERTY:
+      return constantInstruction("OP_SET_PROPERTY", chunk, index);
+    case OP_GET_SUPER:
+      return constantInstruction("OP_GET_SUPER", chunk, index);
+    case OP_EQUAL:
+      return simpleInstruction("OP_EQUAL", index);
+    case OP_GREATER:
+      return simpleInstruction("OP_GREATER", index);
+    case OP_LESS:
+      return simpleInstruction("OP_LESS", index);
+    case OP_ADD:
+      return simpleInstruction("OP_ADD", index);
+    case OP_SUBTRACT:
+      return simpleInstruction("OP_SUBTRACT", index);
+    case OP_MULTIPLY:
+      return simpleInstruction("OP_MULTIPLY", index);
+    case OP_DIVIDE:
+      return simpleInstruction("OP_DIVIDE", index);
+    case OP_NOT:
+      return simpleInstruction("OP_NOT", index);
+    case OP_NEGATE:
+      return simpleInstruction("OP_NEGATE", index);
+    case OP_PRINT:
+      return simpleInstruction("OP_PRINT", index);
+    case OP_JUMP:
+      return jumpInstruction("OP_JUMP", 1, chunk, index);
+    case OP_JUMP_IF_FALSE:
+      return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, index);
+    case OP_LOOP:
+      return jumpInstruction("OP_LOOP", -1, chunk, index);
+    case OP_CALL:
+      return byteInstruction("OP_CALL", chunk, index);
+    case OP_INVOKE:
+      return selectorInstruction("OP_INVOKE", chunk, index);
+    case OP_SUPER_INVOKE:
+      return invokeInstruction("OP_SUPER_INVOKE", chunk, index);
+    case OP_CLOSURE:
+      return closureInstruction("OP_CLOSURE", chunk, chunk->code[index + 1], index + 2);
+    case OP_CLOSE_UPVALUE:
+      return simpleInstruction("OP_CLOSE_UPVALUE", index);
+    case OP_RETURN:
+      return simpleInstruction("OP_RETURN", index);
+    case OP_CLASS:
+      return constantInstruction("OP_CLASS", chunk, index);
+    case OP_INHERIT:
+      return simpleInstruction("OP_INHERIT", index);
+    case OP_METHOD:
+        return constantInstruction("OP_METHOD", chunk, index);
+    case OP_WIDE:
+      return wideInstruction(chunk, index);
+    //not a known instruction, probably input error
+    default:
+      printf("Unknown opcode %d\n", instruction);
+      return index + 1;
+  }
+}
@@ -0,0 +1,295 @@
+//epoll, pipes, sockets and the monotonic clock are Linux and POSIX
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "LoxEventLoop.h"
+#include "memory.h"
+
+void initEventLoop(LoxEventLoop* loop) {
+    loop->epollFd = -1;
+    loop->watches = NULL;
+    loop->watchCapacity = 0;
+    loop->callbackCount = 0;
+    loop->alwaysReadyCount = 0;
+    loop->timers = NULL;
+    loop->timerCount = 0;
+    loop->timerCapacity = 0;
+    loop->timerOrder = 0;
+    loop->turnsUntilPoll = 0;
+}
+
+void freeEventLoop(LoxEventLoop* loop) {
+    if (loop->epollFd >= 0) close(loop->epollFd);
+    free(loop->watches);
+    free(loop->timers);
+    initEventLoop(loop);
+}
+
+void clearEventLoop(LoxEventLoop* loop) {
+    for (int fd = 0; fd < loop->watchCapacity; fd++) {
+        FdWatch* watch = &loop->watches[fd];
+        if (watch->registered) epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+        watch->onRead = NULL;
+        watch->onWrite = NULL;
+        watch->registered = false;
+        watch->alwaysReady = false;
+    }
+    loop->callbackCount = 0;
+    loop->alwaysReadyCount = 0;
+    loop->timerCount = 0;
+}
+
+bool eventLoopPending(LoxEventLoop* loop) {
+    return loop->callbackCount > 0 || loop->timerCount > 0;
+}
+
+static int64_t monotonicNanos() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static bool ensureEpoll(LoxEventLoop* loop) {
+    if (loop->epollFd < 0) loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    return loop->epollFd >= 0;
+}
+
+//bring epoll in line with the callbacks fd has left
+static bool syncWatch(LoxEventLoop* loop, int fd) {
+    FdWatch* watch = &loop->watches[fd];
+    uint32_t events = (watch->onRead != NULL ? EPOLLIN : 0) | (watch->onWrite != NULL ? EPOLLOUT : 0);
+
+    if (watch->alwaysReady) {
+        if (events == 0) {
+            watch->alwaysReady = false;
+            loop->alwaysReadyCount--;
+        }
+        return true;
+    }
+
+    if (events == 0) {
+        if (watch->registered) epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+        watch->registered = false;
+        return true;
+    }
+
+    if (!ensureEpoll(loop)) return false;
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (watch->registered) {
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, fd, &event) == 0) return true;
+        //the fd was closed and its number reused without the loop being told
+        if (errno != ENOENT) return false;
+        watch->registered = false;
+    }
+
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) == 0) {
+        watch->registered = true;
+        return true;
+    }
+    if (errno == EPERM) {
+        watch->alwaysReady = true;
+        loop->alwaysReadyCount++;
+        return true;
+    }
+    return false;
+}
+
+//the callback replaces any the fd already had for the same direction
+bool watchFd(LoxEventLoop* loop, int fd, bool writable, LoxObject* target) {
+    if (fd < 0) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (fd >= loop->watchCapacity) {
+        int capacity = GrowCap(loop->watchCapacity);
+        while (capacity <= fd) capacity *= 2;
+        FdWatch* watches = (FdWatch*)realloc(loop->watches, sizeof(FdWatch) * capacity);
+        if (watches == NULL) exit(1);
+
+        memset(watches + loop->watchCapacity, 0, sizeof(FdWatch) * (capacity - loop->watchCapacity));
+        loop->watches = watches;
+        loop->watchCapacity = capacity;
+    }
+
+    FdWatch* watch = &loop->watches[fd];
+    LoxObject** slot = writable ? &watch->onWrite : &watch->onRead;
+    LoxObject* previous = *slot;
+    *slot = target;
+    if (!syncWatch(loop, fd)) {
+        *slot = previous;
+        return false;
+    }
+
+    if (previous == NULL) loop->callbackCount++;
+    return true;
+}
+
+//hands the callback over, it is only rooted by the loop until ready runs
+static void fireWatch(LoxVM* vm, LoxEventLoop* loop, int fd, bool writable, EventHandler ready) {
+    FdWatch* watch = &loop->watches[fd];
+    LoxObject** slot = writable ? &watch->onWrite : &watch->onRead;
+    LoxObject* target = *slot;
+    if (target == NULL) return;
+
+    *slot = NULL;
+    loop->callbackCount--;
+    syncWatch(loop, fd);
+    ready(vm, target);
+}
+
+static bool timerBefore(LoxTimer* a, LoxTimer* b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && a->order < b->order);
+}
+
+void addTimer(LoxEventLoop* loop, double delayMs, LoxObject* target) {
+    if (loop->timerCount == loop->timerCapacity) {
+        loop->timerCapacity = GrowCap(loop->timerCapacity);
+        loop->timers = (LoxTimer*)realloc(loop->timers, sizeof(LoxTimer) * loop->timerCapacity);
+        if (loop->timers == NULL) exit(1);
+    }
+
+    LoxTimer timer;
+    timer.deadline = monotonicNanos() + (delayMs > 0 ? (int64_t)(delayMs * 1000000) : 0);
+    timer.order = loop->timerOrder++;
+    timer.target = target;
+
+    int index = loop->timerCount++;
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!timerBefore(&timer, &loop->timers[parent])) break;
+        loop->timers[index] = loop->timers[parent];
+        index = parent;
+    }
+    loop->timers[index] = timer;
+}
+
+static LoxObject* popTimer(LoxEventLoop* loop) {
+    LoxObject* target = loop->timers[0].target;
+    LoxTimer last = loop->timers[--loop->timerCount];
+
+    int index = 0;
+    for (;;) {
+        int child = index * 2 + 1;
+        if (child >= loop->timerCount) break;
+        if (child + 1 < loop->timerCount && timerBefore(&loop->timers[child + 1], &loop->timers[child])) child++;
+        if (!timerBefore(&loop->timers[child], &last)) break;
+        loop->timers[index] = loop->timers[child];
+        index = child;
+    }
+    if (loop->timerCount > 0) loop->timers[index] = last;
+    return target;
+}
+
+//-1 to wait for an fd alone, otherwise the milliseconds until the next timer is due
+static int waitTimeout(LoxEventLoop* loop) {
+    if (loop->alwaysReadyCount > 0) return 0;
+    if (loop->timerCount == 0) return -1;
+
+    int64_t remaining = loop->timers[0].deadline - monotonicNanos();
+    if (remaining <= 0) return 0;
+    int64_t ms = (remaining + 999999) / 1000000;
+    return ms > INT32_MAX ? INT32_MAX : (int)ms;
+}
+
+void pollEvents(LoxVM* vm, LoxEventLoop* loop, bool wait, EventHandler ready) {
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    int count = 0;
+    int timeout = wait ? waitTimeout(loop) : 0;
+
+    if (ensureEpoll(loop)) {
+        count = epoll_wait(loop->epollFd, events, LOOP_MAX_EVENTS, timeout);
+        //interrupted by a signal, the caller waits again
+        if (count < 0) count = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        uint32_t flags = events[i].events;
+        //a hung up or failed fd wakes both sides, the read or write then reports what happened
+        if (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) fireWatch(vm, loop, fd, false, ready);
+        if (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) fireWatch(vm, loop, fd, true, ready);
+    }
+
+    for (int fd = 0; loop->alwaysReadyCount > 0 && fd < loop->watchCapacity; fd++) {
+        if (!loop->watches[fd].alwaysReady) continue;
+        fireWatch(vm, loop, fd, false, ready);
+        fireWatch(vm, loop, fd, true, ready);
+    }
+
+    int64_t now = monotonicNanos();
+    while (loop->timerCount > 0 && loop->timers[0].deadline <= now) {
+        ready(vm, popTimer(loop));
+    }
+}
+
+void markEventLoop(LoxVM* vm, LoxEventLoop* loop) {
+    for (int fd = 0; fd < loop->watchCapacity; fd++) {
+        markObject(vm, loop->watches[fd].onRead);
+        markObject(vm, loop->watches[fd].onWrite);
+    }
+
+    for (int i = 0; i < loop->timerCount; i++) {
+        markObject(vm, loop->timers[i].target);
+    }
+}
+
+void forwardEventLoop(LoxEventLoop* loop) {
+    for (int fd = 0; fd < loop->watchCapacity; fd++) {
+        loop->watches[fd].onRead = forwardObject(loop->watches[fd].onRead);
+        loop->watches[fd].onWrite = forwardObject(loop->watches[fd].onWrite);
+    }
+
+    for (int i = 0; i < loop->timerCount; i++) {
+        loop->timers[i].target = forwardObject(loop->timers[i].target);
+    }
+}
+
+bool openPipe(int fds[2]) {
+    return pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0;
+}
+
+bool openSocketPair(int fds[2]) {
+    return socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0;
+}
+
+int openFile(const char* path, const char* mode) {
+    int flags;
+    if (strcmp(mode, "r") == 0) flags = O_RDONLY;
+    else if (strcmp(mode, "w") == 0) flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (strcmp(mode, "a") == 0) flags = O_WRONLY | O_CREAT | O_APPEND;
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+    return open(path, flags | O_CLOEXEC, 0666);
+}
+
+int readFd(int fd, char* buffer, int size) {
+    return (int)read(fd, buffer, size);
+}
+
+int writeFd(int fd, const char* chars, int length) {
+    return (int)write(fd, chars, length);
+}
+
+bool closeFd(LoxEventLoop* loop, int fd) {
+    if (fd >= 0 && fd < loop->watchCapacity) {
+        FdWatch* watch = &loop->watches[fd];
+        if (watch->onRead != NULL) loop->callbackCount--;
+        if (watch->onWrite != NULL) loop->callbackCount--;
+        watch->onRead = NULL;
+        watch->onWrite = NULL;
+        syncWatch(loop, fd);
+    }
+    return close(fd) == 0;
+}
@@ -0,0 +1,74 @@
+#ifndef lox_LoxEventLoop_h
+#define lox_LoxEventLoop_h
+
+#include "common.h"
+#include "LoxValue.h"
+
+//how many ready file descriptors one wait hands back at most
+#define LOOP_MAX_EVENTS 64
+//most bytes one readFd() returns
+#define LOOP_READ_SIZE 4096
+
+//the callbacks waiting on one file descriptor, each is called once and then dropped,
+//fds epoll refuses, like regular files, are always ready and checked without it
+typedef struct {
+    LoxObject* onRead;
+    LoxObject* onWrite;
+    bool registered;
+    bool alwaysReady;
+} FdWatch;
+
+//order breaks ties between timers due at the same time, they fire in the order they were set
+typedef struct {
+    int64_t deadline;
+    uint64_t order;
+    LoxObject* target;
+} LoxTimer;
+
+//a target is a closure to call or a fiber waiting in sleep(), the loop only holds on to them
+//until they are due and hands them to the VM, which runs them as fibers
+typedef struct {
+    //-1 until the first fd is watched or the first wait on a timer
+    int epollFd;
+    FdWatch* watches;
+    int watchCapacity;
+    int callbackCount;
+    int alwaysReadyCount;
+    //timers ordered as a binary heap by deadline
+    LoxTimer* timers;
+    int timerCount;
+    int timerCapacity;
+    uint64_t timerOrder;
+    //queued fibers the scheduler runs before it checks for events again
+    int turnsUntilPoll;
+} LoxEventLoop;
+
+typedef void (*EventHandler)(LoxVM* vm, LoxObject* target);
+
+void initEventLoop(LoxEventLoop* loop);
+void freeEventLoop(LoxEventLoop* loop);
+//drops every callback and timer, after a runtime error nothing is left to run them
+void clearEventLoop(LoxEventLoop* loop);
+bool eventLoopPending(LoxEventLoop* loop);
+
+//false with errno set if fd cannot be watched
+bool watchFd(LoxEventLoop* loop, int fd, bool writable, LoxObject* target);
+void addTimer(LoxEventLoop* loop, double delayMs, LoxObject* target);
+//hands every target that is due to ready, if wait is set it first blocks until one is
+void pollEvents(LoxVM* vm, LoxEventLoop* loop, bool wait, EventHandler ready);
+
+void markEventLoop(LoxVM* vm, LoxEventLoop* loop);
+void forwardEventLoop(LoxEventLoop* loop);
+
+//non-blocking pipes and local sockets for the loop to wait on, false with errno set on failure
+bool openPipe(int fds[2]);
+bool openSocketPair(int fds[2]);
+//mode is "r", "w" or "a" as for fopen, -1 with errno set on failure
+int openFile(const char* path, const char* mode);
+//the byte counts read or written, -1 with errno set on failure
+int readFd(int fd, char* buffer, int size);
+int writeFd(int fd, const char* chars, int length);
+//the fd's callbacks are dropped before it is closed
+bool closeFd(LoxEventLoop* loop, int fd);
+
+#endif
@@ -0,0 +1,365 @@
+//mremap is a Linux extension
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "LoxHeap.h"
+
+//let address sanitizer see free cells, otherwise a stale object pointer goes unnoticed
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define POISON_CELL(cell, size) ASAN_POISON_MEMORY_REGION(cell, size)
+#define UNPOISON_CELL(cell, size) ASAN_UNPOISON_MEMORY_REGION(cell, size)
+#else
+#define POISON_CELL(cell, size) ((void)(cell), (void)(size))
+#define UNPOISON_CELL(cell, size) ((void)(cell), (void)(size))
+#endif
+
+//header rounded up so every cell stays aligned to a granule
+#define PAGE_HEADER_SIZE \
+    ((sizeof(HeapPage) + HEAP_GRANULE - 1) / HEAP_GRANULE * HEAP_GRANULE)
+
+static int sizeClassOf(size_t size) {
+    return (int)((size + HEAP_GRANULE - 1) / HEAP_GRANULE) - 1;
+}
+
+static void setBit(uint64_t* bits, size_t index) {
+    bits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static void clearBit(uint64_t* bits, size_t index) {
+    bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+void initHeap(LoxHeap* heap) {
+    for (int i = 0; i <= HEAP_LARGE_CLASS; i++) {
+        heap->pages[i] = NULL;
+    }
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        heap->available[i] = NULL;
+        heap->unswept[i] = NULL;
+    }
+    heap->unsweptCount = 0;
+    heap->pageCount = 0;
+}
+
+void freeHeap(LoxHeap* heap) {
+    for (int i = 0; i <= HEAP_LARGE_CLASS; i++) {
+        HeapPage* page = heap->pages[i];
+        while (page != NULL) {
+            HeapPage* next = page->next;
+            free(page);
+            page = next;
+        }
+    }
+    initHeap(heap);
+}
+
+static HeapPage* newPage(LoxHeap* heap, int sizeClass, size_t bytes) {
+    HeapPage* page = (HeapPage*)aligned_alloc(HEAP_PAGE_SIZE, bytes);
+    if (page == NULL) return NULL;
+
+    page->nextAvailable = NULL;
+    page->nextUnswept = NULL;
+    page->needsSweep = false;
+    page->evacuating = false;
+    page->freeList = NULL;
+    page->sizeClass = sizeClass;
+    page->liveCount = 0;
+    page->hasYoung = false;
+    memset(page->allocBits, 0, sizeof(page->allocBits));
+    memset(page->markBits, 0, sizeof(page->markBits));
+
+    page->next = heap->pages[sizeClass];
+    heap->pages[sizeClass] = page;
+    heap->pageCount++;
+    return page;
+}
+
+//get a fresh page for the class and thread all of its cells onto its free list,
+//in address order so objects allocated one after another sit next to each other
+static bool addPage(LoxHeap* heap, int sizeClass) {
+    HeapPage* page = newPage(heap, sizeClass, HEAP_PAGE_SIZE);
+    if (page == NULL) return false;
+    page->cellSize = (sizeClass + 1) * HEAP_GRANULE;
+    page->cellCount = (HEAP_PAGE_SIZE - PAGE_HEADER_SIZE) / page->cellSize;
+
+    char* cells = (char*)page + PAGE_HEADER_SIZE;
+    for (int i = page->cellCount - 1; i >= 0; i--) {
+        HeapCell* cell = (HeapCell*)(cells + (size_t)i * page->cellSize);
+        cell->next = page->freeList;
+        page->freeList = cell;
+        POISON_CELL(cell, page->cellSize);
+    }
+
+    page->nextAvailable = heap->available[sizeClass];
+    heap->available[sizeClass] = page;
+    return true;
+}
+
+//a large object is the only cell of a page rounded up to whole HEAP_PAGE_SIZE blocks
+static void* allocateLarge(LoxHeap* heap, size_t size) {
+    size_t bytes = (PAGE_HEADER_SIZE + size + HEAP_PAGE_SIZE - 1) / HEAP_PAGE_SIZE * HEAP_PAGE_SIZE;
+    HeapPage* page = newPage(heap, HEAP_LARGE_CLASS, bytes);
+    if (page == NULL) return NULL;
+    page->cellSize = (int)size;
+    page->cellCount = 1;
+    page->liveCount = 1;
+    page->hasYoung = true;
+
+    void* cell = (char*)page + PAGE_HEADER_SIZE;
+    setBit(page->allocBits, heapBitIndex(cell));
+    return cell;
+}
+
+void* heapAllocate(LoxHeap* heap, size_t size) {
+    if (size > HEAP_MAX_SMALL) return allocateLarge(heap, size);
+
+    int sizeClass = sizeClassOf(size);
+    if (heap->available[sizeClass] == NULL && !addPage(heap, sizeClass)) return NULL;
+
+    HeapPage* page = heap->available[sizeClass];
+    HeapCell* cell = page->freeList;
+    UNPOISON_CELL(cell, page->cellSize);
+    page->freeList = cell->next;
+    if (page->freeList == NULL) heap->available[sizeClass] = page->nextAvailable;
+
+    //cells are only ever freed unmarked, so the mark bit is already clear
+    page->liveCount++;
+    page->hasYoung = true;
+    setBit(page->allocBits, heapBitIndex(cell));
+    return cell;
+}
+
+//the cell goes back on its page's free list, empty pages are only
+//given back to the system by heapReleaseEmptyPages once a sweep is over
+void heapFree(LoxHeap* heap, void* pointer, size_t size) {
+    HeapPage* page = heapPageOf(pointer);
+    clearBit(page->allocBits, heapBitIndex(pointer));
+    page->liveCount--;
+    if (size > HEAP_MAX_SMALL) return;
+
+    if (page->freeList == NULL) {
+        page->nextAvailable = heap->available[page->sizeClass];
+        heap->available[page->sizeClass] = page;
+    }
+
+    HeapCell* cell = (HeapCell*)pointer;
+    cell->next = page->freeList;
+    page->freeList = cell;
+    POISON_CELL(cell, page->cellSize);
+}
+
+//walk every page, the small size classes first and then the large objects
+HeapPage* heapFirstPage(LoxHeap* heap) {
+    for (int i = 0; i <= HEAP_LARGE_CLASS; i++) {
+        if (heap->pages[i] != NULL) return heap->pages[i];
+    }
+    return NULL;
+}
+
+HeapPage* heapNextPage(LoxHeap* heap, HeapPage* page) {
+    if (page->next != NULL) return page->next;
+    for (int i = page->sizeClass + 1; i <= HEAP_LARGE_CLASS; i++) {
+        if (heap->pages[i] != NULL) return heap->pages[i];
+    }
+    return NULL;
+}
+
+void heapClearMarks(LoxHeap* heap) {
+    for (HeapPage* page = heapFirstPage(heap); page != NULL; page = heapNextPage(heap, page)) {
+        memset(page->markBits, 0, sizeof(page->markBits));
+    }
+}
+
+//free the pages nothing lives in any more and rebuild the lists of pages with free cells
+void heapReleaseEmptyPages(LoxHeap* heap) {
+    for (int i = 0; i <= HEAP_LARGE_CLASS; i++) {
+        HeapPage** link = &heap->pages[i];
+        while (*link != NULL) {
+            HeapPage* page = *link;
+            if (page->liveCount == 0 && !page->needsSweep) {
+                *link = page->next;
+                free(page);
+                heap->pageCount--;
+            }
+            else {
+                link = &page->next;
+            }
+        }
+    }
+
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        heap->available[i] = NULL;
+        for (HeapPage* page = heap->pages[i]; page != NULL; page = page->next) {
+            if (page->freeList == NULL) continue;
+            page->nextAvailable = heap->available[i];
+            heap->available[i] = page;
+        }
+    }
+}
+
+//queue a small object page for lazy sweeping, its dead objects stay where they are until then
+//nothing gets allocated in it before it is swept, so it holds no young objects in the meantime
+void heapDeferSweep(LoxHeap* heap, HeapPage* page) {
+    if (page->needsSweep) return;
+
+    page->needsSweep = true;
+    page->hasYoung = false;
+    page->nextUnswept = heap->unswept[page->sizeClass];
+    heap->unswept[page->sizeClass] = page;
+    heap->unsweptCount++;
+}
+
+void heapPageSwept(LoxHeap* heap, HeapPage* page) {
+    if (!page->needsSweep) return;
+    page->needsSweep = false;
+    heap->unsweptCount--;
+}
+
+//the page that has to be swept before an object of this size can be allocated, if any
+//it is either the page the next cell would come from, or when no page has free cells
+//one of the pages still waiting to be swept
+HeapPage* heapUnsweptFor(LoxHeap* heap, size_t size) {
+    if (size > HEAP_MAX_SMALL) return NULL;
+
+    int sizeClass = sizeClassOf(size);
+    HeapPage* page = heap->available[sizeClass];
+    if (page != NULL) return page->needsSweep ? page : NULL;
+
+    //pages already swept on the allocation path above are still linked here
+    while (heap->unswept[sizeClass] != NULL) {
+        page = heap->unswept[sizeClass];
+        heap->unswept[sizeClass] = page->nextUnswept;
+        if (page->needsSweep) return page;
+    }
+    return NULL;
+}
+
+//any page still waiting to be swept, for finishing a lazy sweep
+HeapPage* heapTakeUnswept(LoxHeap* heap) {
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        while (heap->unswept[i] != NULL) {
+            HeapPage* page = heap->unswept[i];
+            heap->unswept[i] = page->nextUnswept;
+            if (page->needsSweep) return page;
+        }
+    }
+    return NULL;
+}
+
+//share of the cells in small object pages that hold an object
+double heapOccupancy(LoxHeap* heap) {
+    long cells = 0;
+    long live = 0;
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        for (HeapPage* page = heap->pages[i]; page != NULL; page = page->next) {
+            cells += page->cellCount;
+            live += page->liveCount;
+        }
+    }
+    return cells == 0 ? 1.0 : (double)live / cells;
+}
+
+static int compareLiveCount(const void* a, const void* b) {
+    return (*(HeapPage* const*)a)->liveCount - (*(HeapPage* const*)b)->liveCount;
+}
+
+static void rebuildAvailable(LoxHeap* heap, int sizeClass) {
+    heap->available[sizeClass] = NULL;
+    for (HeapPage* page = heap->pages[sizeClass]; page != NULL; page = page->next) {
+        if (page->freeList == NULL || page->evacuating) continue;
+        page->nextAvailable = heap->available[sizeClass];
+        heap->available[sizeClass] = page;
+    }
+}
+
+//pick the emptiest pages of each size class whose objects fit in the free cells of the rest,
+//all pages of a class hold the same number of cells so that is as many pages as the free cells fill,
+//they are taken off the available lists so moved objects only land in pages that stay
+int heapSelectEvacuation(LoxHeap* heap) {
+    int selected = 0;
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        int count = 0;
+        long freeCells = 0;
+        for (HeapPage* page = heap->pages[i]; page != NULL; page = page->next) {
+            count++;
+            freeCells += page->cellCount - page->liveCount;
+        }
+        if (count < 2) continue;
+
+        int evacuate = (int)(freeCells / heap->pages[i]->cellCount);
+        if (evacuate == 0) continue;
+
+        //without room to sort the pages this class is left as it is, compacting is never required
+        HeapPage** pages = (HeapPage**)malloc(sizeof(HeapPage*) * count);
+        if (pages == NULL) continue;
+        int n = 0;
+        for (HeapPage* page = heap->pages[i]; page != NULL; page = page->next) {
+            pages[n++] = page;
+        }
+        qsort(pages, count, sizeof(HeapPage*), compareLiveCount);
+
+        for (int j = 0; j < evacuate; j++) {
+            pages[j]->evacuating = true;
+        }
+        free(pages);
+
+        rebuildAvailable(heap, i);
+        selected += evacuate;
+    }
+    return selected;
+}
+
+//free the pages a compaction emptied and ask the C library to give the memory back
+void heapReleaseEvacuated(LoxHeap* heap) {
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        HeapPage** link = &heap->pages[i];
+        while (*link != NULL) {
+            HeapPage* page = *link;
+            if (page->evacuating) {
+                *link = page->next;
+                free(page);
+                heap->pageCount--;
+            }
+            else {
+                link = &page->next;
+            }
+        }
+        rebuildAvailable(heap, i);
+    }
+
+    #ifdef __GLIBC__
+    malloc_trim(0);
+    #endif
+}
+
+//large buffers bypass malloc, whose arenas can hold on to freed memory
+//indefinitely, so the pages of a dead buffer go back to the system right away
+void* heapMapBuffer(size_t size) {
+    void* pointer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return pointer == MAP_FAILED ? NULL : pointer;
+}
+
+//the kernel can move the pages of a growing buffer without copying them,
+//on failure the buffer is left as it was, like realloc
+void* heapRemapBuffer(void* pointer, size_t oldSize, size_t newSize) {
+    #ifdef MREMAP_MAYMOVE
+    void* result = mremap(pointer, oldSize, newSize, MREMAP_MAYMOVE);
+    return result == MAP_FAILED ? NULL : result;
+    #else
+    void* result = heapMapBuffer(newSize);
+    if (result == NULL) return NULL;
+    memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    heapUnmapBuffer(pointer, oldSize);
+    return result;
+    #endif
+}
+
+void heapUnmapBuffer(void* pointer, size_t size) {
+    munmap(pointer, size);
+}
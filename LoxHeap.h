@@ -0,0 +1,113 @@
+#ifndef lox_LoxHeap_h
+#define lox_LoxHeap_h
+
+#include "common.h"
+
+//objects up to HEAP_MAX_SMALL bytes are carved out of pages of equally sized cells,
+//one size class per HEAP_GRANULE bytes, anything bigger gets a page of its own
+#define HEAP_PAGE_SIZE (64 * 1024)
+#define HEAP_GRANULE 8
+#define HEAP_SIZE_CLASSES 32
+#define HEAP_MAX_SMALL (HEAP_GRANULE * HEAP_SIZE_CLASSES)
+//large object pages are listed after the small size classes
+#define HEAP_LARGE_CLASS HEAP_SIZE_CLASSES
+
+//buffers of at least this many bytes, the characters of a huge string or the entries of
+//a huge table, get their own mapping that is handed back to the system when they are freed
+#define HEAP_LARGE_BUFFER (128 * 1024)
+
+//one bit per granule of the page, a cell's bit is the one for its first granule
+#define HEAP_PAGE_WORDS (HEAP_PAGE_SIZE / HEAP_GRANULE / 64)
+
+//a free cell holds the link to the next free cell of its page
+typedef struct HeapCell {
+    struct HeapCell* next;
+} HeapCell;
+
+//pages are aligned to HEAP_PAGE_SIZE, so the header of the page an object lives
+//in is found by masking its address, the header is followed by the cells
+typedef struct HeapPage {
+    struct HeapPage* next;
+    //next page of the same class that still has free cells
+    struct HeapPage* nextAvailable;
+    //next page of the same class left for lazy sweeping
+    struct HeapPage* nextUnswept;
+    HeapCell* freeList;
+    int sizeClass;
+    int cellSize;
+    int cellCount;
+    int liveCount;
+    //allocated since the last collection, so a minor collection has to sweep it
+    bool hasYoung;
+    //marked but not swept yet, it has to be swept before anything is allocated in it
+    bool needsSweep;
+    //its objects are being moved out by a compaction, each old cell holds a forwarding pointer
+    bool evacuating;
+
+    uint64_t allocBits[HEAP_PAGE_WORDS];
+    uint64_t markBits[HEAP_PAGE_WORDS];
+} HeapPage;
+
+typedef struct {
+    HeapPage* pages[HEAP_SIZE_CLASSES + 1];
+    HeapPage* available[HEAP_SIZE_CLASSES];
+    HeapPage* unswept[HEAP_SIZE_CLASSES];
+    int unsweptCount;
+    int pageCount;
+} LoxHeap;
+
+void initHeap(LoxHeap* heap);
+void freeHeap(LoxHeap* heap);
+//NULL if the system has no memory left for a new page
+void* heapAllocate(LoxHeap* heap, size_t size);
+void heapFree(LoxHeap* heap, void* pointer, size_t size);
+HeapPage* heapFirstPage(LoxHeap* heap);
+HeapPage* heapNextPage(LoxHeap* heap, HeapPage* page);
+void heapClearMarks(LoxHeap* heap);
+void heapReleaseEmptyPages(LoxHeap* heap);
+void heapDeferSweep(LoxHeap* heap, HeapPage* page);
+void heapPageSwept(LoxHeap* heap, HeapPage* page);
+HeapPage* heapUnsweptFor(LoxHeap* heap, size_t size);
+HeapPage* heapTakeUnswept(LoxHeap* heap);
+double heapOccupancy(LoxHeap* heap);
+int heapSelectEvacuation(LoxHeap* heap);
+void heapReleaseEvacuated(LoxHeap* heap);
+//NULL if the system has no memory left for the mapping
+void* heapMapBuffer(size_t size);
+void* heapRemapBuffer(void* pointer, size_t oldSize, size_t newSize);
+void heapUnmapBuffer(void* pointer, size_t size);
+
+static inline HeapPage* heapPageOf(const void* cell) {
+    return (HeapPage*)((uintptr_t)cell & ~(uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+static inline size_t heapBitIndex(const void* cell) {
+    return ((uintptr_t)cell & (HEAP_PAGE_SIZE - 1)) / HEAP_GRANULE;
+}
+
+//the cell whose first granule is the given bit of the page
+static inline void* heapCellAt(HeapPage* page, size_t index) {
+    return (char*)page + index * HEAP_GRANULE;
+}
+
+//mark bits can be set by marking threads at the same time as they are read here
+static inline bool heapIsMarked(const void* cell) {
+    size_t index = heapBitIndex(cell);
+    uint64_t word = __atomic_load_n(&heapPageOf(cell)->markBits[index / 64], __ATOMIC_RELAXED);
+    return (word >> (index % 64)) & 1;
+}
+
+static inline void heapSetMarked(void* cell) {
+    size_t index = heapBitIndex(cell);
+    heapPageOf(cell)->markBits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+//atomically set the mark bit, true if this call is the one that set it
+static inline bool heapTryMark(void* cell) {
+    size_t index = heapBitIndex(cell);
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    uint64_t old = __atomic_fetch_or(&heapPageOf(cell)->markBits[index / 64], bit, __ATOMIC_ACQ_REL);
+    return (old & bit) == 0;
+}
+
+#endif
@@ -1,166 +1,233 @@
-#include <stdio.h>
-#include <string.h>
-
-#include "memory.h"
-#include "LoxObject.h"
-#include "LoxTable.h"
-#include "LoxValue.h"
-#include "LoxVM.h"
-
-#define ALLOCATE_OBJ(type, objectType) \
-(type*)allocateObject(sizeof(type), objectType)
-
-static LoxObject* allocateObject(size_t size, ObjType type) {
-    LoxObject* obj = (LoxObject*)reallocate(NULL, 0, size);
-    obj->type = type;
-    obj->isMarked = false;
-
-    obj->next = vm.objects;
-    vm.objects = obj;
-
-    #ifdef DEBUG_LOG_GC
-    printf("%p allocate %zu for %d\n", (void*)object, size, type);
-    #endif
-
-    return obj;
-}
-
-LoxObjBoundMethod* newBoundMethod(LoxValue receiver, LoxObjClosure* method) {
-    LoxObjBoundMethod* bound = ALLOCATE_OBJ(LoxObjBoundMethod, OBJ_BOUND_METHOD);
-    bound->receiver = receiver;
-    bound->method = method;
-    return bound;
-}
-
-LoxObjClass* newClass(LoxObjString* name) {
-    LoxObjClass* klass = ALLOCATE_OBJ(LoxObjClass, OBJ_CLASS);
-    klass->name = name; 
-    initTable(&klass->methods);
-    return klass;
-}
-
-LoxObjClosure* newClosure(LoxObjFunction* function) {
-    LoxObjUpvalue** upvalues = ALLOCATE(LoxObjUpvalue*, function->upvalueCount);
-    for (int i = 0; i < function->upvalueCount; i++) {
-        upvalues[i] = NULL;
-    }
-
-    LoxObjClosure* closure = ALLOCATE_OBJ(LoxObjClosure, OBJ_CLOSURE);
-    closure->function = function;
-    closure->upvalues = upvalues;
-    closure->upvalueCount = function->upvalueCount;
-    return closure;
-}
-
-LoxObjFunction* newFunction() {
-    LoxObjFunction* function = ALLOCATE_OBJ(LoxObjFunction, OBJ_FUNCTION);
-    function->arity = 0;
-    function->upvalueCount = 0;
-    function->name = NULL;
-    initChunk(&function->chunk);
-    return function;
-}
-
-LoxObjInstance* newInstance(LoxObjClass* klass) {
-    LoxObjInstance* instance = ALLOCATE_OBJ(LoxObjInstance, OBJ_INSTANCE);
-    instance->klass = klass;
-    initTable(&instance->fields);
-    return instance;
-}
-
-LoxObjNative* newNative(LoxNativeFunc function) {
-    LoxObjNative* native = ALLOCATE_OBJ(LoxObjNative, OBJ_NATIVE);
-    native->function = function;
-    return native;
-}
-
-static LoxObjString* allocateString(char* chars, int length, uint32_t hash) {
-    LoxObjString* str = ALLOCATE_OBJ(LoxObjString, OBJ_STRING);
-    str->length = length;
-    str->chars = chars;
-    str->hash = hash;
-
-    push(OBJ_VAL(str));
-    tableSet(&vm.strings, str, NIL_VAL);
-    pop();
-
-    return str;
-}
-
-static uint32_t hashString(const char* key, int length){
-    uint32_t hash = 2166136261u;
-    for (int i = 0; i < length; i++) {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
-    }
-    return hash;
-}
-
-LoxObjString* takeString(char* chars, int length){
-    uint32_t hash = hashString(chars, length);
-    LoxObjString* objStr = tableFindString(&vm.strings, chars, length, hash);
-    if (objStr != NULL) {
-        FreeArr(char, chars, length + 1);
-        return objStr;
-    }
-
-    return allocateString(chars, length, hash);
-}
-
-LoxObjString* copyString(const char* chars, int length) {
-    uint32_t hashVal = hashString(chars, length);
-    LoxObjString* objStr = tableFindString(&vm.strings, chars, length, hashVal);
-
-    if (objStr != NULL) return objStr;
-
-    char* heapChars = ALLOCATE(char, length + 1);
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
-    return allocateString(heapChars, length, hashVal);
-}
-
-LoxObjUpvalue* newUpvalue(LoxValue* slot) {
-    LoxObjUpvalue* upvalue = ALLOCATE_OBJ(LoxObjUpvalue, OBJ_UPVALUE);
-    upvalue->closed = NIL_VAL;
-    upvalue->location = slot;
-    upvalue->next = NULL;
-    return upvalue;
-}
-
-static void printFunction(LoxObjFunction* function) {
-    if (function->name == NULL) {
-        printf("<script>");
-        return;
-    }
-    printf("<fn %s>", function->name->chars);
-}
-
-void printObject(LoxValue value) {
-    switch (OBJ_TYPE(value)) {
-        case OBJ_BOUND_METHOD:
-            printFunction(AS_BOUND_METHOD(value)->method->function);
-            break;
-        case OBJ_CLASS:
-            printf("%s", AS_CLASS(value)->name->chars);
-            break;
-        case OBJ_CLOSURE:
-            printFunction(AS_CLOSURE(value)->function);
-            break;
-        case OBJ_FUNCTION:
-            printFunction(AS_FUNCTION(value));
-            break;
-        case OBJ_INSTANCE:
-            printf("%s instance",
-                    AS_INSTANCE(value)->klass->name->chars);
-            break;
-        case OBJ_NATIVE:
-            printf("<native fn>");
-            break;
-        case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
-            break;
-        case OBJ_UPVALUE:
-            printf("upvalue");
-            break;
-        }
-}
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "LoxObject.h"
+#include "LoxTable.h"
+#include "LoxValue.h"
+#include "LoxVM.h"
+
+#define ALLOCATE_OBJ(vm, type, objectType) \
+(type*)allocateObject(vm, sizeof(type), objectType)
+
+static LoxObject* allocateObject(LoxVM* vm, size_t size, ObjType type) {
+    LoxObject* obj = (LoxObject*)allocateObjectMemory(vm, size, type);
+    obj->type = type;
+    //objects created during an incremental or concurrent collection start out black,
+    //otherwise they are white and belong to the young generation until they survive one
+    if (vm->gcPhase != GC_PHASE_IDLE) heapTryMark(obj);
+    obj->isRemembered = false;
+
+    #ifdef DEBUG_LOG_GC
+    printf("%p allocate %zu for %d\n", (void*)object, size, type);
+    #endif
+
+    return obj;
+}
+
+LoxObjBoundMethod* newBoundMethod(LoxVM* vm, LoxValue receiver, LoxObjClosure* method) {
+    LoxObjBoundMethod* bound = ALLOCATE_OBJ(vm, LoxObjBoundMethod, OBJ_BOUND_METHOD);
+    bound->receiver = receiver;
+    bound->method = method;
+    writeBarrier(vm, (LoxObject*)bound, receiver);
+    writeBarrier(vm, (LoxObject*)bound, OBJ_VAL(method));
+    return bound;
+}
+
+LoxObjClass* newClass(LoxVM* vm, LoxObjString* name) {
+    LoxObjClass* klass = ALLOCATE_OBJ(vm, LoxObjClass, OBJ_CLASS);
+    klass->name = name; 
+    writeBarrier(vm, (LoxObject*)klass, OBJ_VAL(name));
+    klass->frozen = false;
+    initTable(&klass->methods);
+    initFrozenTable(&klass->frozenMethods);
+    klass->vtable = NULL;
+    klass->vtableBase = 0;
+    klass->vtableSize = 0;
+    klass->initializer = NULL;
+    klass->fieldCount = 0;
+    return klass;
+}
+
+LoxObjClosure* newClosure(LoxVM* vm, LoxObjFunction* function) {
+    LoxObjUpvalue** upvalues = ALLOCATE(vm, LoxObjUpvalue*, function->upvalueCount);
+    for (int i = 0; i < function->upvalueCount; i++) {
+        upvalues[i] = NULL;
+    }
+
+    LoxObjClosure* closure = ALLOCATE_OBJ(vm, LoxObjClosure, OBJ_CLOSURE);
+    closure->function = function;
+    writeBarrier(vm, (LoxObject*)closure, OBJ_VAL(function));
+    closure->upvalues = upvalues;
+    closure->upvalueCount = function->upvalueCount;
+    return closure;
+}
+
+//the stack and frames are allocated before the fiber, a collection that runs meanwhile cannot see them
+LoxObjFiber* newFiber(LoxVM* vm, LoxObjClosure* closure, int stackCapacity) {
+    LoxValue* stack = ALLOCATE(vm, LoxValue, stackCapacity);
+    LoxCallFrame* frames = ALLOCATE(vm, LoxCallFrame, FIBER_FRAMES_MIN);
+
+    LoxObjFiber* fiber = ALLOCATE_OBJ(vm, LoxObjFiber, OBJ_FIBER);
+    fiber->state = FIBER_NEW;
+    fiber->queued = false;
+    fiber->closure = closure;
+    if (closure != NULL) writeBarrier(vm, (LoxObject*)fiber, OBJ_VAL(closure));
+    fiber->stack = stack;
+    fiber->stackTop = stack;
+    fiber->stackCapacity = stackCapacity;
+    fiber->frames = frames;
+    fiber->frameCount = 0;
+    fiber->frameCapacity = FIBER_FRAMES_MIN;
+    fiber->openUpvalues = NULL;
+    fiber->resumer = NULL;
+    return fiber;
+}
+
+LoxObjFunction* newFunction(LoxVM* vm) {
+    LoxObjFunction* function = ALLOCATE_OBJ(vm, LoxObjFunction, OBJ_FUNCTION);
+    function->arity = 0;
+    function->upvalueCount = 0;
+    function->slotCount = 1;
+    function->name = NULL;
+    function->superCache = NULL;
+    initChunk(&function->chunk);
+    return function;
+}
+
+//the fields are sized before the instance exists, a collection that runs meanwhile cannot see them
+LoxObjInstance* newInstance(LoxVM* vm, LoxObjClass* klass) {
+    LoxTable fields;
+    initTable(&fields);
+    if (klass->fieldCount > 0) tableReserve(vm, &fields, klass->fieldCount);
+
+    LoxObjInstance* instance = ALLOCATE_OBJ(vm, LoxObjInstance, OBJ_INSTANCE);
+    instance->klass = klass;
+    writeBarrier(vm, (LoxObject*)instance, OBJ_VAL(klass));
+    instance->fields = fields;
+    return instance;
+}
+
+LoxObjNative* newNative(LoxVM* vm, LoxNativeFunc function) {
+    LoxObjNative* native = ALLOCATE_OBJ(vm, LoxObjNative, OBJ_NATIVE);
+    native->function = function;
+    return native;
+}
+
+static LoxObjString* allocateString(LoxVM* vm, char* chars, int length, uint32_t hash) {
+    LoxObjString* str = ALLOCATE_OBJ(vm, LoxObjString, OBJ_STRING);
+    str->length = length;
+    str->chars = chars;
+    str->hash = hash;
+    str->selector = -1;
+
+    push(vm, OBJ_VAL(str));
+    tableSet(vm, &vm->strings, str, NIL_VAL);
+    pop(vm);
+
+    return str;
+}
+
+static uint32_t hashString(const char* key, int length){
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+//vm->strings only holds its strings weakly, so one found there may be garbage the
+//concurrent marker will never reach, it is shaded before being handed out again
+static LoxObjString* findInterned(LoxVM* vm, const char* chars, int length, uint32_t hash) {
+    LoxObjString* string = tableFindString(&vm->strings, chars, length, hash);
+    if (string != NULL && vm->gcConcurrentMark) markObject(vm, (LoxObject*)string);
+    return string;
+}
+
+LoxObjString* takeString(LoxVM* vm, char* chars, int length){
+    uint32_t hash = hashString(chars, length);
+    LoxObjString* objStr = findInterned(vm, chars, length, hash);
+    if (objStr != NULL) {
+        FreeArr(vm, char, chars, length + 1);
+        return objStr;
+    }
+
+    return allocateString(vm, chars, length, hash);
+}
+
+LoxObjString* copyString(LoxVM* vm, const char* chars, int length) {
+    uint32_t hashVal = hashString(chars, length);
+    LoxObjString* objStr = findInterned(vm, chars, length, hashVal);
+
+    if (objStr != NULL) return objStr;
+
+    char* heapChars = ALLOCATE(vm, char, length + 1);
+    memcpy(heapChars, chars, length);
+    heapChars[length] = '\0';
+    return allocateString(vm, heapChars, length, hashVal);
+}
+
+//selectors are handed out VM-wide in the order method names are first compiled,
+//only the compiler hands them out, so the collector is held off while the names grow
+int methodSelector(LoxVM* vm, LoxObjString* name) {
+    if (name->selector >= 0) return name->selector;
+
+    if (vm->selectorCapacity < vm->selectorCount + 1) {
+        int oldCap = vm->selectorCapacity;
+        vm->selectorCapacity = GrowCap(oldCap);
+        vm->selectorNames = GrowArr(vm, LoxObjString*, vm->selectorNames, oldCap, vm->selectorCapacity);
+    }
+    vm->selectorNames[vm->selectorCount] = name;
+    name->selector = vm->selectorCount++;
+    return name->selector;
+}
+
+LoxObjUpvalue* newUpvalue(LoxVM* vm, LoxValue* slot) {
+    LoxObjUpvalue* upvalue = ALLOCATE_OBJ(vm, LoxObjUpvalue, OBJ_UPVALUE);
+    upvalue->closed = OBJ_VAL(vm->fiber);
+    upvalue->location = slot;
+    upvalue->next = NULL;
+    return upvalue;
+}
+
+static void printFunction(LoxObjFunction* function) {
+    if (function->name == NULL) {
+        printf("<script>");
+        return;
+    }
+    printf("<fn %s>", function->name->chars);
+}
+
+void printObject(LoxValue value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_BOUND_METHOD:
+            printFunction(AS_BOUND_METHOD(value)->method->function);
+            break;
+        case OBJ_CLASS:
+            printf("%s", AS_CLASS(value)->name->chars);
+            break;
+        case OBJ_CLOSURE:
+            printFunction(AS_CLOSURE(value)->function);
+            break;
+        case OBJ_FIBER:
+            printf("<fiber>");
+            break;
+        case OBJ_FUNCTION:
+            printFunction(AS_FUNCTION(value));
+            break;
+        case OBJ_INSTANCE:
+            printf("%s instance",
+                    AS_INSTANCE(value)->klass->name->chars);
+            break;
+        case OBJ_NATIVE:
+            printf("<native fn>");
+            break;
+        case OBJ_STRING:
+            printf("%s", AS_CSTRING(value));
+            break;
+        case OBJ_UPVALUE:
+            printf("upvalue");
+            break;
+        }
+}
@@ -1,120 +1,187 @@
-#ifndef lox_LoxObject_h
-#define lox_LoxObject_h
-
-#include "common.h"
-#include "LoxChunk.h"
-#include "LoxTable.h"
-#include "LoxValue.h"
-
-
-#define OBJ_TYPE(value)        (AS_OBJ(value)->type)
-
-#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
-#define IS_CLASS(value)        isObjType(value, OBJ_CLASS)
-
-#define IS_CLOSURE(value)      isObjType(value, OBJ_CLOSURE)
-#define IS_FUNCTION(value)     isObjType(value, OBJ_FUNCTION)
-
-#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
-#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
-#define IS_STRING(value)       isObjType(value, OBJ_STRING)
-#define AS_BOUND_METHOD(value) ((LoxObjBoundMethod*)AS_OBJ(value))
-#define AS_CLASS(value)        ((LoxObjClass*)AS_OBJ(value))
-#define AS_CLOSURE(value)      ((LoxObjClosure*)AS_OBJ(value))
-#define AS_FUNCTION(value)     ((LoxObjFunction*)AS_OBJ(value))
-#define AS_INSTANCE(value)     ((LoxObjInstance*)AS_OBJ(value))
-#define AS_NATIVE(value) \
-(((LoxObjNative*)AS_OBJ(value))->function)
-#define AS_STRING(value)       ((LoxObjString*)AS_OBJ(value))
-#define AS_CSTRING(value)      (((LoxObjString*)AS_OBJ(value))->chars)
-
-
-typedef enum {
-OBJ_BOUND_METHOD,
-OBJ_CLASS,
-OBJ_CLOSURE,
-OBJ_FUNCTION,
-OBJ_INSTANCE,
-OBJ_NATIVE,
-OBJ_STRING,
-OBJ_UPVALUE
-} ObjType;
-
-struct LoxObject{
-    ObjType type;
-    bool isMarked;
-    struct LoxObject* next;
-};
-
-typedef struct {
-    LoxObject obj;
-    int arity;
-    int upvalueCount;
-    LoxChunk chunk;
-    LoxObjString* name;
-} LoxObjFunction;
-
-
-typedef LoxValue (*LoxNativeFunc)(int argCount, LoxValue* args);
-
-typedef struct {
-    LoxObject obj;
-    LoxNativeFunc function;
-} LoxObjNative;
-
-
-struct LoxObjString {
-    LoxObject obj;
-    int length;
-    char* chars;
-    uint32_t hash;
-};
-
-typedef struct LoxObjUpvalue {
-    LoxObject obj;
-    LoxValue* location;
-    LoxValue closed;
-    struct LoxObjUpvalue* next;
-} LoxObjUpvalue;
-
-typedef struct {
-    LoxObject obj;
-    LoxObjFunction* function;
-    LoxObjUpvalue** upvalues;
-    int upvalueCount;
-} LoxObjClosure;
-
-
-typedef struct {
-    LoxObject obj;
-    LoxObjString* name;
-    LoxTable methods;
-} LoxObjClass;
-
-typedef struct {
-    LoxObject obj;
-    LoxObjClass* klass;
-    LoxTable fields; 
-} LoxObjInstance;
-
-typedef struct {
-    LoxObject obj;
-    LoxValue receiver;
-    LoxObjClosure* method;
-} LoxObjBoundMethod;
-
-LoxObjBoundMethod* newBoundMethod(LoxValue receiver, LoxObjClosure* method);
-LoxObjClass* newClass(LoxObjString* name);
-LoxObjClosure* newClosure(LoxObjFunction* function);
-LoxObjFunction* newFunction();
-LoxObjInstance* newInstance(LoxObjClass* klass);
-LoxObjNative* newNative(LoxNativeFunc function);
-LoxObjString* takeString(char* chars, int length);
-LoxObjString* copyString(const char* chars, int length);
-LoxObjUpvalue* newUpvalue(LoxValue* slot);
-void printObject(LoxValue value);
-static inline bool isObjType(LoxValue value, ObjType type) {
-return IS_OBJ(value) && AS_OBJ(value)->type == type;
-}
-
+#ifndef lox_LoxObject_h
+#define lox_LoxObject_h
+
+#include "common.h"
+#include "LoxChunk.h"
+#include "LoxTable.h"
+#include "LoxValue.h"
+
+
+#define OBJ_TYPE(value)        (AS_OBJ(value)->type)
+
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
+#define IS_CLASS(value)        isObjType(value, OBJ_CLASS)
+
+#define IS_CLOSURE(value)      isObjType(value, OBJ_CLOSURE)
+#define IS_FIBER(value)        isObjType(value, OBJ_FIBER)
+#define IS_FUNCTION(value)     isObjType(value, OBJ_FUNCTION)
+
+#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
+#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
+#define IS_STRING(value)       isObjType(value, OBJ_STRING)
+#define AS_BOUND_METHOD(value) ((LoxObjBoundMethod*)AS_OBJ(value))
+#define AS_CLASS(value)        ((LoxObjClass*)AS_OBJ(value))
+#define AS_CLOSURE(value)      ((LoxObjClosure*)AS_OBJ(value))
+#define AS_FIBER(value)        ((LoxObjFiber*)AS_OBJ(value))
+#define AS_FUNCTION(value)     ((LoxObjFunction*)AS_OBJ(value))
+#define AS_INSTANCE(value)     ((LoxObjInstance*)AS_OBJ(value))
+#define AS_NATIVE(value) \
+(((LoxObjNative*)AS_OBJ(value))->function)
+#define AS_STRING(value)       ((LoxObjString*)AS_OBJ(value))
+#define AS_CSTRING(value)      (((LoxObjString*)AS_OBJ(value))->chars)
+
+
+typedef enum {
+OBJ_BOUND_METHOD,
+OBJ_CLASS,
+OBJ_CLOSURE,
+OBJ_FIBER,
+OBJ_FUNCTION,
+OBJ_INSTANCE,
+OBJ_NATIVE,
+OBJ_STRING,
+OBJ_UPVALUE
+} ObjType;
+
+#define OBJ_TYPE_COUNT (OBJ_UPVALUE + 1)
+
+//mark bits live in the bitmaps of the heap page holding the object, so the header is two bytes
+//and the first 32-bit field of each object type fits in the rest of the object's first word
+struct LoxObject{
+    uint8_t type;
+    bool isRemembered;
+};
+
+//superCache is NULL until the function first calls a method on super, see LoxSuperCache
+typedef struct {
+    LoxObject obj;
+    int arity;
+    int upvalueCount;
+    int slotCount;
+    LoxChunk chunk;
+    LoxObjString* name;
+    struct LoxSuperCache* superCache;
+} LoxObjFunction;
+
+
+typedef LoxValue (*LoxNativeFunc)(LoxVM* vm, int argCount, LoxValue* args);
+
+typedef struct {
+    LoxObject obj;
+    LoxNativeFunc function;
+} LoxObjNative;
+
+
+//selector is the string's slot in the vtables once a method is defined or invoked with it as its name, else -1
+struct LoxObjString {
+    LoxObject obj;
+    int length;
+    char* chars;
+    uint32_t hash;
+    int selector;
+};
+
+//while the upvalue is open closed holds the fiber whose stack location points into,
+//which keeps that stack alive for as long as a closure can still reach the upvalue
+typedef struct LoxObjUpvalue {
+    LoxObject obj;
+    LoxValue* location;
+    LoxValue closed;
+    struct LoxObjUpvalue* next;
+} LoxObjUpvalue;
+
+typedef struct {
+    LoxObject obj;
+    int upvalueCount;
+    LoxObjFunction* function;
+    LoxObjUpvalue** upvalues;
+} LoxObjClosure;
+
+typedef struct {
+    LoxObjClosure* closure;
+    uint8_t* ip;
+    LoxValue* slots;
+} LoxCallFrame;
+
+//a fiber that is not running has its stack, frames and open upvalues saved here, the running
+//one's are loaded into the VM and only written back when it is switched out
+//a waiting fiber is parked in sleep() until the event loop queues it again
+typedef enum {
+    FIBER_NEW,
+    FIBER_SUSPENDED,
+    FIBER_WAITING,
+    FIBER_RUNNING,
+    FIBER_DONE
+} FiberState;
+
+//resumer is the fiber waiting in resume() for this one to yield or finish, NULL when it was
+//started by the scheduler, queued is set while it has an entry in the VM's run queue
+typedef struct LoxObjFiber {
+    LoxObject obj;
+    uint8_t state;
+    bool queued;
+    int frameCount;
+    int frameCapacity;
+    int stackCapacity;
+    LoxObjClosure* closure;
+    LoxValue* stack;
+    LoxValue* stackTop;
+    LoxCallFrame* frames;
+    LoxObjUpvalue* openUpvalues;
+    struct LoxObjFiber* resumer;
+} LoxObjFiber;
+
+//methods holds every method by name and keeps them alive, vtable holds the same closures for
+//the window of vtableSize selectors starting at vtableBase and initializer the init method, if any
+//frozenMethods is built from methods the first time a lookup falls outside the window, frozen is
+//set then, and a method defined after that frees it again
+//fieldCount is the most fields any of its instances has had, new ones get room for that many
+typedef struct {
+    LoxObject obj;
+    bool frozen;
+    int fieldCount;
+    LoxObjString* name;
+    LoxTable methods;
+    LoxFrozenTable frozenMethods;
+    LoxObjClosure** vtable;
+    int vtableBase;
+    int vtableSize;
+    LoxObjClosure* initializer;
+} LoxObjClass;
+
+//the method a super call resolved to, one for each constant of the calling function's chunk and
+//used by the super calls naming that constant, klass is the superclass it was looked up in
+typedef struct LoxSuperCache {
+    LoxObjClass* klass;
+    LoxObjClosure* method;
+} LoxSuperCache;
+
+typedef struct {
+    LoxObject obj;
+    LoxObjClass* klass;
+    LoxTable fields; 
+} LoxObjInstance;
+
+typedef struct {
+    LoxObject obj;
+    LoxValue receiver;
+    LoxObjClosure* method;
+} LoxObjBoundMethod;
+
+LoxObjBoundMethod* newBoundMethod(LoxVM* vm, LoxValue receiver, LoxObjClosure* method);
+LoxObjClass* newClass(LoxVM* vm, LoxObjString* name);
+LoxObjClosure* newClosure(LoxVM* vm, LoxObjFunction* function);
+LoxObjFiber* newFiber(LoxVM* vm, LoxObjClosure* closure, int stackCapacity);
+LoxObjFunction* newFunction(LoxVM* vm);
+LoxObjInstance* newInstance(LoxVM* vm, LoxObjClass* klass);
+LoxObjNative* newNative(LoxVM* vm, LoxNativeFunc function);
+LoxObjString* takeString(LoxVM* vm, char* chars, int length);
+LoxObjString* copyString(LoxVM* vm, const char* chars, int length);
+int methodSelector(LoxVM* vm, LoxObjString* name);
+LoxObjUpvalue* newUpvalue(LoxVM* vm, LoxValue* slot);
+void printObject(LoxValue value);
+static inline bool isObjType(LoxValue value, ObjType type) {
+return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
+
 #endif
\ No newline at end of file
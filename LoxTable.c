@@ -1,148 +1,466 @@
-#include <stdlib.h>
-#include <string.h>
-#include "memory.h"
-#include "LoxObject.h"
-#include "LoxTable.h"
-#include "LoxValue.h"
-
-#define TABLE_MAX_LOAD 0.75
-
-void initTable(LoxTable* table) {
-    table->count = 0;
-    table->capacity = 0;
-    table->entries = NULL;
-}
-
-void freeTable(LoxTable* table) {
-    FreeArr(LoxEntry, table->entries, table->capacity);
-    initTable(table);
-}
-
-static LoxEntry* findEntry(LoxEntry* entries, int capacity, LoxObjString* key){
-    uint32_t index = key->hash & (capacity - 1);
-    LoxEntry* tombstone = NULL;
-
-    for (;;) {
-        LoxEntry* entry = &entries[index];
-
-        if (entry->key == NULL) {
-            if (IS_NIL(entry->value)){
-                return tombstone != NULL ? tombstone : entry;
-            } 
-            else{
-            if (tombstone == NULL){
-                tombstone = entry;
-            }
-            }
-        } 
-        else if (entry->key == key){
-            return entry;
-        }
-
-        index = (index + 1) & (capacity - 1);
-    }
-}
-
-bool tableGet(LoxTable* table, LoxObjString* key, LoxValue* value) {
-    if (table->count == 0) return false;
-
-    LoxEntry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) return false;
-
-    *value = entry->value;
-    return true;
-}
-
-static void adjustCapacity(LoxTable* table, int capacity) {
-    LoxEntry* entries = ALLOCATE(LoxEntry, capacity);
-    for (int i = 0; i < capacity; i++) {
-        entries[i].key = NULL;
-        entries[i].value = NIL_VAL;
-    }
-
-    table->count = 0;
-    for (int i = 0; i < table->capacity; i++) {
-        LoxEntry* entry = &table->entries[i];
-        if (entry->key == NULL) continue;
-
-        LoxEntry* dest = findEntry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->value = entry->value;
-        table->count++;
-    }
-
-    FreeArr(LoxEntry, table->entries, table->capacity);
-    table->entries = entries;
-    table->capacity = capacity;
-}
-
-bool tableSet(LoxTable* table, LoxObjString* key, LoxValue value){
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-        int capacity = GrowCap(table->capacity);
-        adjustCapacity(table, capacity);
-    }
-
-    LoxEntry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-
-    if (isNewKey && IS_NIL(entry->value)) table->count++;
-    entry->key = key;
-    entry->value = value;
-    return isNewKey;
-}
-
-bool tableDelete(LoxTable* table, LoxObjString* key){
-    if (table->count == 0) return false;
-
-    LoxEntry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) return false;
-
-    entry->key = NULL;
-    entry->value = BOOL_VAL(true);
-    return true;
-}
-
-void tableAddAll(LoxTable* src, LoxTable* dest){
-    for (int i = 0; i < src->capacity; i++) {
-        LoxEntry* entry = &src->entries[i];
-        if (entry->key != NULL) {
-            tableSet(dest, entry->key, entry->value);
-        }
-    }
-}
-
-LoxObjString* tableFindString(LoxTable* table, const char* chars, int length, uint32_t hash){
-    if (table->count == 0) return NULL;
-
-    uint32_t index = hash & (table->capacity - 1);
-    for (;;) {
-        LoxEntry* entry = &table->entries[index];
-        if (entry->key == NULL) {
-            if(IS_NIL(entry->value)) return NULL;
-        } 
-        else if (entry->key->length == length &&
-            entry->key->hash == hash &&
-            memcmp(entry->key->chars, chars, length) == 0) {
-            return entry->key;
-        }
-
-        index = (index + 1) & (table->capacity - 1);
-    }
-}
-
-void tableRemoveWhite(LoxTable* table) {
-    for (int i = 0; i < table->capacity; i++) {
-        LoxEntry* entry = &table->entries[i];
-        if (entry->key != NULL && !entry->key->obj.isMarked) {
-            tableDelete(table, entry->key);
-        }
-    }
-}
-
-void markTable(LoxTable* table) {
-    for (int i = 0; i < table->capacity; i++) {
-        LoxEntry* entry = &table->entries[i];
-        markObject((LoxObject*)entry->key);
-        markValue(entry->value);
-    }
-}
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+#include "LoxObject.h"
+#include "LoxTable.h"
+#include "LoxValue.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TABLE_MAX_LOAD 0.75
+//the smallest capacity GrowCap gives a table
+#define TABLE_MIN_CAPACITY 8
+
+//frozen tables are meant for method tables, bigger ones are left to the general lookup
+#define FROZEN_MAX_ENTRIES 64
+//seeds tried for each frozen capacity before the capacity is doubled
+#define FROZEN_SEED_TRIES 32
+
+//a Swiss table: next to the entries is one control byte per slot, either EMPTY, DELETED
+//or, for a full slot, the low 7 bits of its key's hash, lookups compare a whole group of
+//control bytes at once and only look at the entries whose byte matches
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+#define GROUP_SIZE 16
+
+static uint8_t hashTag(uint32_t hash) {
+    return hash & 0x7f;
+}
+
+//tables smaller than a group still get a whole group of control bytes, the extra ones stay EMPTY
+static int controlSize(int capacity) {
+    return capacity < GROUP_SIZE ? GROUP_SIZE : capacity;
+}
+
+static size_t tableBytes(int capacity) {
+    return sizeof(LoxEntry) * capacity + controlSize(capacity);
+}
+
+static uint8_t* controlBytes(LoxEntry* entries, int capacity) {
+    return (uint8_t*)(entries + capacity);
+}
+
+//groups are numbered from 0 to the mask, a table smaller than a group is a single group
+static int groupMask(int capacity) {
+    return (capacity - 1) / GROUP_SIZE;
+}
+
+//the slots of a group that belong to the table, a lookup can skip this since the
+//padding control bytes never match a tag and any group with them is the only one
+static uint32_t groupLanes(int capacity) {
+    return capacity < GROUP_SIZE ? (1u << capacity) - 1 : 0xffff;
+}
+
+static bool isFull(LoxTable* table, int index) {
+    return controlBytes(table->entries, table->capacity)[index] < CTRL_EMPTY;
+}
+
+//one bit per control byte of the group equal to tag
+static uint32_t groupMatch(const uint8_t* group, uint8_t tag) {
+    #ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)tag)));
+    #else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        if (group[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+    #endif
+}
+
+//one bit per control byte of the group that is EMPTY or DELETED, the only ones with the top bit set
+static uint32_t groupFree(const uint8_t* group) {
+    #ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+    #else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        if (group[i] & 0x80) mask |= 1u << i;
+    }
+    return mask;
+    #endif
+}
+
+void initTable(LoxTable* table) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+}
+
+void freeTable(LoxVM* vm, LoxTable* table) {
+    if (table->entries != NULL) {
+        FreeArr(vm, uint8_t, table->entries, tableBytes(table->capacity));
+    }
+    initTable(table);
+}
+
+//groups are visited in triangular steps, which reaches every group of a power of two count,
+//a key is missing once a group it would be in still has an EMPTY slot
+static int findIndex(LoxEntry* entries, int capacity, LoxObjString* key) {
+    uint8_t* control = controlBytes(entries, capacity);
+    int mask = groupMask(capacity);
+    uint8_t tag = hashTag(key->hash);
+
+    int group = (key->hash >> 7) & mask;
+    for (int step = 1; ; step++) {
+        uint8_t* bytes = control + group * GROUP_SIZE;
+        uint32_t match = groupMatch(bytes, tag);
+        while (match != 0) {
+            int index = group * GROUP_SIZE + __builtin_ctz(match);
+            if (entries[index].key == key) return index;
+            match &= match - 1;
+        }
+        if (groupMatch(bytes, CTRL_EMPTY)) return -1;
+        group = (group + step) & mask;
+    }
+}
+
+//the slot for a key that is not in the table, the first DELETED or EMPTY one on its probe path
+static int findFree(LoxEntry* entries, int capacity, uint32_t hash) {
+    uint8_t* control = controlBytes(entries, capacity);
+    int mask = groupMask(capacity);
+    uint32_t lanes = groupLanes(capacity);
+
+    int group = (hash >> 7) & mask;
+    for (int step = 1; ; step++) {
+        uint32_t free = groupFree(control + group * GROUP_SIZE) & lanes;
+        if (free != 0) return group * GROUP_SIZE + __builtin_ctz(free);
+        group = (group + step) & mask;
+    }
+}
+
+//the slot holding key or, when it is missing, the one it goes in, found in a single pass
+static int findSlot(LoxEntry* entries, int capacity, LoxObjString* key, bool* found) {
+    uint8_t* control = controlBytes(entries, capacity);
+    int mask = groupMask(capacity);
+    uint32_t lanes = groupLanes(capacity);
+    uint8_t tag = hashTag(key->hash);
+    int freeSlot = -1;
+
+    int group = (key->hash >> 7) & mask;
+    for (int step = 1; ; step++) {
+        uint8_t* bytes = control + group * GROUP_SIZE;
+        uint32_t match = groupMatch(bytes, tag);
+        while (match != 0) {
+            int index = group * GROUP_SIZE + __builtin_ctz(match);
+            if (entries[index].key == key) {
+                *found = true;
+                return index;
+            }
+            match &= match - 1;
+        }
+        uint32_t free = groupFree(bytes) & lanes;
+        if (freeSlot < 0 && free != 0) freeSlot = group * GROUP_SIZE + __builtin_ctz(free);
+        if (groupMatch(bytes, CTRL_EMPTY)) {
+            *found = false;
+            return freeSlot;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+bool tableGet(LoxTable* table, LoxObjString* key, LoxValue* value) {
+    if (table->count == 0) return false;
+
+    int index = findIndex(table->entries, table->capacity, key);
+    if (index < 0) return false;
+
+    *value = table->entries[index].value;
+    return true;
+}
+
+static void adjustCapacity(LoxVM* vm, LoxTable* table, int capacity) {
+    //only slots with a full control byte are ever read, the entries themselves need no clearing
+    LoxEntry* entries = (LoxEntry*)ALLOCATE(vm, uint8_t, tableBytes(capacity));
+    uint8_t* control = controlBytes(entries, capacity);
+    memset(control, CTRL_EMPTY, controlSize(capacity));
+
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (!isFull(table, i)) continue;
+        LoxEntry* entry = &table->entries[i];
+
+        int index = findFree(entries, capacity, entry->key->hash);
+        control[index] = hashTag(entry->key->hash);
+        entries[index] = *entry;
+        table->count++;
+    }
+
+    if (table->entries != NULL) {
+        FreeArr(vm, uint8_t, table->entries, tableBytes(table->capacity));
+    }
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+static int countFull(LoxTable* table) {
+    int full = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (isFull(table, i)) full++;
+    }
+    return full;
+}
+
+//rehash without a new allocation to get rid of the DELETED slots, every full slot is first turned
+//into a DELETED one that still has to be placed and the DELETED ones into EMPTY, then each entry
+//is moved to the first free slot on its probe path, swapping with one still to be placed
+static void rehashInPlace(LoxTable* table) {
+    uint8_t* control = controlBytes(table->entries, table->capacity);
+    for (int i = 0; i < table->capacity; i++) {
+        control[i] = control[i] < CTRL_EMPTY ? CTRL_DELETED : CTRL_EMPTY;
+    }
+
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (control[i] != CTRL_DELETED) continue;
+        LoxEntry* entry = &table->entries[i];
+        uint8_t tag = hashTag(entry->key->hash);
+
+        //slots before the target on the probe path are all placed and stay full, so an
+        //entry already in the target's group is found where it is
+        int target = findFree(table->entries, table->capacity, entry->key->hash);
+        if (target / GROUP_SIZE == i / GROUP_SIZE) {
+            control[i] = tag;
+        }
+        else if (control[target] == CTRL_EMPTY) {
+            table->entries[target] = *entry;
+            control[target] = tag;
+            control[i] = CTRL_EMPTY;
+        }
+        else {
+            LoxEntry swapped = table->entries[target];
+            table->entries[target] = *entry;
+            *entry = swapped;
+            control[target] = tag;
+            i--;
+            continue;
+        }
+        table->count++;
+    }
+}
+
+//count covers DELETED slots as well as full ones, so the table grows before it runs out of EMPTY ones,
+//unless DELETED slots make up most of it and a rehash in place frees enough room
+bool tableSet(LoxVM* vm, LoxTable* table, LoxObjString* key, LoxValue value){
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
+        if (countFull(table) + 1 <= table->capacity * TABLE_MAX_LOAD / 2) {
+            rehashInPlace(table);
+        }
+        else {
+            adjustCapacity(vm, table, GrowCap(table->capacity));
+        }
+    }
+
+    bool found;
+    int index = findSlot(table->entries, table->capacity, key, &found);
+    if (found) {
+        LoxEntry* entry = &table->entries[index];
+        deleteBarrier(vm, entry->value);
+        entry->value = value;
+        return false;
+    }
+
+    uint8_t* control = controlBytes(table->entries, table->capacity);
+    if (control[index] == CTRL_EMPTY) table->count++;
+    control[index] = hashTag(key->hash);
+    table->entries[index].key = key;
+    table->entries[index].value = value;
+    return true;
+}
+
+bool tableDelete(LoxVM* vm, LoxTable* table, LoxObjString* key){
+    if (table->count == 0) return false;
+
+    int index = findIndex(table->entries, table->capacity, key);
+    if (index < 0) return false;
+
+    LoxEntry* entry = &table->entries[index];
+    deleteBarrier(vm, OBJ_VAL(entry->key));
+    deleteBarrier(vm, entry->value);
+    //no probe ever went past a group that still has an EMPTY slot, so the slot can be EMPTY as well
+    uint8_t* group = controlBytes(table->entries, table->capacity) + index / GROUP_SIZE * GROUP_SIZE;
+    if (groupMatch(group, CTRL_EMPTY)) {
+        group[index % GROUP_SIZE] = CTRL_EMPTY;
+        table->count--;
+    }
+    else {
+        group[index % GROUP_SIZE] = CTRL_DELETED;
+    }
+    return true;
+}
+
+//make room for count entries up front, so adding them never grows the table
+void tableReserve(LoxVM* vm, LoxTable* table, int count) {
+    int capacity = TABLE_MIN_CAPACITY;
+    while (count > capacity * TABLE_MAX_LOAD) capacity *= 2;
+    if (capacity > table->capacity) adjustCapacity(vm, table, capacity);
+}
+
+void tableAddAll(LoxVM* vm, LoxTable* src, LoxTable* dest){
+    for (int i = 0; i < src->capacity; i++) {
+        if (isFull(src, i)) {
+            LoxEntry* entry = &src->entries[i];
+            tableSet(vm, dest, entry->key, entry->value);
+        }
+    }
+}
+
+LoxObjString* tableFindString(LoxTable* table, const char* chars, int length, uint32_t hash){
+    if (table->count == 0) return NULL;
+
+    uint8_t* control = controlBytes(table->entries, table->capacity);
+    int mask = groupMask(table->capacity);
+    uint8_t tag = hashTag(hash);
+
+    int group = (hash >> 7) & mask;
+    for (int step = 1; ; step++) {
+        uint8_t* bytes = control + group * GROUP_SIZE;
+        uint32_t match = groupMatch(bytes, tag);
+        while (match != 0) {
+            LoxObjString* key = table->entries[group * GROUP_SIZE + __builtin_ctz(match)].key;
+            if (key->length == length && key->hash == hash &&
+                memcmp(key->chars, chars, length) == 0) {
+                return key;
+            }
+            match &= match - 1;
+        }
+        if (groupMatch(bytes, CTRL_EMPTY)) return NULL;
+        group = (group + step) & mask;
+    }
+}
+
+//drop the strings no longer marked, once the DELETED slots left behind outnumber the live entries
+//they are cleared out by a rehash in place, which lets tableShrink see the live count
+void tableRemoveWhite(LoxVM* vm, LoxTable* table) {
+    int live = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (!isFull(table, i)) continue;
+        LoxEntry* entry = &table->entries[i];
+        if (heapIsMarked(entry->key)) {
+            live++;
+        }
+        else {
+            tableDelete(vm, table, entry->key);
+        }
+    }
+    if (table->count - live > live) rehashInPlace(table);
+}
+
+//give back most of a table whose entries have dropped well below its capacity,
+//it is left no more than half as full as it may get so it does not grow again right away
+void tableShrink(LoxVM* vm, LoxTable* table) {
+    if (table->capacity <= TABLE_MIN_CAPACITY ||
+        table->count >= table->capacity * TABLE_MAX_LOAD / 4) {
+        return;
+    }
+
+    int capacity = table->capacity;
+    while (capacity / 2 >= TABLE_MIN_CAPACITY && table->count <= capacity / 2 * TABLE_MAX_LOAD / 2) {
+        capacity /= 2;
+    }
+    if (table->count == 0) {
+        freeTable(vm, table);
+    }
+    else {
+        adjustCapacity(vm, table, capacity);
+    }
+}
+
+void markTable(LoxVM* vm, LoxTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        if (!isFull(table, i)) continue;
+        LoxEntry* entry = &table->entries[i];
+        markObject(vm, (LoxObject*)entry->key);
+        markValue(vm, entry->value);
+    }
+}
+
+//point the entries at the new copies of objects a compaction moved, a moved
+//string keeps its hash so every entry stays in its slot
+void forwardTable(LoxTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        if (!isFull(table, i)) continue;
+        LoxEntry* entry = &table->entries[i];
+        entry->key = (LoxObjString*)forwardObject((LoxObject*)entry->key);
+        entry->value = forwardValue(entry->value);
+    }
+}
+
+void initFrozenTable(LoxFrozenTable* frozen) {
+    frozen->seed = 0;
+    frozen->shift = 0;
+    frozen->capacity = 0;
+    frozen->entries = NULL;
+}
+
+static int frozenIndex(uint32_t seed, int shift, uint32_t hash) {
+    return (uint32_t)(hash * seed) >> shift;
+}
+
+//look for a multiplier that sends every key to a slot of its own, starting at twice as many
+//slots as keys and doubling up to eight times as many, false if there is none, which is
+//certain when two keys share the same hash, and the table is then left unfrozen
+bool freezeTable(LoxVM* vm, LoxTable* table, LoxFrozenTable* frozen) {
+    int count = countFull(table);
+    if (count == 0 || count > FROZEN_MAX_ENTRIES) return false;
+
+    LoxEntry* keys[FROZEN_MAX_ENTRIES];
+    int keyCount = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (isFull(table, i)) keys[keyCount++] = &table->entries[i];
+    }
+
+    int bits = 1;
+    while ((1 << bits) < count * 2) bits++;
+    for (; (1 << bits) <= count * 8; bits++) {
+        int capacity = 1 << bits;
+        int shift = 32 - bits;
+        uint32_t seed = 0x9e3779b9u;
+        for (int attempt = 0; attempt < FROZEN_SEED_TRIES; attempt++) {
+            seed = (seed * 0x2c1b3c6du + 0x297a2d39u) | 1;
+
+            uint64_t used[FROZEN_MAX_ENTRIES * 8 / 64] = {0};
+            bool perfect = true;
+            for (int i = 0; i < keyCount && perfect; i++) {
+                int index = frozenIndex(seed, shift, keys[i]->key->hash);
+                if (used[index / 64] & ((uint64_t)1 << (index % 64))) perfect = false;
+                used[index / 64] |= (uint64_t)1 << (index % 64);
+            }
+            if (!perfect) continue;
+
+            //keys holds pointers into the table, which the allocation does not move
+            LoxEntry* entries = ALLOCATE(vm, LoxEntry, capacity);
+            for (int i = 0; i < capacity; i++) {
+                entries[i].key = NULL;
+                entries[i].value = NIL_VAL;
+            }
+            for (int i = 0; i < keyCount; i++) {
+                entries[frozenIndex(seed, shift, keys[i]->key->hash)] = *keys[i];
+            }
+            frozen->entries = entries;
+            frozen->seed = seed;
+            frozen->shift = shift;
+            frozen->capacity = capacity;
+            return true;
+        }
+    }
+    return false;
+}
+
+void freeFrozenTable(LoxVM* vm, LoxFrozenTable* frozen) {
+    FreeArr(vm, LoxEntry, frozen->entries, frozen->capacity);
+    initFrozenTable(frozen);
+}
+
+//the entries are copies of the ones in the general table, which keep them alive,
+//so they are only ever forwarded and never marked
+void forwardFrozenTable(LoxFrozenTable* frozen) {
+    for (int i = 0; i < frozen->capacity; i++) {
+        LoxEntry* entry = &frozen->entries[i];
+        entry->key = (LoxObjString*)forwardObject((LoxObject*)entry->key);
+        entry->value = forwardValue(entry->value);
+    }
+}
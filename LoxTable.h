@@ -1,29 +1,51 @@
-#ifndef lox_LoxTable_h
-#define lox_LoxTable_h
-
-#include "common.h"
-#include "LoxValue.h"
-#include "LoxObject.h"
-
-typedef struct {
-    LoxObjString* key;
-    LoxValue value;
-} LoxEntry;
-
-typedef struct {
-    int count;
-    int capacity;
-    LoxEntry* entries;
-} LoxTable;
-
-void initTable(LoxTable* table);
-void freeTable(LoxTable* table);
-bool tableGet(LoxTable* table, LoxObjString* key, LoxValue* value);
-bool tableSet(LoxTable* table, LoxObjString* key, LoxValue value);
-bool tableDelete(LoxTable* table, LoxObjString* key);
-void tableAddAll(LoxTable* from, LoxTable* to);
-LoxObjString* tableFindString(LoxTable* table, const char* chars, int length, uint32_t hash);
-void tableRemoveWhite(LoxTable* table);
-void markTable(LoxTable* table);
-
+#ifndef lox_LoxTable_h
+#define lox_LoxTable_h
+
+#include "common.h"
+#include "LoxValue.h"
+#include "LoxObject.h"
+
+typedef struct {
+    LoxObjString* key;
+    LoxValue value;
+} LoxEntry;
+
+//entries is a single allocation, capacity entries followed by their control bytes
+typedef struct {
+    int count;
+    int capacity;
+    LoxEntry* entries;
+} LoxTable;
+
+//a read-only copy of a table whose keys no longer change, each entry sits in the slot
+//a perfect hash of its key's hash picks, so a lookup is a multiply, a shift and one compare
+typedef struct {
+    uint32_t seed;
+    int shift;
+    int capacity;
+    LoxEntry* entries;
+} LoxFrozenTable;
+
+void initTable(LoxTable* table);
+void freeTable(LoxVM* vm, LoxTable* table);
+bool tableGet(LoxTable* table, LoxObjString* key, LoxValue* value);
+bool tableSet(LoxVM* vm, LoxTable* table, LoxObjString* key, LoxValue value);
+bool tableDelete(LoxVM* vm, LoxTable* table, LoxObjString* key);
+void tableAddAll(LoxVM* vm, LoxTable* from, LoxTable* to);
+void tableReserve(LoxVM* vm, LoxTable* table, int count);
+LoxObjString* tableFindString(LoxTable* table, const char* chars, int length, uint32_t hash);
+void tableRemoveWhite(LoxVM* vm, LoxTable* table);
+void tableShrink(LoxVM* vm, LoxTable* table);
+void markTable(LoxVM* vm, LoxTable* table);
+void forwardTable(LoxTable* table);
+void initFrozenTable(LoxFrozenTable* frozen);
+bool freezeTable(LoxVM* vm, LoxTable* table, LoxFrozenTable* frozen);
+void freeFrozenTable(LoxVM* vm, LoxFrozenTable* frozen);
+void forwardFrozenTable(LoxFrozenTable* frozen);
+
+//the only slot a key with this hash can be in, it holds the key if the table has it at all
+static inline LoxEntry* frozenTableSlot(LoxFrozenTable* frozen, uint32_t hash) {
+    return &frozen->entries[(uint32_t)(hash * frozen->seed) >> frozen->shift];
+}
+
 #endif
\ No newline at end of file
@@ -1,555 +1,1453 @@
-#include <stdarg.h>
-#include <stdio.h>
-#include <string.h>
-#include <time.h>
-#include "common.h"
-#include "LoxCompiler.h"
-#include "LoxDebugger.h"
-#include "LoxObject.h"
-#include "memory.h"
-#include "LoxVM.h"
-
-LoxVM vm; 
-
-static LoxValue clockNative(int argCount, LoxValue* args) {
-  return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
-}
-
-static void resetStack() {
-  vm.stackTop = vm.stack;
-  vm.frameCount = 0;
-  vm.openUpvalues = NULL;
-}
-
-static void runtimeError(const char* format, ...) {
-  va_list args;
-  va_start(args, format);
-  vfprintf(stderr, format, args);
-  va_end(args);
-  fputs("\n", stderr);
-
-  for (int i = vm.frameCount - 1; i >= 0; i--) {
-    LoxCallFrame* frame = &vm.frames[i];
-    LoxObjFunction* function = frame->closure->function;
-    size_t instruction = frame->ip - function->chunk.code - 1;
-    fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
-    if (function->name == NULL) {
-      fprintf(stderr, "script\n");
-    } else {
-      fprintf(stderr, "%s()\n", function->name->chars);
-    }
-  }
-
-  resetStack();
-}
-
-static void defineNative(const char* name, LoxNativeFunc function) {
-  push(OBJ_VAL(copyString(name, (int)strlen(name))));
-  push(OBJ_VAL(newNative(function)));
-  tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-  pop();
-  pop();
-}
-
-void initLoxVM() {
-  resetStack();
-  vm.objects = NULL;
-  vm.bytesAllocated = 0;
-  vm.nextGC = 1024 * 1024;
-
-  vm.grayCount = 0;
-  vm.grayCapacity = 0;
-  vm.grayStack = NULL;
-
-  initTable(&vm.globals);
-  initTable(&vm.strings);
-
-  vm.initString = NULL;
-  vm.initString = copyString("init", 4);
-
-  defineNative("clock", clockNative);
-}
-
-void freeLoxVM() {
-  freeTable(&vm.globals);
-  freeTable(&vm.strings);
-  vm.initString = NULL;
-  freeObjects();
-}
-
-void push(LoxValue value) {
-  *vm.stackTop = value;
-  vm.stackTop++;
-}
-
-LoxValue pop() {
-  vm.stackTop--;
-  return *vm.stackTop;
-}
-
-static LoxValue peek(int distance) {
-  return vm.stackTop[-1 - distance];
-}
-
-static bool call(LoxObjClosure* closure, int argCount) {
-  if (argCount != closure->function->arity) {
-    runtimeError("Expected %d arguments but got %d.",
-        closure->function->arity, argCount);
-    return false;
-  }
-
-  if (vm.frameCount == FRAMES_MAX) {
-    runtimeError("Stack overflow.");
-    return false;
-  }
-
-  LoxCallFrame* frame = &vm.frames[vm.frameCount++];
-
-  frame->closure = closure;
-  frame->ip = closure->function->chunk.code;
-  frame->slots = vm.stackTop - argCount - 1;
-  return true;
-}
-
-static bool callValue(LoxValue callee, int argCount) {
-  if (IS_OBJ(callee)) {
-    switch (OBJ_TYPE(callee)) {
-      case OBJ_BOUND_METHOD: {
-        LoxObjBoundMethod* bound = AS_BOUND_METHOD(callee);
-        vm.stackTop[-argCount - 1] = bound->receiver;
-        return call(bound->method, argCount);
-      }
-      case OBJ_CLASS: {
-        LoxObjClass* klass = AS_CLASS(callee);
-        vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));
-        LoxValue initializer;
-        if (tableGet(&klass->methods, vm.initString,
-                     &initializer)) {
-          return call(AS_CLOSURE(initializer), argCount);
-        } 
-        else if (argCount != 0) {
-          runtimeError("Expected 0 arguments but got %d.", argCount);
-          return false;
-        }
-        return true;
-      }
-
-      case OBJ_CLOSURE:
-        return call(AS_CLOSURE(callee), argCount);
-      case OBJ_NATIVE: {
-        LoxNativeFunc native = AS_NATIVE(callee);
-        LoxValue result = native(argCount, vm.stackTop - argCount);
-        vm.stackTop -= argCount + 1;
-        push(result);
-        return true;
-      }
-      default:
-        break; 
-    }
-  }
-  runtimeError("Can only call functions and classes.");
-  return false;
-}
-
-static bool invokeFromClass(LoxObjClass* klass, LoxObjString* name, int argCount) {
-  LoxValue method;
-  if (!tableGet(&klass->methods, name, &method)) {
-    runtimeError("Undefined property '%s'.", name->chars);
-    return false;
-  }
-  return call(AS_CLOSURE(method), argCount);
-}
-
-static bool invoke(LoxObjString* name, int argCount) {
-  LoxValue receiver = peek(argCount);
-
-  if (!IS_INSTANCE(receiver)) {
-    runtimeError("Only instances have methods.");
-    return false;
-  }
-
-  LoxObjInstance* instance = AS_INSTANCE(receiver);
-
-  LoxValue value;
-  if (tableGet(&instance->fields, name, &value)) {
-    vm.stackTop[-argCount - 1] = value;
-    return callValue(value, argCount);
-  }
-
-  return invokeFromClass(instance->klass, name, argCount);
-}
-
-static bool bindMethod(LoxObjClass* klass, LoxObjString* name) {
-  LoxValue method;
-  if (!tableGet(&klass->methods, name, &method)) {
-    runtimeError("Undefined property '%s'.", name->chars);
-    return false;
-  }
-
-  LoxObjBoundMethod* bound = newBoundMethod(peek(0),AS_CLOSURE(method));
-  pop();
-  push(OBJ_VAL(bound));
-  return true;
-}
-
-static LoxObjUpvalue* captureUpvalue(LoxValue* local) {
-  LoxObjUpvalue* prevUpvalue = NULL;
-  LoxObjUpvalue* upvalue = vm.openUpvalues;
-  while (upvalue != NULL && upvalue->location > local) {
-    prevUpvalue = upvalue;
-    upvalue = upvalue->next;
-  }
-
-  if (upvalue != NULL && upvalue->location == local) {
-    return upvalue;
-  }
-
-  LoxObjUpvalue* createdUpvalue = newUpvalue(local);
-  createdUpvalue->next = upvalue;
-
-  if (prevUpvalue == NULL) {
-    vm.openUpvalues = createdUpvalue;
-  } else {
-    prevUpvalue->next = createdUpvalue;
-  }
-
-  return createdUpvalue;
-}
-
-static void closeUpvalues(LoxValue* last) {
-  while (vm.openUpvalues != NULL &&
-         vm.openUpvalues->location >= last) {
-    LoxObjUpvalue* upvalue = vm.openUpvalues;
-    upvalue->closed = *upvalue->location;
-    upvalue->location = &upvalue->closed;
-    vm.openUpvalues = upvalue->next;
-  }
-}
-
-static void defineMethod(LoxObjString* name) {
-  LoxValue method = peek(0);
-  LoxObjClass* klass = AS_CLASS(peek(1));
-  tableSet(&klass->methods, name, method);
-  pop();
-}
-
-static bool isFalsey(LoxValue value) {
-  return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
-}
-
-static void concatenate() {
-  LoxObjString* b = AS_STRING(peek(0));
-  LoxObjString* a = AS_STRING(peek(1));
-
-  int length = a->length + b->length;
-  char* chars = ALLOCATE(char, length + 1);
-  memcpy(chars, a->chars, a->length);
-  memcpy(chars + a->length, b->chars, b->length);
-  chars[length] = '\0';
-
-  LoxObjString* result = takeString(chars, length);
-  pop();
-  pop();
-  push(OBJ_VAL(result));
-}
-
-static InterpreterResult run() {
-  LoxCallFrame* frame = &vm.frames[vm.frameCount - 1];
-
-#define READ_BYTE() (*frame->ip++)
-#define READ_SHORT() \
-    (frame->ip += 2, \
-    (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-
-#define READ_CONSTANT() \
-    (frame->closure->function->chunk.constants.values[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
-#define BINARY_OP(valueType, op) \
-    do { \
-      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
-        runtimeError("Operands must be numbers."); \
-        return INTERPRET_RUNTIME_ERROR; \
-      } \
-      double b = AS_NUMBER(pop()); \
-      double a = AS_NUMBER(pop()); \
-      push(valueType(a op b)); \
-    } while (false)
-
-  for (;;) {
-#ifdef DEBUG_TRACE_EXECUTION
-    printf("          ");
-    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-      printf("[ ");
-      printValue(*slot);
-      printf(" ]");
-    }
-    printf("\n");
-    disassembleInstruction(&frame->closure->function->chunk,
-        (int)(frame->ip - frame->closure->function->chunk.code));
-#endif
-
-    uint8_t instruction;
-    switch (instruction = READ_BYTE()) {
-      case OP_CONSTANT: {
-        LoxValue constant = READ_CONSTANT();
-        push(constant);
-        break;
-      }
-      case OP_NIL: push(NIL_VAL); break;
-      case OP_TRUE: push(BOOL_VAL(true)); break;
-      case OP_FALSE: push(BOOL_VAL(false)); break;
-      case OP_POP: pop(); break;
-      case OP_GET_LOCAL: {
-        uint8_t slot = READ_BYTE();
-        push(frame->slots[slot]);
-        break;
-      }
-      case OP_SET_LOCAL: {
-        uint8_t slot = READ_BYTE();
-        frame->slots[slot] = peek(0);
-        break;
-      }
-      case OP_GET_GLOBAL: {
-        LoxObjString* name = READ_STRING();
-        LoxValue value;
-        if (!tableGet(&vm.globals, name, &value)) {
-          runtimeError("Undefined variable '%s'.", name->chars);
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        push(value);
-        break;
-      }
-      case OP_DEFINE_GLOBAL: {
-        LoxObjString* name = READ_STRING();
-        tableSet(&vm.globals, name, peek(0));
-        pop();
-        break;
-      }
-      case OP_SET_GLOBAL: {
-        LoxObjString* name = READ_STRING();
-        if (tableSet(&vm.globals, name, peek(0))) {
-          tableDelete(&vm.globals, name); // [delete]
-          runtimeError("Undefined variable '%s'.", name->chars);
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        break;
-      }
-      case OP_GET_UPVALUE: {
-        uint8_t slot = READ_BYTE();
-        push(*frame->closure->upvalues[slot]->location);
-        break;
-      }
-      case OP_SET_UPVALUE: {
-        uint8_t slot = READ_BYTE();
-        *frame->closure->upvalues[slot]->location = peek(0);
-        break;
-      }
-      case OP_GET_PROPERTY: {
-        if (!IS_INSTANCE(peek(0))) {
-          runtimeError("Only instances have properties.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-
-        LoxObjInstance* instance = AS_INSTANCE(peek(0));
-        LoxObjString* name = READ_STRING();
-        
-        LoxValue value;
-        if (tableGet(&instance->fields, name, &value)) {
-          pop();
-          push(value);
-          break;
-        }
-        if (!bindMethod(instance->klass, name)) {
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        break;
-      }
-      case OP_SET_PROPERTY: {
-        if (!IS_INSTANCE(peek(1))) {
-          runtimeError("Only instances have fields.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-
-        LoxObjInstance* instance = AS_INSTANCE(peek(1));
-        tableSet(&instance->fields, READ_STRING(), peek(0));
-        LoxValue value = pop();
-        pop();
-        push(value);
-        break;
-      }
-      case OP_GET_SUPER: {
-        LoxObjString* name = READ_STRING();
-        LoxObjClass* superclass = AS_CLASS(pop());
-        
-        if (!bindMethod(superclass, name)) {
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        break;
-      }
-      case OP_EQUAL: {
-        LoxValue b = pop();
-        LoxValue a = pop();
-        push(BOOL_VAL(valuesEqual(a, b)));
-        break;
-      }
-      case OP_GREATER:  BINARY_OP(BOOL_VAL, >); break;
-      case OP_LESS:     BINARY_OP(BOOL_VAL, <); break;
-      case OP_ADD: {
-        if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-          concatenate();
-        } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-          double b = AS_NUMBER(pop());
-          double a = AS_NUMBER(pop());
-          push(NUMBER_VAL(a + b));
-        } else {
-          runtimeError(
-              "Operands must be two numbers or two strings.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        break;
-      }
-      case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-      case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
-      case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
-      case OP_NOT:
-        push(BOOL_VAL(isFalsey(pop())));
-        break;
-      case OP_NEGATE:
-        if (!IS_NUMBER(peek(0))) {
-          runtimeError("Operand must be a number.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        push(NUMBER_VAL(-AS_NUMBER(pop())));
-        break;
-      case OP_PRINT: {
-        printLoxValue(pop());
-        printf("\n");
-        break;
-      }
-      case OP_JUMP: {
-        uint16_t offset = READ_SHORT();
-        frame->ip += offset;
-        break;
-}
-      case OP_JUMP_IF_FALSE: {
-        uint16_t offset = READ_SHORT();
-        if (isFalsey(peek(0))) frame->ip += offset;
-        break;
-}
-      case OP_LOOP: {
-        uint16_t offset = READ_SHORT();
-        frame->ip -= offset;
-        break;
-      }
-      case OP_CALL: {
-        int argCount = READ_BYTE();
-        if (!callValue(peek(argCount), argCount)) {
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_INVOKE: {
-        LoxObjString* method = READ_STRING();
-        int argCount = READ_BYTE();
-        if (!invoke(method, argCount)) {
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_SUPER_INVOKE: {
-        LoxObjString* method = READ_STRING();
-        int argCount = READ_BYTE();
-        LoxObjClass* superclass = AS_CLASS(pop());
-        if (!invokeFromClass(superclass, method, argCount)) {
-          return INTERPRET_RUNTIME_ERROR;
-        }
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_CLOSURE: {
-        LoxObjFunction* function = AS_FUNCTION(READ_CONSTANT());
-        LoxObjClosure* closure = newClosure(function);
-        push(OBJ_VAL(closure));
-        for (int i = 0; i < closure->upvalueCount; i++) {
-          uint8_t isLocal = READ_BYTE();
-          uint8_t index = READ_BYTE();
-          if (isLocal) {
-            closure->upvalues[i] =
-                captureUpvalue(frame->slots + index);
-          } else {
-            closure->upvalues[i] = frame->closure->upvalues[index];
-          }
-        }
-        break;
-      }
-      case OP_CLOSE_UPVALUE:
-        closeUpvalues(vm.stackTop - 1);
-        pop();
-        break;
-      case OP_RETURN: {
-        LoxValue result = pop();
-        closeUpvalues(frame->slots);
-        vm.frameCount--;
-        if (vm.frameCount == 0) {
-          pop();
-          return INTERPRET_OK;
-        }
-
-        vm.stackTop = frame->slots;
-        push(result);
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_CLASS:
-        push(OBJ_VAL(newClass(READ_STRING())));
-        break;
-      case OP_INHERIT: {
-        LoxValue superclass = peek(1);
-        if (!IS_CLASS(superclass)) {
-          runtimeError("Superclass must be a class.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-
-        LoxObjClass* subclass = AS_CLASS(peek(0));
-        tableAddAll(&AS_CLASS(superclass)->methods,
-                    &subclass->methods);
-        pop(); 
-        break;
-      }
-      case OP_METHOD:
-        defineMethod(READ_STRING());
-        break;
-    }
-  }
-
-#undef READ_BYTE
-#undef READ_SHORT
-#undef READ_CONSTANT
-#undef READ_STRING
-#undef BINARY_OP
-}
-
-void hack(bool b) {
-  run();
-  if (b) hack(false);
-}
-
-InterpreterResult interpretCode(const char* source) {
-
-  LoxObjFunction* function = compileCode(source);
-  if (function == NULL) return INTERPRET_COMPILE_ERROR;
-
-  push(OBJ_VAL(function));
-  LoxObjClosure* closure = newClosure(function);
-  pop();
-  push(OBJ_VAL(closure));
-  call(closure, 0);
-
-  return run();
-}
-
-
-
-
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "LoxCompiler.h"
+#include "LoxDebugger.h"
+#include "LoxObject.h"
+#include "memory.h"
+#include "LoxVM.h"
+
+static LoxValue clockNative(LoxVM* vm, int argCount, LoxValue* args) {
+  return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+//objects can only move between instructions, so this just asks the interpreter to do it
+static LoxValue compactHeapNative(LoxVM* vm, int argCount, LoxValue* args) {
+  vm->gcCompactRequested = true;
+  return NIL_VAL;
+}
+
+//runs a full collection, the number of bytes it freed is returned
+static LoxValue gcNative(LoxVM* vm, int argCount, LoxValue* args) {
+  size_t before = vm->bytesAllocated + vm->largeBytesAllocated;
+  collectGarbage(vm);
+  finishSweep(vm);
+  size_t after = vm->bytesAllocated + vm->largeBytesAllocated;
+  return NUMBER_VAL(before > after ? (double)(before - after) : 0);
+}
+
+static void setStat(LoxVM* vm, LoxObjInstance* stats, const char* name, double value) {
+  LoxObjString* key = copyString(vm, name, (int)strlen(name));
+  push(vm, OBJ_VAL(key));
+  lockHeap(vm);
+  tableSet(vm, &stats->fields, key, NUMBER_VAL(value));
+  unlockHeap(vm);
+  writeBarrier(vm, (LoxObject*)stats, OBJ_VAL(key));
+  pop(vm);
+}
+
+//a snapshot of the collector's statistics as the fields of a GcStats instance
+static LoxValue gcStatsNative(LoxVM* vm, int argCount, LoxValue* args) {
+  LoxObjString* name = copyString(vm, "GcStats", 7);
+  push(vm, OBJ_VAL(name));
+  LoxObjClass* klass = newClass(vm, name);
+  push(vm, OBJ_VAL(klass));
+  LoxObjInstance* stats = newInstance(vm, klass);
+  push(vm, OBJ_VAL(stats));
+
+  //read once the allocations above are done, which may have run a collection
+  GcStats counts = vm->gcStats;
+  long pauses = 0;
+  for (int i = 0; i < GC_PAUSE_BUCKETS; i++) pauses += vm->gcPauseHistogram[i];
+
+  setStat(vm, stats, "collections", counts.collections);
+  setStat(vm, stats, "minorCollections", counts.minorCollections);
+  setStat(vm, stats, "compactions", counts.compactions);
+  setStat(vm, stats, "pauses", pauses);
+  setStat(vm, stats, "pauseTotalMs", vm->gcPauseTotal * 1000);
+  setStat(vm, stats, "pauseMaxMs", vm->gcPauseMax * 1000);
+  setStat(vm, stats, "heapBytes", vm->bytesAllocated + vm->largeBytesAllocated);
+  setStat(vm, stats, "totalAllocated", counts.totalAllocated);
+  setStat(vm, stats, "totalFreed", counts.totalFreed);
+  setStat(vm, stats, "objectsFreed", counts.objectsFreed);
+  setStat(vm, stats, "promoted", counts.promoted);
+  setStat(vm, stats, "promotionRate", gcPromotionRate(vm));
+  for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+    char name[32];
+    setStat(vm, stats, gcTypeNames[i], counts.liveObjects[i]);
+    snprintf(name, sizeof(name), "%sBytes", gcTypeNames[i]);
+    setStat(vm, stats, name, counts.liveBytes[i]);
+  }
+
+  LoxValue result = pop(vm);
+  pop(vm);
+  pop(vm);
+  return result;
+}
+
+//nothing writes barriers for stack slots, so a fiber switched in or out while a collection is
+//marking has its stack shaded, and one that ran since the last minor collection is remembered
+static void fiberBarrier(LoxVM* vm, LoxObjFiber* from, LoxObjFiber* to) {
+  if (vm->gcPhase == GC_PHASE_MARK) {
+    markFiber(vm, from);
+    markFiber(vm, to);
+  }
+  else if (vm->gcMode == GC_GENERATIONAL) {
+    rememberObject(vm, (LoxObject*)from);
+  }
+}
+
+//save the running fiber's stack, frames and open upvalues into it and load the next one's,
+//the concurrent marker only traces a fiber's stack while it is not the one running
+static void switchFiber(LoxVM* vm, LoxObjFiber* fiber) {
+  LoxObjFiber* from = vm->fiber;
+  lockHeap(vm);
+  from->stackTop = vm->stackTop;
+  from->frameCount = vm->frameCount;
+  from->openUpvalues = vm->openUpvalues;
+
+  vm->fiber = fiber;
+  vm->stack = fiber->stack;
+  vm->stackTop = fiber->stackTop;
+  vm->stackLimit = fiber->stack + fiber->stackCapacity - STACK_HEADROOM;
+  vm->frames = fiber->frames;
+  vm->frameCount = fiber->frameCount;
+  vm->openUpvalues = fiber->openUpvalues;
+  fiberBarrier(vm, from, fiber);
+  unlockHeap(vm);
+}
+
+//a runtime error ends the program, every fiber and callback it started is dropped and the
+//main fiber is left with an empty stack for the next script or REPL line
+static void resetStack(LoxVM* vm) {
+  clearEventLoop(&vm->loop);
+  for (int i = 0; i < vm->fiberQueueCount; i++) {
+    vm->fiberQueue[(vm->fiberQueueHead + i) % vm->fiberQueueCapacity]->queued = false;
+  }
+  vm->fiberQueueCount = 0;
+  //the fibers waiting in resume() on the one that failed are never resumed either
+  for (LoxObjFiber* fiber = vm->fiber; fiber != vm->mainFiber && fiber != NULL; fiber = fiber->resumer) {
+    fiber->state = FIBER_DONE;
+  }
+  if (vm->fiber != vm->mainFiber) switchFiber(vm, vm->mainFiber);
+
+  vm->stackTop = vm->stack;
+  vm->frameCount = 0;
+  vm->openUpvalues = NULL;
+}
+
+static void runtimeError(LoxVM* vm, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputs("\n", stderr);
+
+  for (int i = vm->frameCount - 1; i >= 0; i--) {
+    LoxCallFrame* frame = &vm->frames[i];
+    LoxObjFunction* function = frame->closure->function;
+    size_t instruction = frame->ip - function->chunk.code - 1;
+    fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
+    if (function->name == NULL) {
+      fprintf(stderr, "script\n");
+    } else {
+      fprintf(stderr, "%s()\n", function->name->chars);
+    }
+  }
+
+  resetStack(vm);
+}
+
+static bool call(LoxVM* vm, LoxObjClosure* closure, int argCount);
+
+static void scheduleFiber(LoxVM* vm, LoxObjFiber* fiber) {
+  if (vm->fiberQueueCount == vm->fiberQueueCapacity) {
+    int capacity = GrowCap(vm->fiberQueueCapacity);
+    LoxObjFiber** queue = (LoxObjFiber**)malloc(sizeof(LoxObjFiber*) * capacity);
+    if (queue == NULL) exit(1);
+
+    for (int i = 0; i < vm->fiberQueueCount; i++) {
+      queue[i] = vm->fiberQueue[(vm->fiberQueueHead + i) % vm->fiberQueueCapacity];
+    }
+    free(vm->fiberQueue);
+    vm->fiberQueue = queue;
+    vm->fiberQueueHead = 0;
+    vm->fiberQueueCapacity = capacity;
+  }
+
+  vm->fiberQueue[(vm->fiberQueueHead + vm->fiberQueueCount) % vm->fiberQueueCapacity] = fiber;
+  vm->fiberQueueCount++;
+  fiber->queued = true;
+}
+
+//a fiber waiting in sleep() that the event loop found due is queued again,
+//a callback is called by a new fiber of its own
+static void readyEvent(LoxVM* vm, LoxObject* target) {
+  if (target->type == OBJ_FIBER) {
+    scheduleFiber(vm, (LoxObjFiber*)target);
+    return;
+  }
+
+  LoxObjClosure* closure = (LoxObjClosure*)target;
+  push(vm, OBJ_VAL(closure));
+  LoxObjFiber* fiber = newFiber(vm, closure, closure->function->slotCount + STACK_HEADROOM);
+  pop(vm);
+  scheduleFiber(vm, fiber);
+}
+
+//the fiber at the front of the run queue, if it is empty the event loop is waited on until it
+//makes one ready, NULL once neither has anything left to run
+static LoxObjFiber* nextFiber(LoxVM* vm) {
+  LoxEventLoop* loop = &vm->loop;
+  for (;;) {
+    //fibers that keep yielding to each other still let the loop look for events once a round
+    if (eventLoopPending(loop) && (vm->fiberQueueCount == 0 || --loop->turnsUntilPoll < 0)) {
+      pollEvents(vm, loop, vm->fiberQueueCount == 0, readyEvent);
+      loop->turnsUntilPoll = vm->fiberQueueCount;
+    }
+
+    while (vm->fiberQueueCount > 0) {
+      LoxObjFiber* fiber = vm->fiberQueue[vm->fiberQueueHead];
+      vm->fiberQueueHead = (vm->fiberQueueHead + 1) % vm->fiberQueueCapacity;
+      vm->fiberQueueCount--;
+      //a fiber resumed directly while it was queued already left the queue then
+      if (fiber->queued) {
+        fiber->queued = false;
+        return fiber;
+      }
+    }
+    if (!eventLoopPending(loop)) return NULL;
+  }
+}
+
+//run fiber next, a new one calls its function, passing value if it takes a parameter, and a
+//suspended one gets value as the result of the yield() or resume() it is waiting in
+static void transferTo(LoxVM* vm, LoxObjFiber* fiber, LoxValue value) {
+  bool isNew = fiber->state == FIBER_NEW;
+  fiber->state = FIBER_RUNNING;
+  switchFiber(vm, fiber);
+  if (!isNew) {
+    push(vm, value);
+    return;
+  }
+
+  LoxObjClosure* closure = fiber->closure;
+  push(vm, OBJ_VAL(closure));
+  if (closure->function->arity == 1) push(vm, value);
+  //spawn() checked the arity and the first call cannot overflow the frames
+  call(vm, closure, closure->function->arity);
+}
+
+//a finished fiber's stack and frames are handed back at once, the fiber lives on while referenced
+static void releaseFiber(LoxVM* vm, LoxObjFiber* fiber) {
+  if (fiber == vm->mainFiber) return;
+
+  LoxValue* stack = fiber->stack;
+  int stackCapacity = fiber->stackCapacity;
+  LoxCallFrame* frames = fiber->frames;
+  int frameCapacity = fiber->frameCapacity;
+
+  lockHeap(vm);
+  if (fiber->resumer != NULL) deleteBarrier(vm, OBJ_VAL(fiber->resumer));
+  fiber->resumer = NULL;
+  fiber->stack = NULL;
+  fiber->stackTop = NULL;
+  fiber->stackCapacity = 0;
+  fiber->frames = NULL;
+  fiber->frameCount = 0;
+  fiber->frameCapacity = 0;
+  unlockHeap(vm);
+
+  FreeArr(vm, LoxValue, stack, stackCapacity);
+  FreeArr(vm, LoxCallFrame, frames, frameCapacity);
+}
+
+//the running fiber's function returned, the result goes to the fiber waiting in resume() for it
+//or else the scheduler runs the next one, false once there is nothing left to run
+static bool finishFiber(LoxVM* vm, LoxValue result) {
+  LoxObjFiber* fiber = vm->fiber;
+  LoxObjFiber* next = fiber->resumer;
+  fiber->state = FIBER_DONE;
+  if (next == NULL) {
+    next = nextFiber(vm);
+    result = NIL_VAL;
+  }
+
+  if (next == NULL) {
+    if (fiber == vm->mainFiber) return false;
+    //the main fiber finished before this one, it is where the program ends
+    switchFiber(vm, vm->mainFiber);
+    releaseFiber(vm, fiber);
+    return false;
+  }
+
+  transferTo(vm, next, result);
+  releaseFiber(vm, fiber);
+  return true;
+}
+
+//a new fiber that runs fn once the running ones yield or finish, fn can take a parameter
+//for the value the fiber is first resumed with
+static LoxValue spawnNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 1 || !IS_CLOSURE(args[0]) || AS_CLOSURE(args[0])->function->arity > 1) {
+    runtimeError(vm, "spawn() takes a function with at most one parameter.");
+    return NIL_VAL;
+  }
+
+  LoxObjClosure* closure = AS_CLOSURE(args[0]);
+  LoxObjFiber* fiber = newFiber(vm, closure, closure->function->slotCount + STACK_HEADROOM);
+  scheduleFiber(vm, fiber);
+  return OBJ_VAL(fiber);
+}
+
+//hands the value to the fiber waiting in resume() for this one, a fiber the scheduler started
+//goes to the back of the run queue instead and yield() returns once its turn comes again
+static LoxValue yieldNative(LoxVM* vm, int argCount, LoxValue* args) {
+  LoxValue value = argCount > 0 ? args[0] : NIL_VAL;
+  LoxObjFiber* fiber = vm->fiber;
+  LoxObjFiber* next = fiber->resumer;
+  if (next != NULL) {
+    lockHeap(vm);
+    deleteBarrier(vm, OBJ_VAL(next));
+    fiber->resumer = NULL;
+    unlockHeap(vm);
+  } else {
+    scheduleFiber(vm, fiber);
+    next = nextFiber(vm);
+    //nothing else is ready to run
+    if (next == fiber) return NIL_VAL;
+    value = NIL_VAL;
+  }
+
+  vm->stackTop -= argCount + 1;
+  fiber->state = FIBER_SUSPENDED;
+  transferTo(vm, next, value);
+  return NIL_VAL;
+}
+
+//runs the fiber until it yields or returns, what it yields or returns is the result
+static LoxValue resumeNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount < 1 || argCount > 2 || !IS_FIBER(args[0])) {
+    runtimeError(vm, "resume() takes a fiber and an optional value.");
+    return NIL_VAL;
+  }
+
+  LoxObjFiber* fiber = AS_FIBER(args[0]);
+  if (fiber->state == FIBER_RUNNING) {
+    runtimeError(vm, "Fiber is already running.");
+    return NIL_VAL;
+  }
+  if (fiber->state == FIBER_DONE) {
+    runtimeError(vm, "Cannot resume a finished fiber.");
+    return NIL_VAL;
+  }
+  if (fiber->state == FIBER_WAITING) {
+    runtimeError(vm, "Cannot resume a sleeping fiber.");
+    return NIL_VAL;
+  }
+
+  LoxValue value = argCount > 1 ? args[1] : NIL_VAL;
+  fiber->queued = false;
+  lockHeap(vm);
+  fiber->resumer = vm->fiber;
+  unlockHeap(vm);
+  writeBarrier(vm, (LoxObject*)fiber, OBJ_VAL(vm->fiber));
+
+  vm->stackTop -= argCount + 1;
+  transferTo(vm, fiber, value);
+  return NIL_VAL;
+}
+
+//parks the running fiber for ms milliseconds, other fibers and the event loop's callbacks
+//run meanwhile
+static LoxValue sleepNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 1 || !IS_NUMBER(args[0])) {
+    runtimeError(vm, "sleep() takes a number of milliseconds.");
+    return NIL_VAL;
+  }
+
+  LoxObjFiber* fiber = vm->fiber;
+  addTimer(&vm->loop, AS_NUMBER(args[0]), (LoxObject*)fiber);
+  fiber->state = FIBER_WAITING;
+  LoxObjFiber* next = nextFiber(vm);
+  //nothing else ran before the timer was due
+  if (next == fiber) {
+    fiber->state = FIBER_RUNNING;
+    return NIL_VAL;
+  }
+
+  vm->stackTop -= argCount + 1;
+  transferTo(vm, next, NIL_VAL);
+  return NIL_VAL;
+}
+
+//the event loop calls its callbacks with no arguments, each from a fiber of its own
+static bool isCallback(LoxValue value) {
+  return IS_CLOSURE(value) && AS_CLOSURE(value)->function->arity == 0;
+}
+
+//calls fn once ms milliseconds have passed
+static LoxValue setTimerNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 2 || !IS_NUMBER(args[0]) || !isCallback(args[1])) {
+    runtimeError(vm, "setTimer() takes a number of milliseconds and a function with no parameters.");
+    return NIL_VAL;
+  }
+
+  addTimer(&vm->loop, AS_NUMBER(args[0]), AS_OBJ(args[1]));
+  return NIL_VAL;
+}
+
+//calls fn once the fd can be read from or written to without blocking, then forgets it
+static LoxValue watchNative(LoxVM* vm, int argCount, LoxValue* args, bool writable, const char* name) {
+  if (argCount != 2 || !IS_NUMBER(args[0]) || !isCallback(args[1])) {
+    runtimeError(vm, "%s() takes a file descriptor and a function with no parameters.", name);
+    return NIL_VAL;
+  }
+
+  int fd = (int)AS_NUMBER(args[0]);
+  if (!watchFd(&vm->loop, fd, writable, AS_OBJ(args[1]))) {
+    runtimeError(vm, "Cannot watch file descriptor %d: %s.", fd, strerror(errno));
+  }
+  return NIL_VAL;
+}
+
+static LoxValue onReadableNative(LoxVM* vm, int argCount, LoxValue* args) {
+  return watchNative(vm, argCount, args, false, "onReadable");
+}
+
+static LoxValue onWritableNative(LoxVM* vm, int argCount, LoxValue* args) {
+  return watchNative(vm, argCount, args, true, "onWritable");
+}
+
+//the two fds as the fields of an instance of a class named className
+static LoxValue fdPair(LoxVM* vm, const char* className, const char* first, const char* second, int fds[2]) {
+  LoxObjString* name = copyString(vm, className, (int)strlen(className));
+  push(vm, OBJ_VAL(name));
+  LoxObjClass* klass = newClass(vm, name);
+  push(vm, OBJ_VAL(klass));
+  LoxObjInstance* pair = newInstance(vm, klass);
+  push(vm, OBJ_VAL(pair));
+
+  setStat(vm, pair, first, fds[0]);
+  setStat(vm, pair, second, fds[1]);
+
+  LoxValue result = pop(vm);
+  pop(vm);
+  pop(vm);
+  return result;
+}
+
+static LoxValue pipeNative(LoxVM* vm, int argCount, LoxValue* args) {
+  int fds[2];
+  if (!openPipe(fds)) {
+    runtimeError(vm, "Cannot create pipe: %s.", strerror(errno));
+    return NIL_VAL;
+  }
+  return fdPair(vm, "Pipe", "read", "write", fds);
+}
+
+static LoxValue socketPairNative(LoxVM* vm, int argCount, LoxValue* args) {
+  int fds[2];
+  if (!openSocketPair(fds)) {
+    runtimeError(vm, "Cannot create socket pair: %s.", strerror(errno));
+    return NIL_VAL;
+  }
+  return fdPair(vm, "SocketPair", "first", "second", fds);
+}
+
+static LoxValue openFileNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 2 || !IS_STRING(args[0]) || !IS_STRING(args[1])) {
+    runtimeError(vm, "openFile() takes a path and a mode.");
+    return NIL_VAL;
+  }
+
+  int fd = openFile(AS_CSTRING(args[0]), AS_CSTRING(args[1]));
+  if (fd < 0) {
+    runtimeError(vm, "Cannot open '%s': %s.", AS_CSTRING(args[0]), strerror(errno));
+    return NIL_VAL;
+  }
+  return NUMBER_VAL(fd);
+}
+
+//what could be read at once, "" if nothing is there yet and nil at the end of the file
+static LoxValue readFdNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 1 || !IS_NUMBER(args[0])) {
+    runtimeError(vm, "readFd() takes a file descriptor.");
+    return NIL_VAL;
+  }
+
+  char buffer[LOOP_READ_SIZE];
+  int count = readFd((int)AS_NUMBER(args[0]), buffer, LOOP_READ_SIZE);
+  if (count == 0) return NIL_VAL;
+  if (count < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      runtimeError(vm, "Cannot read file descriptor %d: %s.", (int)AS_NUMBER(args[0]), strerror(errno));
+      return NIL_VAL;
+    }
+    count = 0;
+  }
+  return OBJ_VAL(copyString(vm, buffer, count));
+}
+
+//how many bytes of the string were written, 0 if the fd cannot take any yet
+static LoxValue writeFdNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 2 || !IS_NUMBER(args[0]) || !IS_STRING(args[1])) {
+    runtimeError(vm, "writeFd() takes a file descriptor and a string.");
+    return NIL_VAL;
+  }
+
+  LoxObjString* string = AS_STRING(args[1]);
+  int count = writeFd((int)AS_NUMBER(args[0]), string->chars, string->length);
+  if (count < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      runtimeError(vm, "Cannot write file descriptor %d: %s.", (int)AS_NUMBER(args[0]), strerror(errno));
+      return NIL_VAL;
+    }
+    count = 0;
+  }
+  return NUMBER_VAL(count);
+}
+
+static LoxValue closeFdNative(LoxVM* vm, int argCount, LoxValue* args) {
+  if (argCount != 1 || !IS_NUMBER(args[0])) {
+    runtimeError(vm, "closeFd() takes a file descriptor.");
+    return NIL_VAL;
+  }
+
+  if (!closeFd(&vm->loop, (int)AS_NUMBER(args[0]))) {
+    runtimeError(vm, "Cannot close file descriptor %d: %s.", (int)AS_NUMBER(args[0]), strerror(errno));
+  }
+  return NIL_VAL;
+}
+
+static void defineNative(LoxVM* vm, const char* name, LoxNativeFunc function) {
+  push(vm, OBJ_VAL(copyString(vm, name, (int)strlen(name))));
+  push(vm, OBJ_VAL(newNative(vm, function)));
+  tableSet(vm, &vm->globals, AS_STRING(vm->stack[0]), vm->stack[1]);
+  pop(vm);
+  pop(vm);
+}
+
+void initLoxVM(LoxVM* vm) {
+  vm->fiber = NULL;
+  vm->mainFiber = NULL;
+  vm->frames = NULL;
+  vm->frameCount = 0;
+  vm->stack = NULL;
+  vm->stackTop = NULL;
+  vm->stackLimit = NULL;
+  vm->openUpvalues = NULL;
+  vm->fiberQueue = NULL;
+  vm->fiberQueueHead = 0;
+  vm->fiberQueueCount = 0;
+  vm->fiberQueueCapacity = 0;
+  initEventLoop(&vm->loop);
+  initHeap(&vm->heap);
+  vm->bytesAllocated = 0;
+  vm->nextGC = 1024 * 1024;
+  vm->largeBytesAllocated = 0;
+  vm->nextLargeGC = 16 * 1024 * 1024;
+  vm->bytesSinceGC = 0;
+  vm->gcMode = GC_GENERATIONAL;
+
+  vm->grayCount = 0;
+  vm->grayCapacity = 0;
+  vm->grayStack = NULL;
+
+  vm->rememberedCount = 0;
+  vm->rememberedCapacity = 0;
+  vm->remembered = NULL;
+
+  vm->gcPhase = GC_PHASE_IDLE;
+  vm->gcPool = NULL;
+  vm->gcMarker = NULL;
+  vm->gcConcurrentMark = false;
+  vm->heapLocks = 0;
+  vm->gcSuppressed = false;
+  vm->sweepPage = NULL;
+  vm->gcLazySweep = false;
+  vm->sweepCredit = 0;
+  vm->gcCompactThreshold = 0;
+  vm->gcCompactRequested = false;
+  vm->gcPauseMax = 0;
+  vm->gcPauseTotal = 0;
+  for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+    vm->gcPauseHistogram[i] = 0;
+  }
+  memset(&vm->gcStats, 0, sizeof(vm->gcStats));
+  vm->gcStatsPath = NULL;
+  configureGarbageCollector(vm);
+
+  initTable(&vm->globals);
+  initTable(&vm->strings);
+
+  vm->initString = NULL;
+  vm->selectorNames = NULL;
+  vm->selectorCount = 0;
+  vm->selectorCapacity = 0;
+  vm->mainFiber = newFiber(vm, NULL, STACK_HEADROOM);
+  vm->mainFiber->state = FIBER_RUNNING;
+  vm->fiber = vm->mainFiber;
+  vm->stack = vm->fiber->stack;
+  vm->stackTop = vm->stack;
+  vm->stackLimit = vm->stack;
+  vm->frames = vm->fiber->frames;
+  vm->initString = copyString(vm, "init", 4);
+
+  defineNative(vm, "clock", clockNative);
+  defineNative(vm, "compactHeap", compactHeapNative);
+  defineNative(vm, "gc", gcNative);
+  defineNative(vm, "gcStats", gcStatsNative);
+  defineNative(vm, "spawn", spawnNative);
+  defineNative(vm, "yield", yieldNative);
+  defineNative(vm, "resume", resumeNative);
+  defineNative(vm, "sleep", sleepNative);
+  defineNative(vm, "setTimer", setTimerNative);
+  defineNative(vm, "onReadable", onReadableNative);
+  defineNative(vm, "onWritable", onWritableNative);
+  defineNative(vm, "pipe", pipeNative);
+  defineNative(vm, "socketPair", socketPairNative);
+  defineNative(vm, "openFile", openFileNative);
+  defineNative(vm, "readFd", readFdNative);
+  defineNative(vm, "writeFd", writeFdNative);
+  defineNative(vm, "closeFd", closeFdNative);
+}
+
+void freeLoxVM(LoxVM* vm) {
+  if (vm->gcReportPauses) printGcPauses(vm);
+  if (vm->gcStatsPath != NULL) writeGcStats(vm, vm->gcStatsPath);
+
+  freeTable(vm, &vm->globals);
+  freeTable(vm, &vm->strings);
+  vm->initString = NULL;
+  FreeArr(vm, LoxObjString*, vm->selectorNames, vm->selectorCapacity);
+  vm->selectorNames = NULL;
+  vm->selectorCount = 0;
+  vm->selectorCapacity = 0;
+  freeObjects(vm);
+  free(vm->fiberQueue);
+  freeEventLoop(&vm->loop);
+}
+
+void push(LoxVM* vm, LoxValue value) {
+  *vm->stackTop = value;
+  vm->stackTop++;
+}
+
+LoxValue pop(LoxVM* vm) {
+  vm->stackTop--;
+  return *vm->stackTop;
+}
+
+static LoxValue peek(LoxVM* vm, int distance) {
+  return vm->stackTop[-1 - distance];
+}
+
+//frames double up to FRAMES_MAX, false if the fiber already has that many
+static bool growFrames(LoxVM* vm) {
+  LoxObjFiber* fiber = vm->fiber;
+  if (fiber->frameCapacity >= FRAMES_MAX) return false;
+
+  int capacity = fiber->frameCapacity * 2 < FRAMES_MAX ? fiber->frameCapacity * 2 : FRAMES_MAX;
+  fiber->frames = GrowArr(vm, LoxCallFrame, fiber->frames, fiber->frameCapacity, capacity);
+  fiber->frameCapacity = capacity;
+  vm->frames = fiber->frames;
+  return true;
+}
+
+//the stack moves when it grows, so the frames and open upvalues pointing into it follow
+static void growStack(LoxVM* vm, size_t needed) {
+  LoxObjFiber* fiber = vm->fiber;
+  int capacity = fiber->stackCapacity;
+  while ((size_t)capacity < needed) capacity *= 2;
+
+  LoxValue* oldStack = vm->stack;
+  size_t used = vm->stackTop - oldStack;
+  LoxValue* stack = GrowArr(vm, LoxValue, oldStack, fiber->stackCapacity, capacity);
+
+  lockHeap(vm);
+  for (int i = 0; i < vm->frameCount; i++) {
+    vm->frames[i].slots = stack + (vm->frames[i].slots - oldStack);
+  }
+  for (LoxObjUpvalue* upvalue = vm->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+    upvalue->location = stack + (upvalue->location - oldStack);
+  }
+  fiber->stack = stack;
+  fiber->stackCapacity = capacity;
+  vm->stack = stack;
+  vm->stackTop = stack + used;
+  vm->stackLimit = stack + capacity - STACK_HEADROOM;
+  unlockHeap(vm);
+}
+
+static bool call(LoxVM* vm, LoxObjClosure* closure, int argCount) {
+  if (argCount != closure->function->arity) {
+    runtimeError(vm, "Expected %d arguments but got %d.",
+        closure->function->arity, argCount);
+    return false;
+  }
+
+  if (vm->frameCount == vm->fiber->frameCapacity && !growFrames(vm)) {
+    runtimeError(vm, "Stack overflow.");
+    return false;
+  }
+
+  if (vm->stackTop - argCount - 1 + closure->function->slotCount > vm->stackLimit) {
+    growStack(vm, vm->stackTop - argCount - 1 + closure->function->slotCount + STACK_HEADROOM - vm->stack);
+  }
+
+  LoxCallFrame* frame = &vm->frames[vm->frameCount++];
+
+  frame->closure = closure;
+  frame->ip = closure->function->chunk.code;
+  frame->slots = vm->stackTop - argCount - 1;
+  return true;
+}
+
+//a method is found in the vtable at the selector its name was given when it was compiled,
+//the vtable covers a window of selectors and has every method of the class that falls in it,
+//methods outside the window are looked up in the frozen table, built on the first such lookup
+static bool findMethod(LoxVM* vm, LoxObjClass* klass, LoxObjString* name, LoxValue* method) {
+  unsigned int index = (unsigned int)(name->selector - klass->vtableBase);
+  if (index < (unsigned int)klass->vtableSize) {
+    if (klass->vtable[index] == NULL) return false;
+    *method = OBJ_VAL(klass->vtable[index]);
+    return true;
+  }
+
+  if (!klass->frozen) {
+    klass->frozen = true;
+    freezeTable(vm, &klass->methods, &klass->frozenMethods);
+  }
+  if (klass->frozenMethods.entries != NULL) {
+    LoxEntry* entry = frozenTableSlot(&klass->frozenMethods, name->hash);
+    if (entry->key != name) return false;
+    *method = entry->value;
+    return true;
+  }
+  return tableGet(&klass->methods, name, method);
+}
+
+//a method table changing after it was frozen goes back to the general lookup until the next freeze
+static void thawMethods(LoxVM* vm, LoxObjClass* klass) {
+  klass->frozen = false;
+  if (klass->frozenMethods.entries != NULL) freeFrozenTable(vm, &klass->frozenMethods);
+}
+
+//loop back edges, calls, returns and the return from a native are where the heap may be
+//compacted or found to be over its limit, so a running program gets there promptly whether or
+//not it loops, and the script's own return catches whatever is left before it finishes
+#define SAFEPOINT_PENDING() (vm->gcCompactRequested || vm->heapLimitExceeded)
+
+static bool safepoint(LoxVM* vm) {
+  if (vm->gcCompactRequested) compactHeap(vm);
+  if (vm->heapLimitExceeded && !enforceHeapLimit(vm)) {
+    runtimeError(vm, "Heap limit of %zu bytes exceeded.", vm->heapLimit);
+    return false;
+  }
+  return true;
+}
+
+static bool callValue(LoxVM* vm, LoxValue callee, int argCount) {
+  if (IS_OBJ(callee)) {
+    switch (OBJ_TYPE(callee)) {
+      case OBJ_BOUND_METHOD: {
+        LoxObjBoundMethod* bound = AS_BOUND_METHOD(callee);
+        vm->stackTop[-argCount - 1] = bound->receiver;
+        return call(vm, bound->method, argCount);
+      }
+      case OBJ_CLASS: {
+        LoxObjClass* klass = AS_CLASS(callee);
+        vm->stackTop[-argCount - 1] = OBJ_VAL(newInstance(vm, klass));
+        if (klass->initializer != NULL) {
+          return call(vm, klass->initializer, argCount);
+        } 
+        else if (argCount != 0) {
+          runtimeError(vm, "Expected 0 arguments but got %d.", argCount);
+          return false;
+        }
+        return true;
+      }
+
+      case OBJ_CLOSURE:
+        return call(vm, AS_CLOSURE(callee), argCount);
+      case OBJ_NATIVE: {
+        LoxNativeFunc native = AS_NATIVE(callee);
+        LoxObjFiber* fiber = vm->fiber;
+        LoxValue result = native(vm, argCount, vm->stackTop - argCount);
+        //the native raised a runtime error, or switched fibers and settled both stacks itself
+        if (vm->frameCount == 0) return false;
+        if (vm->fiber != fiber) return true;
+        vm->stackTop -= argCount + 1;
+        push(vm, result);
+        return !SAFEPOINT_PENDING() || safepoint(vm);
+      }
+      default:
+        break; 
+    }
+  }
+  runtimeError(vm, "Can only call functions and classes.");
+  return false;
+}
+
+static bool invokeFromClass(LoxVM* vm, LoxObjClass* klass, LoxObjString* name, int argCount) {
+  LoxValue method;
+  if (!findMethod(vm, klass, name, &method)) {
+    runtimeError(vm, "Undefined property '%s'.", name->chars);
+    return false;
+  }
+  return call(vm, AS_CLOSURE(method), argCount);
+}
+
+static bool invoke(LoxVM* vm, LoxObjString* name, int argCount) {
+  LoxValue receiver = peek(vm, argCount);
+
+  if (!IS_INSTANCE(receiver)) {
+    runtimeError(vm, "Only instances have methods.");
+    return false;
+  }
+
+  LoxObjInstance* instance = AS_INSTANCE(receiver);
+
+  LoxValue value;
+  if (tableGet(&instance->fields, name, &value)) {
+    vm->stackTop[-argCount - 1] = value;
+    return callValue(vm, value, argCount);
+  }
+
+  return invokeFromClass(vm, instance->klass, name, argCount);
+}
+
+//replace the receiver on top of the stack with the method bound to it
+static void bindClosure(LoxVM* vm, LoxObjClosure* method) {
+  LoxObjBoundMethod* bound = newBoundMethod(vm, peek(vm, 0), method);
+  pop(vm);
+  push(vm, OBJ_VAL(bound));
+}
+
+static bool bindMethod(LoxVM* vm, LoxObjClass* klass, LoxObjString* name) {
+  LoxValue method;
+  if (!findMethod(vm, klass, name, &method)) {
+    runtimeError(vm, "Undefined property '%s'.", name->chars);
+    return false;
+  }
+
+  bindClosure(vm, AS_CLOSURE(method));
+  return true;
+}
+
+//the superclass a method calls through super is fixed once its class is declared, so each super
+//call remembers the method it resolved to and calls it directly while the superclass is the same
+static LoxObjClosure* resolveSuper(LoxVM* vm, LoxObjFunction* function, int constant, LoxObjClass* superclass) {
+  if (function->superCache == NULL) {
+    int count = function->chunk.constants.count;
+    LoxSuperCache* cache = ALLOCATE(vm, LoxSuperCache, count);
+    for (int i = 0; i < count; i++) {
+      cache[i].klass = NULL;
+      cache[i].method = NULL;
+    }
+    lockHeap(vm);
+    function->superCache = cache;
+    unlockHeap(vm);
+  }
+
+  LoxSuperCache* cache = &function->superCache[constant];
+  if (cache->klass == superclass) return cache->method;
+
+  LoxObjString* name = AS_STRING(function->chunk.constants.values[constant]);
+  LoxValue method;
+  if (!findMethod(vm, superclass, name, &method)) {
+    runtimeError(vm, "Undefined property '%s'.", name->chars);
+    return NULL;
+  }
+
+  lockHeap(vm);
+  cache->klass = superclass;
+  cache->method = AS_CLOSURE(method);
+  unlockHeap(vm);
+  writeBarrier(vm, (LoxObject*)function, OBJ_VAL(superclass));
+  writeBarrier(vm, (LoxObject*)function, method);
+  return cache->method;
+}
+
+static LoxObjUpvalue* captureUpvalue(LoxVM* vm, LoxValue* local) {
+  LoxObjUpvalue* prevUpvalue = NULL;
+  LoxObjUpvalue* upvalue = vm->openUpvalues;
+  while (upvalue != NULL && upvalue->location > local) {
+    prevUpvalue = upvalue;
+    upvalue = upvalue->next;
+  }
+
+  if (upvalue != NULL && upvalue->location == local) {
+    return upvalue;
+  }
+
+  LoxObjUpvalue* createdUpvalue = newUpvalue(vm, local);
+  createdUpvalue->next = upvalue;
+
+  if (prevUpvalue == NULL) {
+    vm->openUpvalues = createdUpvalue;
+  } else {
+    prevUpvalue->next = createdUpvalue;
+  }
+
+  return createdUpvalue;
+}
+
+static void closeUpvalues(LoxVM* vm, LoxValue* last) {
+  while (vm->openUpvalues != NULL &&
+         vm->openUpvalues->location >= last) {
+    LoxObjUpvalue* upvalue = vm->openUpvalues;
+    lockHeap(vm);
+    upvalue->closed = *upvalue->location;
+    upvalue->location = &upvalue->closed;
+    unlockHeap(vm);
+    writeBarrier(vm, (LoxObject*)upvalue, upvalue->closed);
+    vm->openUpvalues = upvalue->next;
+  }
+}
+
+//the upvalue may already be closed, so the store can overwrite a heap slot
+static void setUpvalue(LoxVM* vm, LoxObjUpvalue* upvalue, LoxValue value) {
+  lockHeap(vm);
+  deleteBarrier(vm, *upvalue->location);
+  *upvalue->location = value;
+  unlockHeap(vm);
+}
+
+static void resizeVtable(LoxVM* vm, LoxObjClass* klass, int base, int size) {
+  LoxObjClosure** vtable = ALLOCATE(vm, LoxObjClosure*, size);
+  for (int i = 0; i < size; i++) {
+    int old = base + i - klass->vtableBase;
+    vtable[i] = old >= 0 && old < klass->vtableSize ? klass->vtable[old] : NULL;
+  }
+  FreeArr(vm, LoxObjClosure*, klass->vtable, klass->vtableSize);
+  klass->vtable = vtable;
+  klass->vtableBase = base;
+  klass->vtableSize = size;
+}
+
+//methods with selectors above the window extend it, unless it would then be mostly holes,
+//in which case it starts over at the new selector, since the newest selectors are the ones
+//no other class shares, anything below the window is only in the method table
+static void setVtableMethod(LoxVM* vm, LoxObjClass* klass, int selector, LoxObjClosure* method) {
+  if (selector < klass->vtableBase) return;
+
+  if (selector >= klass->vtableBase + klass->vtableSize) {
+    int base = klass->vtableSize == 0 ? selector : klass->vtableBase;
+    if (selector + 1 - base > VTABLE_MAX_SPREAD * klass->methods.count + VTABLE_MIN_SIZE) {
+      base = selector;
+    }
+    resizeVtable(vm, klass, base, selector + 1 - base);
+  }
+  klass->vtable[selector - klass->vtableBase] = method;
+}
+
+//a subclass starts out with a copy of its superclass's vtable, as it does with its methods,
+//one that already has methods of its own is left to lookups by name
+static void inheritVtable(LoxVM* vm, LoxObjClass* subclass, LoxObjClass* superclass) {
+  if (subclass->methods.count > 0) {
+    resizeVtable(vm, subclass, 0, 0);
+    return;
+  }
+  if (superclass->vtableSize == 0) return;
+
+  LoxObjClosure** vtable = ALLOCATE(vm, LoxObjClosure*, superclass->vtableSize);
+  memcpy(vtable, superclass->vtable, sizeof(LoxObjClosure*) * superclass->vtableSize);
+  FreeArr(vm, LoxObjClosure*, subclass->vtable, subclass->vtableSize);
+  subclass->vtable = vtable;
+  subclass->vtableBase = superclass->vtableBase;
+  subclass->vtableSize = superclass->vtableSize;
+}
+
+//the copied method table brings the superclass's init along, and instances of the subclass
+//start out with room for at least the superclass's fields
+static void inheritInitializer(LoxObjClass* subclass, LoxObjClass* superclass) {
+  if (superclass->initializer != NULL) subclass->initializer = superclass->initializer;
+  if (superclass->fieldCount > subclass->fieldCount) subclass->fieldCount = superclass->fieldCount;
+}
+
+static void defineMethod(LoxVM* vm, LoxObjString* name) {
+  LoxValue method = peek(vm, 0);
+  LoxObjClass* klass = AS_CLASS(peek(vm, 1));
+  thawMethods(vm, klass);
+  lockHeap(vm);
+  tableSet(vm, &klass->methods, name, method);
+  unlockHeap(vm);
+  setVtableMethod(vm, klass, methodSelector(vm, name), AS_CLOSURE(method));
+  if (name == vm->initString) klass->initializer = AS_CLOSURE(method);
+  writeBarrier(vm, (LoxObject*)klass, OBJ_VAL(name));
+  writeBarrier(vm, (LoxObject*)klass, method);
+  pop(vm);
+}
+
+static bool getGlobal(LoxVM* vm, LoxObjString* name) {
+  LoxValue value;
+  if (!tableGet(&vm->globals, name, &value)) {
+    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+    return false;
+  }
+  push(vm, value);
+  return true;
+}
+
+static bool setGlobal(LoxVM* vm, LoxObjString* name) {
+  if (tableSet(vm, &vm->globals, name, peek(vm, 0))) {
+    tableDelete(vm, &vm->globals, name); // [delete]
+    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+    return false;
+  }
+  return true;
+}
+
+static bool getProperty(LoxVM* vm, LoxObjString* name) {
+  if (!IS_INSTANCE(peek(vm, 0))) {
+    runtimeError(vm, "Only instances have properties.");
+    return false;
+  }
+
+  LoxObjInstance* instance = AS_INSTANCE(peek(vm, 0));
+
+  LoxValue value;
+  if (tableGet(&instance->fields, name, &value)) {
+    pop(vm);
+    push(vm, value);
+    return true;
+  }
+  return bindMethod(vm, instance->klass, name);
+}
+
+static bool setProperty(LoxVM* vm, LoxObjString* name) {
+  if (!IS_INSTANCE(peek(vm, 1))) {
+    runtimeError(vm, "Only instances have fields.");
+    return false;
+  }
+
+  LoxObjInstance* instance = AS_INSTANCE(peek(vm, 1));
+  lockHeap(vm);
+  tableSet(vm, &instance->fields, name, peek(vm, 0));
+  unlockHeap(vm);
+  if (instance->fields.count > instance->klass->fieldCount) {
+    instance->klass->fieldCount = instance->fields.count;
+  }
+  writeBarrier(vm, (LoxObject*)instance, OBJ_VAL(name));
+  writeBarrier(vm, (LoxObject*)instance, peek(vm, 0));
+  LoxValue value = pop(vm);
+  pop(vm);
+  push(vm, value);
+  return true;
+}
+
+//build a closure for the function and read its upvalue descriptors from the frame's code
+static void makeClosure(LoxVM* vm, LoxCallFrame* frame, LoxObjFunction* function) {
+  LoxObjClosure* closure = newClosure(vm, function);
+  push(vm, OBJ_VAL(closure));
+  for (int i = 0; i < closure->upvalueCount; i++) {
+    uint8_t flags = *frame->ip++;
+    int index;
+    if (flags & UPVALUE_LONG) {
+      index = (frame->ip[0] << 16) | (frame->ip[1] << 8) | frame->ip[2];
+      frame->ip += 3;
+    } else {
+      index = *frame->ip++;
+    }
+
+    LoxObjUpvalue* upvalue = (flags & UPVALUE_LOCAL) ? captureUpvalue(vm, frame->slots + index)
+                                                      : frame->closure->upvalues[index];
+    lockHeap(vm);
+    closure->upvalues[i] = upvalue;
+    unlockHeap(vm);
+    //capturing can collect garbage and promote the closure before its upvalues are filled in
+    writeBarrier(vm, (LoxObject*)closure, OBJ_VAL(closure->upvalues[i]));
+  }
+}
+
+static bool isFalsey(LoxValue value) {
+  return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static void concatenate(LoxVM* vm) {
+  LoxObjString* b = AS_STRING(peek(vm, 0));
+  LoxObjString* a = AS_STRING(peek(vm, 1));
+
+  int length = a->length + b->length;
+  char* chars = ALLOCATE(vm, char, length + 1);
+  memcpy(chars, a->chars, a->length);
+  memcpy(chars + a->length, b->chars, b->length);
+  chars[length] = '\0';
+
+  LoxObjString* result = takeString(vm, chars, length);
+  pop(vm);
+  pop(vm);
+  push(vm, OBJ_VAL(result));
+}
+
+static InterpreterResult run(LoxVM* vm) {
+  LoxCallFrame* frame = &vm->frames[vm->frameCount - 1];
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_SHORT() \
+    (frame->ip += 2, \
+    (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+
+#define READ_LONG() \
+    (frame->ip += 3, \
+    (uint32_t)((frame->ip[-3] << 16) | (frame->ip[-2] << 8) | frame->ip[-1]))
+
+#define READ_CONSTANT() \
+    (frame->closure->function->chunk.constants.values[READ_BYTE()])
+#define CONSTANT_AT(index) \
+    (frame->closure->function->chunk.constants.values[(index)])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define BINARY_OP(valueType, op) \
+    do { \
+      if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
+        runtimeError(vm, "Operands must be numbers."); \
+        return INTERPRET_RUNTIME_ERROR; \
+      } \
+      double b = AS_NUMBER(pop(vm)); \
+      double a = AS_NUMBER(pop(vm)); \
+      push(vm, valueType(a op b)); \
+    } while (false)
+
+  for (;;) {
+#ifdef DEBUG_TRACE_EXECUTION
+    printf("          ");
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+      printf("[ ");
+      printValue(*slot);
+      printf(" ]");
+    }
+    printf("\n");
+    disassembleInstruction(&frame->closure->function->chunk,
+        (int)(frame->ip - frame->closure->function->chunk.code));
+#endif
+
+    uint8_t instruction;
+    switch (instruction = READ_BYTE()) {
+      case OP_CONSTANT: {
+        LoxValue constant = READ_CONSTANT();
+        push(vm, constant);
+        break;
+      }
+      case OP_CONSTANT_LONG: {
+        LoxValue constant = CONSTANT_AT(READ_LONG());
+        push(vm, constant);
+        break;
+      }
+      case OP_NIL: push(vm, NIL_VAL); break;
+      case OP_TRUE: push(vm, BOOL_VAL(true)); break;
+      case OP_FALSE: push(vm, BOOL_VAL(false)); break;
+      case OP_POP: pop(vm); break;
+      case OP_GET_LOCAL: {
+        uint8_t slot = READ_BYTE();
+        push(vm, frame->slots[slot]);
+        break;
+      }
+      case OP_SET_LOCAL: {
+        uint8_t slot = READ_BYTE();
+        frame->slots[slot] = peek(vm, 0);
+        break;
+      }
+      case OP_GET_GLOBAL: {
+        if (!getGlobal(vm, READ_STRING())) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_DEFINE_GLOBAL: {
+        LoxObjString* name = READ_STRING();
+        tableSet(vm, &vm->globals, name, peek(vm, 0));
+        pop(vm);
+        break;
+      }
+      case OP_SET_GLOBAL: {
+        if (!setGlobal(vm, READ_STRING())) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_GET_UPVALUE: {
+        uint8_t slot = READ_BYTE();
+        push(vm, *frame->closure->upvalues[slot]->location);
+        break;
+      }
+      case OP_SET_UPVALUE: {
+        uint8_t slot = READ_BYTE();
+        LoxObjUpvalue* upvalue = frame->closure->upvalues[slot];
+        setUpvalue(vm, upvalue, peek(vm, 0));
+        writeBarrier(vm, (LoxObject*)upvalue, peek(vm, 0));
+        break;
+      }
+      case OP_GET_PROPERTY: {
+        if (!getProperty(vm, READ_STRING())) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_SET_PROPERTY: {
+        if (!setProperty(vm, READ_STRING())) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_GET_SUPER: {
+        int constant = READ_BYTE();
+        LoxObjClass* superclass = AS_CLASS(pop(vm));
+        LoxObjClosure* method = resolveSuper(vm, frame->closure->function, constant, superclass);
+        if (method == NULL) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        bindClosure(vm, method);
+        break;
+      }
+      case OP_EQUAL: {
+        LoxValue b = pop(vm);
+        LoxValue a = pop(vm);
+        push(vm, BOOL_VAL(valuesEqual(a, b)));
+        break;
+      }
+      case OP_GREATER:  BINARY_OP(BOOL_VAL, >); break;
+      case OP_LESS:     BINARY_OP(BOOL_VAL, <); break;
+      case OP_ADD: {
+        if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+          concatenate(vm);
+        } else if (IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1))) {
+          double b = AS_NUMBER(pop(vm));
+          double a = AS_NUMBER(pop(vm));
+          push(vm, NUMBER_VAL(a + b));
+        } else {
+          runtimeError(vm, 
+              "Operands must be two numbers or two strings.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
+      case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
+      case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
+      case OP_NOT:
+        push(vm, BOOL_VAL(isFalsey(pop(vm))));
+        break;
+      case OP_NEGATE:
+        if (!IS_NUMBER(peek(vm, 0))) {
+          runtimeError(vm, "Operand must be a number.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(vm, NUMBER_VAL(-AS_NUMBER(pop(vm))));
+        break;
+      case OP_PRINT: {
+        printLoxValue(pop(vm));
+        printf("\n");
+        break;
+      }
+      case OP_JUMP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip += offset;
+        break;
+}
+      case OP_JUMP_IF_FALSE: {
+        uint16_t offset = READ_SHORT();
+        if (isFalsey(peek(vm, 0))) frame->ip += offset;
+        break;
+}
+      case OP_LOOP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip -= offset;
+        if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+      case OP_CALL: {
+        int argCount = READ_BYTE();
+        if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+        if (!callValue(vm, peek(vm, argCount), argCount)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        frame = &vm->frames[vm->frameCount - 1];
+        break;
+      }
+      case OP_INVOKE: {
+        LoxObjString* method = vm->selectorNames[READ_BYTE()];
+        int argCount = READ_BYTE();
+        if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+        if (!invoke(vm, method, argCount)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        frame = &vm->frames[vm->frameCount - 1];
+        break;
+      }
+      case OP_SUPER_INVOKE: {
+        int constant = READ_BYTE();
+        int argCount = READ_BYTE();
+        if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+        LoxObjClass* superclass = AS_CLASS(pop(vm));
+        LoxObjClosure* method = resolveSuper(vm, frame->closure->function, constant, superclass);
+        if (method == NULL || !call(vm, method, argCount)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        frame = &vm->frames[vm->frameCount - 1];
+        break;
+      }
+      case OP_CLOSURE:
+        makeClosure(vm, frame, AS_FUNCTION(READ_CONSTANT()));
+        break;
+      case OP_CLOSE_UPVALUE:
+        closeUpvalues(vm, vm->stackTop - 1);
+        pop(vm);
+        break;
+      case OP_RETURN: {
+        if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+        LoxValue result = pop(vm);
+        closeUpvalues(vm, frame->slots);
+        vm->frameCount--;
+        if (vm->frameCount == 0) {
+          pop(vm);
+          if (!finishFiber(vm, result)) return INTERPRET_OK;
+          frame = &vm->frames[vm->frameCount - 1];
+          break;
+        }
+
+        vm->stackTop = frame->slots;
+        push(vm, result);
+        frame = &vm->frames[vm->frameCount - 1];
+        break;
+      }
+      case OP_CLASS:
+        push(vm, OBJ_VAL(newClass(vm, READ_STRING())));
+        break;
+      case OP_INHERIT: {
+        LoxValue superclass = peek(vm, 1);
+        if (!IS_CLASS(superclass)) {
+          runtimeError(vm, "Superclass must be a class.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        LoxObjClass* subclass = AS_CLASS(peek(vm, 0));
+        thawMethods(vm, subclass);
+        inheritVtable(vm, subclass, AS_CLASS(superclass));
+        inheritInitializer(subclass, AS_CLASS(superclass));
+        lockHeap(vm);
+        tableAddAll(vm, &AS_CLASS(superclass)->methods,
+                    &subclass->methods);
+        unlockHeap(vm);
+        rememberObject(vm, (LoxObject*)subclass);
+        pop(vm); 
+        break;
+      }
+      case OP_METHOD:
+        defineMethod(vm, READ_STRING());
+        break;
+      //same instructions as above, but with a 3 byte index operand
+      case OP_WIDE: {
+        uint8_t wideInstruction = READ_BYTE();
+        uint32_t operand = READ_LONG();
+        switch (wideInstruction) {
+          case OP_GET_LOCAL:
+            push(vm, frame->slots[operand]);
+            break;
+          case OP_SET_LOCAL:
+            frame->slots[operand] = peek(vm, 0);
+            break;
+          case OP_GET_GLOBAL:
+            if (!getGlobal(vm, AS_STRING(CONSTANT_AT(operand)))) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+          case OP_DEFINE_GLOBAL:
+            tableSet(vm, &vm->globals, AS_STRING(CONSTANT_AT(operand)), peek(vm, 0));
+            pop(vm);
+            break;
+          case OP_SET_GLOBAL:
+            if (!setGlobal(vm, AS_STRING(CONSTANT_AT(operand)))) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+          case OP_GET_UPVALUE:
+            push(vm, *frame->closure->upvalues[operand]->location);
+            break;
+          case OP_SET_UPVALUE: {
+            LoxObjUpvalue* upvalue = frame->closure->upvalues[operand];
+            setUpvalue(vm, upvalue, peek(vm, 0));
+            writeBarrier(vm, (LoxObject*)upvalue, peek(vm, 0));
+            break;
+          }
+          case OP_GET_PROPERTY:
+            if (!getProperty(vm, AS_STRING(CONSTANT_AT(operand)))) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+          case OP_SET_PROPERTY:
+            if (!setProperty(vm, AS_STRING(CONSTANT_AT(operand)))) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+          case OP_GET_SUPER: {
+            LoxObjClass* superclass = AS_CLASS(pop(vm));
+            LoxObjClosure* method = resolveSuper(vm, frame->closure->function, operand, superclass);
+            if (method == NULL) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            bindClosure(vm, method);
+            break;
+          }
+          case OP_INVOKE: {
+            int argCount = READ_BYTE();
+            if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+            if (!invoke(vm, vm->selectorNames[operand], argCount)) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            frame = &vm->frames[vm->frameCount - 1];
+            break;
+          }
+          case OP_SUPER_INVOKE: {
+            int argCount = READ_BYTE();
+            if (SAFEPOINT_PENDING() && !safepoint(vm)) return INTERPRET_RUNTIME_ERROR;
+            LoxObjClass* superclass = AS_CLASS(pop(vm));
+            LoxObjClosure* method = resolveSuper(vm, frame->closure->function, operand, superclass);
+            if (method == NULL || !call(vm, method, argCount)) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            frame = &vm->frames[vm->frameCount - 1];
+            break;
+          }
+          case OP_CLOSURE:
+            makeClosure(vm, frame, AS_FUNCTION(CONSTANT_AT(operand)));
+            break;
+          case OP_CLASS:
+            push(vm, OBJ_VAL(newClass(vm, AS_STRING(CONSTANT_AT(operand)))));
+            break;
+          case OP_METHOD:
+            defineMethod(vm, AS_STRING(CONSTANT_AT(operand)));
+            break;
+        }
+        break;
+      }
+    }
+  }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_LONG
+#undef READ_CONSTANT
+#undef CONSTANT_AT
+#undef READ_STRING
+#undef BINARY_OP
+}
+
+void hack(LoxVM* vm, bool b) {
+  run(vm);
+  if (b) hack(vm, false);
+}
+
+InterpreterResult interpretCode(LoxVM* vm, const char* source) {
+
+  LoxObjFunction* function = compileCode(vm, source);
+  if (function == NULL) return INTERPRET_COMPILE_ERROR;
+
+  vm->fiber->state = FIBER_RUNNING;
+  push(vm, OBJ_VAL(function));
+  LoxObjClosure* closure = newClosure(vm, function);
+  pop(vm);
+  push(vm, OBJ_VAL(closure));
+  call(vm, closure, 0);
+
+  return run(vm);
+}
+
+
+
+
@@ -1,55 +1,164 @@
-#ifndef lox_LoxVM_h
-#define lox_LoxVM_h
-
-#include "LoxObject.h"
-#include "LoxTable.h"
-#include "LoxValue.h"
-
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
-
-typedef struct {
-  LoxObjClosure* closure;
-  uint8_t* ip;
-  LoxValue* slots;
-} LoxCallFrame;
-
-typedef struct {
-  LoxCallFrame frames[FRAMES_MAX];
-  int frameCount;
-  
-  LoxValue stack[STACK_MAX];
-  LoxValue* stackTop;
-
-  LoxTable globals;
-
-  LoxTable strings;
-  LoxObjString* initString;
-  LoxObjUpvalue* openUpvalues;
-
-  size_t bytesAllocated;
-  size_t nextGC;
-
-  LoxObject* objects;
-
-  int grayCount;
-  int grayCapacity;
-  LoxObject** grayStack;
-} LoxVM;
-
-typedef enum {
-  INTERPRET_OK,
-  INTERPRET_COMPILE_ERROR,
-  INTERPRET_RUNTIME_ERROR
-} InterpreterResult;
-
-extern LoxVM vm;
-
-void initLoxVM();
-void freeLoxVM();
-
-InterpreterResult interpretCode(const char* source);
-void push(LoxValue value);
-LoxValue pop();
-
+#ifndef lox_LoxVM_h
+#define lox_LoxVM_h
+
+#include "LoxEventLoop.h"
+#include "LoxHeap.h"
+#include "LoxObject.h"
+#include "LoxTable.h"
+#include "LoxValue.h"
+
+#define FRAMES_MAX 64
+//fibers start with room for this many frames and grow up to FRAMES_MAX
+#define FIBER_FRAMES_MIN 8
+//a stack is grown on each call to hold the callee's locals and this many temporaries past them
+#define STACK_HEADROOM (2 * UINT8_COUNT)
+
+//a vtable may span up to this many slots per method, plus VTABLE_MIN_SIZE, before it starts over
+#define VTABLE_MAX_SPREAD 4
+#define VTABLE_MIN_SIZE 16
+
+//GC_FULL traces the whole heap on every collection
+//GC_GENERATIONAL also runs minor collections that only trace the young generation
+//GC_INCREMENTAL spreads each collection over bounded slices between allocations
+//GC_CONCURRENT marks on a background thread while the program keeps running
+typedef enum {
+  GC_FULL,
+  GC_GENERATIONAL,
+  GC_INCREMENTAL,
+  GC_CONCURRENT
+} GcMode;
+
+//where an incremental or concurrent collection currently is, always idle for the other modes
+typedef enum {
+  GC_PHASE_IDLE,
+  GC_PHASE_MARK,
+  GC_PHASE_SWEEP
+} GcPhase;
+
+//bucket i counts collector pauses shorter than 2^i microseconds
+#define GC_PAUSE_BUCKETS 24
+
+//marking threads, only created when more than one is configured
+typedef struct GcWorkerPool GcWorkerPool;
+//background marking thread for GC_CONCURRENT
+typedef struct GcMarker GcMarker;
+
+//running totals behind gcStats() and the LOX_GC_STATS report
+typedef struct {
+  long collections;
+  long minorCollections;
+  long compactions;
+  size_t totalAllocated;
+  size_t totalFreed;
+  long objectsFreed;
+  long liveObjects[OBJ_TYPE_COUNT];
+  size_t liveBytes[OBJ_TYPE_COUNT];
+  //objects allocated since the last collection, a minor collection frees or promotes each one
+  long youngObjects;
+  long minorCandidates;
+  long promoted;
+} GcStats;
+
+struct LoxVM {
+  //the running fiber's frames and stack, switching fibers swaps these pointers
+  LoxCallFrame* frames;
+  int frameCount;
+  
+  LoxValue* stack;
+  LoxValue* stackTop;
+  //a call whose locals reach past this grows the stack first
+  LoxValue* stackLimit;
+
+  LoxObjFiber* fiber;
+  //runs the scripts and REPL lines, and is where the program ends up once every fiber is done
+  LoxObjFiber* mainFiber;
+  //fibers the scheduler runs in turn as the running one yields or finishes, a ring buffer
+  LoxObjFiber** fiberQueue;
+  int fiberQueueHead;
+  int fiberQueueCount;
+  int fiberQueueCapacity;
+  //fds and timers the scheduler waits on when no fiber is ready to run
+  LoxEventLoop loop;
+
+  LoxTable globals;
+
+  LoxTable strings;
+  LoxObjString* initString;
+  //selectors handed out to method names so far, selectorNames has the name of each, since
+  //OP_INVOKE carries the selector in place of the name's constant
+  LoxObjString** selectorNames;
+  int selectorCount;
+  int selectorCapacity;
+  LoxObjUpvalue* openUpvalues;
+
+  size_t bytesAllocated;
+  size_t nextGC;
+  //buffers in the large buffer space are counted apart from everything else
+  size_t largeBytesAllocated;
+  size_t nextLargeGC;
+  //heap policy, see setGcOption
+  double gcGrowthFactor;
+  size_t gcMinInterval;
+  size_t gcMaxInterval;
+  //0 for no limit, otherwise going past it is a runtime error
+  size_t heapLimit;
+  bool heapLimitExceeded;
+  size_t bytesSinceGC;
+  GcMode gcMode;
+  GcPhase gcPhase;
+  int gcSliceBudget;
+  int gcThreads;
+  GcWorkerPool* gcPool;
+  GcMarker* gcMarker;
+  //set while the marker thread is tracing, stores into the heap then take its lock
+  bool gcConcurrentMark;
+  int heapLocks;
+  //set while compiling, the new functions are not reachable from any root until it is over
+  bool gcSuppressed;
+
+  //size-class pages that objects are allocated from
+  LoxHeap heap;
+
+
+  int grayCount;
+  int grayCapacity;
+  LoxObject** grayStack;
+
+  //old objects that were written a young reference since the last collection
+  int rememberedCount;
+  int rememberedCapacity;
+  LoxObject** remembered;
+
+  //next page an incremental sweep will look at
+  HeapPage* sweepPage;
+  //full collections leave sweeping to the allocator
+  bool gcLazySweep;
+  size_t sweepCredit;
+  //compact when a full collection leaves fewer than this percent of cells in use
+  int gcCompactThreshold;
+  //checked by the interpreter between instructions, where objects can safely move
+  bool gcCompactRequested;
+
+  bool gcReportPauses;
+  GcStats gcStats;
+  //where to write the statistics as JSON at exit, "-" for stderr
+  const char* gcStatsPath;
+  double gcPauseMax;
+  double gcPauseTotal;
+  long gcPauseHistogram[GC_PAUSE_BUCKETS];
+};
+
+typedef enum {
+  INTERPRET_OK,
+  INTERPRET_COMPILE_ERROR,
+  INTERPRET_RUNTIME_ERROR
+} InterpreterResult;
+
+void initLoxVM(LoxVM* vm);
+void freeLoxVM(LoxVM* vm);
+
+InterpreterResult interpretCode(LoxVM* vm, const char* source);
+void push(LoxVM* vm, LoxValue value);
+LoxValue pop(LoxVM* vm);
+
 #endif
\ No newline at end of file
@@ -1,140 +1,176 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <dirent.h>
-#include "common.h"
-#include "LoxChunk.h"
-#include "LoxDebugger.h"
-#include "LoxVM.h"
-
-
-//execute line by line from terminal input
-static void ExecutePrompt() {
-    char input[1024];
-    for (;;) {
-        printf("Lox> ");
-        if (!fgets(input, sizeof(input), stdin)) {
-            printf("\n");
-            break;
-    }
-        interpretCode(input);
-}
-}
-
-static char* readFile(const char* path) {
-    FILE* LoxFile = fopen(path, "rb");
-    if (LoxFile == NULL) {
-        fprintf(stderr, "Could not open file \"%s\".\n", path);
-        exit(74);
-    }
-    fseek(LoxFile, 0L, SEEK_END);
-    size_t fileSize = ftell(LoxFile);
-    rewind(LoxFile);
-    char* buffer = (char*)malloc(fileSize + 1);
-    //not enough space to hold the size of the Lox code file
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-        exit(74);
-    }
-    size_t fileDataSize = fread(buffer, sizeof(char), fileSize, LoxFile);
-    //read fails
-    if (fileDataSize < fileSize) {
-        fprintf(stderr, "Could not read file \"%s\".\n", path);
-        exit(74);
-    }
-
-    buffer[fileDataSize] = '\0';
-    fclose(LoxFile);
-return buffer;
-}
-
-static void ExecuteFile(const char* path) {
-        char* code = readFile(path);
-        InterpreterResult evaluatedCode = interpretCode(code);
-        free(code);
-        //comment out to allow for full testing without exiting after each error
-        if (evaluatedCode == INTERPRET_COMPILE_ERROR); //exit(65);
-        if (evaluatedCode == INTERPRET_RUNTIME_ERROR); //exit(70);
-}
-
-
-int main(int argc, const char* argv[]) {
-    initLoxVM();
-    
-    if (argc == 1) {
-        ExecutePrompt();
-    } 
-    else if (argc == 2) {
-        ExecuteFile(argv[1]);
-    } 
-    else if (argc==3){
-        int testCount=0;
-        char *directories[] = {"assignment", "benchmark", "block", "bool", "call", "class", "closure", "comments", "constructor",
-                                "expressions", "field", "for", "function", "if", "inheritance", "limit", "logical_operator", "method",
-                                "nil", "number", "operator", "print", "regression", "return", "scanning", "string", "super", "T", "this",
-                                "variable", "while"};
-
-        //iterate through each test directory
-        for (int i=0; i<sizeof(directories); i++){
-            char *fullPath;
-            char *path = "Testing\\test\\";
-            fullPath[0] = '\0';
-            //append each directory name to the Testing\test tag of the file structure
-            strcat(fullPath, path);
-            strcat(fullPath, directories[i]);
-            //open each directory to grab each test lox file 
-            DIR *directory = opendir(fullPath);
-
-            if (directory==NULL){
-                printf("Could not open directory");
-                return 0;
-            }
-
-            struct dirent *entry;
-            size_t arglen = strlen(fullPath);
-            //iterate through each item/entry in the directory 
-            while((entry=readdir(directory))!=NULL){
-                
-                //declare new string each loop for full file path with enough space for path+filename
-                char *fullFilePath = malloc(arglen + strlen(entry->d_name) + 2);
-
-                if (fullFilePath==NULL){
-                    printf("malloc failed");
-                    return 0;
-                }
-                //append the filename to the current directory path
-                sprintf(fullFilePath, "%s\\%s", fullPath, entry->d_name);
-                //check for the '.' and '..' files of each directory
-                if (fullFilePath[strlen(fullFilePath)-1]=='.'){
-                    //do nothing for '.' files
-                }
-                //execute each file
-                else{
-                    printf(fullFilePath);
-                    printf("\n-------------------\n");
-                    ExecuteFile(fullFilePath);
-                    testCount++;
-                    printf("\n");
-                    if (strcmp(fullFilePath, "Testing\\test\\while\\var_in_body.lox")==0){
-                        printf("%d", testCount);
-                        return 0;
-                    }
-            }
-                free(fullFilePath);
-
-            }
-            closedir(directory);
-        }
-    }
-    else {
-        fprintf(stderr, "Usage: clox [path]\n");
-        exit(64);
-}
-    freeLoxVM();
-
-    return 0;
-
-}
-
-    
-    
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "LoxBatch.h"
+#include "LoxChunk.h"
+#include "LoxDebugger.h"
+#include "LoxVM.h"
+#include "memory.h"
+
+
+//execute line by line from terminal input
+static void ExecutePrompt(LoxVM* vm) {
+    char input[1024];
+    for (;;) {
+        printf("Lox> ");
+        if (!fgets(input, sizeof(input), stdin)) {
+            printf("\n");
+            break;
+    }
+        interpretCode(vm, input);
+}
+}
+
+static char* readFile(const char* path) {
+    FILE* LoxFile = fopen(path, "rb");
+    if (LoxFile == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    fseek(LoxFile, 0L, SEEK_END);
+    size_t fileSize = ftell(LoxFile);
+    rewind(LoxFile);
+    char* buffer = (char*)malloc(fileSize + 1);
+    //not enough space to hold the size of the Lox code file
+    if (buffer == NULL) {
+        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+        exit(74);
+    }
+    size_t fileDataSize = fread(buffer, sizeof(char), fileSize, LoxFile);
+    //read fails
+    if (fileDataSize < fileSize) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        exit(74);
+    }
+
+    buffer[fileDataSize] = '\0';
+    fclose(LoxFile);
+return buffer;
+}
+
+static InterpreterResult ExecuteFile(LoxVM* vm, const char* path) {
+        char* code = readFile(path);
+        InterpreterResult evaluatedCode = interpretCode(vm, code);
+        free(code);
+        //comment out to allow for full testing without exiting after each error
+        if (evaluatedCode == INTERPRET_COMPILE_ERROR); //exit(65);
+        if (evaluatedCode == INTERPRET_RUNTIME_ERROR); //exit(70);
+        return evaluatedCode;
+}
+
+
+//options of the form --name=value tune the collector, see setGcOption
+//without a VM they are only counted, the batch mode applies them to each script's VM
+static int parseOptions(LoxVM* vm, int argc, const char* argv[]) {
+    int count = 1;
+    while (count < argc && strncmp(argv[count], "--", 2) == 0 && strcmp(argv[count], "--batch") != 0) {
+        const char* option = argv[count] + 2;
+        const char* value = strchr(option, '=');
+        char name[64];
+        if (value == NULL || value - option >= (int)sizeof(name)) {
+            fprintf(stderr, "Expected --name=value but got '%s'.\n", argv[count]);
+            exit(64);
+        }
+        memcpy(name, option, value - option);
+        name[value - option] = '\0';
+        if (vm != NULL && !setGcOption(vm, name, value + 1)) {
+            fprintf(stderr, "Invalid option '%s'.\n", argv[count]);
+            exit(64);
+        }
+        count++;
+    }
+    return count - 1;
+}
+
+//the options given before --batch, passed on to the VM of every script
+static int batchArgc;
+static const char** batchArgv;
+
+//runs in the child process the batch forked for the script, with a VM of its own
+static int ExecuteBatchFile(const char* path) {
+    LoxVM* vm = (LoxVM*)malloc(sizeof(LoxVM));
+    if (vm == NULL) exit(1);
+    initLoxVM(vm);
+    parseOptions(vm, batchArgc, batchArgv);
+
+    InterpreterResult result = ExecuteFile(vm, path);
+    freeLoxVM(vm);
+    free(vm);
+
+    if (result == INTERPRET_COMPILE_ERROR) return BATCH_EXIT_COMPILE_ERROR;
+    if (result == INTERPRET_RUNTIME_ERROR) return BATCH_EXIT_RUNTIME_ERROR;
+    return 0;
+}
+
+//--batch dir [-j jobs] [--expect], jobs defaults to one per processor
+static int ExecuteBatch(int argc, const char* argv[]) {
+    const char* directory = NULL;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool checkExpect = false;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--expect") == 0) {
+            checkExpect = true;
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char* count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            char* end;
+            jobs = strtol(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || jobs < 1) {
+                fprintf(stderr, "Expected a number of jobs but got '%s'.\n", count);
+                return 64;
+            }
+        }
+        else if (directory == NULL) {
+            directory = argv[i];
+        }
+        else {
+            fprintf(stderr, "Unexpected argument '%s'.\n", argv[i]);
+            return 64;
+        }
+    }
+    if (directory == NULL) {
+        fprintf(stderr, "Usage: clox [--option=value ...] --batch dir [-j jobs] [--expect]\n");
+        return 64;
+    }
+    if (jobs < 1) jobs = 1;
+
+    return runBatch(directory, (int)jobs, checkExpect, ExecuteBatchFile);
+}
+
+int main(int argc, const char* argv[]) {
+    int options = parseOptions(NULL, argc, argv);
+    if (argc > options + 1 && strcmp(argv[options + 1], "--batch") == 0) {
+        //no VM is made here, each script gets its own in a process of its own
+        batchArgc = options + 1;
+        batchArgv = argv;
+        return ExecuteBatch(argc - options - 2, argv + options + 2);
+    }
+
+    LoxVM* vm = (LoxVM*)malloc(sizeof(LoxVM));
+    if (vm == NULL) exit(1);
+    initLoxVM(vm);
+
+    parseOptions(vm, argc, argv);
+    argc -= options;
+    argv += options;
+
+    if (argc == 1) {
+        ExecutePrompt(vm);
+    } 
+    else if (argc == 2) {
+        ExecuteFile(vm, argv[1]);
+    } 
+    else {
+        fprintf(stderr, "Usage: clox [--option=value ...] [path]\n");
+        fprintf(stderr, "       clox [--option=value ...] --batch dir [-j jobs] [--expect]\n");
+        exit(64);
+}
+    freeLoxVM(vm);
+    free(vm);
+
+    return 0;
+
+}
\ No newline at end of file
@@ -1,245 +1,1570 @@
-#include <stdlib.h>
-#include "LoxCompiler.h"
-#include "memory.h"
-#include "LoxVM.h"
-#ifdef DEBUG_LOG_GC
-#include <stdio.h>
-#include "LoxDebugger.h"
-#endif
-#define GC_HEAP_GROW_FACTOR 2
-
-
-void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
-    vm.bytesAllocated += newSize - oldSize;
-
-    if (newSize > oldSize) {
-        #ifdef DEBUG_STRESS_GC
-        collectGarbage();
-        #endif
-
-        if (vm.bytesAllocated > vm.nextGC) {
-            collectGarbage();
-        }
-}
-
-    if (newSize == 0) {
-        free(pointer);
-        return NULL;
-    }
-
-    void* result = realloc(pointer, newSize);
-    if (result == NULL) exit(1);
-    return result;
-}
-
-void markObject(LoxObject* object){
-    if (object == NULL) return;
-    if (object->isMarked) return;
-
-    #ifdef DEBUG_LOG_GC
-    printf("%p mark ", (void*)object);
-    printValue(OBJ_VAL(object));
-    printf("\n");
-    #endif
-
-    object->isMarked = true;
-
-    if (vm.grayCapacity < vm.grayCount + 1) {
-        vm.grayCapacity = GrowCap(vm.grayCapacity);
-        vm.grayStack = (LoxObject**)realloc(vm.grayStack, sizeof(LoxObject*) * vm.grayCapacity);
-
-        if (vm.grayStack == NULL) exit(1);
-    }
-
-    vm.grayStack[vm.grayCount++] = object;
-}
-
-void markValue(LoxValue value) {
-    if (IS_OBJ(value)) markObject(AS_OBJ(value));
-}
-
-static void markArray(LoxValueArray* array) {
-    for (int i = 0; i < array->count; i++) {
-        markValue(array->values[i]);
-    }
-}
-
-static void blackenObject(LoxObject* object){
-    #ifdef DEBUG_LOG_GC
-    printf("%p blacken ", (void*)object);
-    printValue(OBJ_VAL(object));
-    printf("\n");
-    #endif
-
-    switch (object->type){
-        case OBJ_BOUND_METHOD:{
-            LoxObjBoundMethod* bound = (LoxObjBoundMethod*)object;
-            markValue(bound->receiver);
-            markObject((LoxObject*)bound->method);
-            break;
-        }
-        case OBJ_CLASS:{
-            LoxObjClass* klass = (LoxObjClass*)object;
-            markObject((LoxObject*)klass->name);
-            markTable(&klass->methods);
-            break;
-        }
-        case OBJ_CLOSURE:{
-            LoxObjClosure* closure = (LoxObjClosure*)object;
-            markObject((LoxObject*)closure->function);
-            for (int i = 0; i < closure->upvalueCount; i++) {
-            markObject((LoxObject*)closure->upvalues[i]);
-            }
-            break;
-        }
-        case OBJ_FUNCTION:{
-            LoxObjFunction* function = (LoxObjFunction*)object;
-            markObject((LoxObject*)function->name);
-            markArray(&function->chunk.constants);
-            break;
-        }
-        case OBJ_INSTANCE:{
-            LoxObjInstance* instance = (LoxObjInstance*)object;
-            markObject((LoxObject*)instance->klass);
-            markTable(&instance->fields);
-            break;
-        }
-        case OBJ_UPVALUE:
-            markValue(((LoxObjUpvalue*)object)->closed);
-            break;
-        case OBJ_NATIVE:
-        case OBJ_STRING:
-            break;
-        }
-}
-
-static void freeObject(LoxObject* object) {
-    #ifdef DEBUG_LOG_GC
-    printf("%p free type %d\n", (void*)object, object->type);
-    #endif
-
-    switch (object->type){
-        case OBJ_BOUND_METHOD:
-            FREE(LoxObjBoundMethod, object);
-            break;
-        case OBJ_CLASS:{
-            LoxObjClass* klass = (LoxObjClass*)object;
-            freeTable(&klass->methods);
-            FREE(LoxObjClass, object);
-            break;
-        } 
-        case OBJ_CLOSURE:{
-            LoxObjClosure* closure = (LoxObjClosure*)object;
-            FreeArr(LoxObjUpvalue*, closure->upvalues, closure->upvalueCount);
-            FREE(LoxObjClosure, object);
-            break;
-        }
-        case OBJ_FUNCTION:{
-            LoxObjFunction* function = (LoxObjFunction*)object;
-            freeChunk(&function->chunk);
-            FREE(LoxObjFunction, object);
-            break;
-        }
-        case OBJ_INSTANCE:{
-            LoxObjInstance* instance = (LoxObjInstance*)object;
-            freeTable(&instance->fields);
-            FREE(LoxObjInstance, object);
-            break;
-        }
-        case OBJ_NATIVE:
-            FREE(LoxObjNative, object);
-            break;
-        case OBJ_STRING:{
-            LoxObjString* string = (LoxObjString*)object;
-            FreeArr(char, string->chars, string->length + 1);
-            FREE(LoxObjString, object);
-            break;
-        }
-        case OBJ_UPVALUE:
-            FREE(LoxObjUpvalue, object);
-            break;
-    }
-}
-
-static void markRoots() {
-    for (LoxValue* slot = vm.stack; slot < vm.stackTop; slot++){
-        markValue(*slot);
-    }
-
-    for (int i = 0; i < vm.frameCount; i++){
-        markObject((LoxObject*)vm.frames[i].closure);
-    }
-
-    for (LoxObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next){
-        markObject((LoxObject*)upvalue);
-    }
-
-    markTable(&vm.globals);
-    markCompilerRoots();
-    markObject((LoxObject*)vm.initString);
-}
-
-static void traceReferences() {
-    while (vm.grayCount > 0) {
-        LoxObject* obj = vm.grayStack[--vm.grayCount];
-        blackenObject(obj);
-    }
-}
-
-static void sweep() {
-    LoxObject* prev = NULL;
-    LoxObject* obj = vm.objects;
-
-    while (obj != NULL) {
-        if (obj->isMarked) {
-            obj->isMarked = false;
-            prev = obj;
-            obj = obj->next;
-        } 
-        else {
-            LoxObject* unreached = obj;
-            obj = obj->next;
-            if (prev != NULL) {
-                prev->next = obj;
-            } 
-            else {
-                vm.objects = obj;
-            }
-
-            freeObject(unreached);
-        }
-    }
-}
-
-void collectGarbage() {
-    #ifdef DEBUG_LOG_GC
-    printf("-- gc begin\n");
-    size_t before = vm.bytesAllocated;
-    #endif
-
-
-    markRoots();
-    traceReferences();
-    tableRemoveWhite(&vm.strings);
-    sweep();
-
-
-    vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
-
-
-    #ifdef DEBUG_LOG_GC
-    printf("-- gc end\n");
-    printf("   collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
-    #endif
-}
-
-void freeObjects() {
-    LoxObject* obj = vm.objects;
-    while (obj != NULL) {
-        LoxObject* nextObj = obj->next;
-        freeObject(obj);
-        obj = nextObj;
-}
-
-    free(vm.grayStack);
-}
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "memory.h"
+#include "LoxVM.h"
+#ifdef DEBUG_LOG_GC
+#include "LoxDebugger.h"
+#endif
+#define GC_HEAP_GROW_FACTOR 2
+#define GC_NURSERY_SIZE (256 * 1024)
+//an incremental collection does one slice of work per this many bytes allocated
+#define GC_SLICE_BYTES (32 * 1024)
+//objects blackened or swept per slice unless LOX_GC_SLICE_BUDGET says otherwise
+#define GC_SLICE_BUDGET 1000
+//objects the marker thread blackens each time it takes the heap lock
+#define GC_MARK_BATCH 128
+//the large buffer space is not collected for until it holds at least this much
+#define GC_LARGE_SPACE_MIN (16 * 1024 * 1024)
+//compacting a heap of a few pages gains nothing
+#define GC_COMPACT_MIN_PAGES 8
+
+static void incrementalStep(LoxVM* vm);
+static void concurrentStep(LoxVM* vm, bool force);
+static void sweepBeforeAllocating(LoxVM* vm, size_t size);
+static void paceLazySweep(LoxVM* vm, size_t size);
+static double gcClock();
+static void recordPause(LoxVM* vm, double start);
+static void checkFragmentation(LoxVM* vm);
+static void* retryAllocation(LoxVM* vm, void* pointer, size_t newSize);
+static void* retryLargeAllocation(LoxVM* vm, void* pointer, size_t oldSize, size_t newSize);
+static void blackenObject(LoxVM* vm, LoxObject* object);
+
+//gray objects owned by one marking thread, the owner pushes and pops at the tail
+//while idle threads steal from the head
+typedef struct {
+    pthread_mutex_t lock;
+    LoxObject** items;
+    int head;
+    int count;
+    int capacity;
+} GcDeque;
+
+//vm is the one whose heap is being marked
+typedef struct {
+    LoxVM* vm;
+    GcDeque deque;
+    int index;
+    GcWorkerPool* pool;
+} GcWorker;
+
+//worker 0 is the thread that runs the collection, the rest wait for each new epoch
+struct GcWorkerPool {
+    int count;
+    GcWorker* workers;
+    pthread_t* threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    int epoch;
+    int finished;
+    bool shutdown;
+
+    atomic_int idle;
+};
+
+struct GcMarker {
+    GcWorker worker;
+    pthread_t thread;
+    //held by the marker while it blackens and by the program while it stores into the heap
+    pthread_mutex_t heapLock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int epoch;
+
+    atomic_bool done;
+    atomic_bool shutdown;
+};
+
+//set while a thread is taking part in a parallel or concurrent mark
+static _Thread_local GcWorker* gcWorker = NULL;
+
+
+static size_t heapInUse(LoxVM* vm) {
+    return vm->bytesAllocated + vm->largeBytesAllocated;
+}
+
+//where the next collection should start given what survived this one, the heap grows
+//by the growth factor but by no less and no more than the configured intervals,
+//and never past the heap limit if there is one
+static size_t nextCollectionAt(LoxVM* vm, size_t live) {
+    size_t interval = (size_t)(live * (vm->gcGrowthFactor - 1));
+    if (interval < vm->gcMinInterval) interval = vm->gcMinInterval;
+    if (interval > vm->gcMaxInterval) interval = vm->gcMaxInterval;
+
+    size_t next = live + interval;
+    if (vm->heapLimit > 0) {
+        size_t room = vm->heapLimit > vm->largeBytesAllocated ? vm->heapLimit - vm->largeBytesAllocated : 0;
+        if (next > room) next = room;
+    }
+    return next;
+}
+
+//the allocation goes ahead either way, the interpreter raises the error at its next safepoint
+static void checkHeapLimit(LoxVM* vm) {
+    if (vm->heapLimit > 0 && heapInUse(vm) > vm->heapLimit) vm->heapLimitExceeded = true;
+}
+
+//count a change in heap size, growing it is what gets the collector to run
+static void countAllocation(LoxVM* vm, size_t oldSize, size_t newSize) {
+    vm->bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize) vm->gcStats.totalAllocated += newSize - oldSize;
+    else vm->gcStats.totalFreed += oldSize - newSize;
+
+    //nothing is collected while the compiler runs
+    if (newSize > oldSize && !vm->gcSuppressed) {
+        vm->bytesSinceGC += newSize - oldSize;
+
+        #ifdef DEBUG_STRESS_GC
+        if (vm->gcMode == GC_GENERATIONAL) {
+            collectYoungGarbage(vm);
+        }
+        else if (vm->gcMode == GC_INCREMENTAL) {
+            incrementalStep(vm);
+        }
+        else if (vm->gcMode == GC_CONCURRENT) {
+            concurrentStep(vm, true);
+        }
+        else {
+            collectGarbage(vm);
+        }
+        #endif
+
+        if (vm->gcMode == GC_INCREMENTAL) {
+            if (vm->gcPhase != GC_PHASE_IDLE ? vm->bytesSinceGC > GC_SLICE_BYTES
+                                            : vm->bytesAllocated > vm->nextGC) {
+                incrementalStep(vm);
+            }
+        }
+        else if (vm->gcMode == GC_CONCURRENT) {
+            concurrentStep(vm, false);
+        }
+        else if (vm->bytesAllocated > vm->nextGC) {
+            //what is left of a lazy sweep may free enough to stay under the limit
+            if (vm->heap.unsweptCount > 0) {
+                double start = gcClock();
+                finishSweep(vm);
+                recordPause(vm, start);
+            }
+            if (vm->bytesAllocated > vm->nextGC) collectGarbage(vm);
+        }
+        else if (vm->gcMode == GC_GENERATIONAL && vm->bytesSinceGC > GC_NURSERY_SIZE) {
+            collectYoungGarbage(vm);
+        }
+        checkHeapLimit(vm);
+    }
+}
+
+//run the collector for the large buffer space, a full collection in the stop-the-world
+//modes, otherwise a new cycle is started if none is under way
+static void collectLargeBuffers(LoxVM* vm) {
+    if (vm->gcMode == GC_INCREMENTAL) {
+        if (vm->gcPhase == GC_PHASE_IDLE) incrementalStep(vm);
+    }
+    else if (vm->gcMode == GC_CONCURRENT) {
+        if (vm->gcPhase == GC_PHASE_IDLE) concurrentStep(vm, true);
+    }
+    else {
+        collectGarbage(vm);
+    }
+}
+
+//large buffers have a limit of their own, so a few huge strings neither push
+//collections of small objects far apart nor bring them on too often
+static void countLargeAllocation(LoxVM* vm, size_t oldSize, size_t newSize) {
+    vm->largeBytesAllocated += newSize - oldSize;
+    if (newSize > oldSize) vm->gcStats.totalAllocated += newSize - oldSize;
+    else vm->gcStats.totalFreed += oldSize - newSize;
+    if (newSize <= oldSize || vm->gcSuppressed) return;
+
+    #ifdef DEBUG_STRESS_GC
+    collectLargeBuffers(vm);
+    #endif
+
+    if (vm->largeBytesAllocated > vm->nextLargeGC) collectLargeBuffers(vm);
+    checkHeapLimit(vm);
+}
+
+static void setLargeLimit(LoxVM* vm) {
+    vm->nextLargeGC = (size_t)(vm->largeBytesAllocated * vm->gcGrowthFactor);
+    if (vm->nextLargeGC < GC_LARGE_SPACE_MIN) vm->nextLargeGC = GC_LARGE_SPACE_MIN;
+}
+
+//a buffer lives in malloc while it is small and in a mapping of its own once it is
+//HEAP_LARGE_BUFFER or more, so one crossing the threshold is copied over
+static void* reallocateLarge(LoxVM* vm, void* pointer, size_t oldSize, size_t newSize) {
+    bool wasLarge = oldSize >= HEAP_LARGE_BUFFER;
+    bool isLarge = newSize >= HEAP_LARGE_BUFFER;
+    if (wasLarge) countLargeAllocation(vm, oldSize, isLarge ? newSize : 0);
+    else countAllocation(vm, oldSize, 0);
+    if (isLarge) {
+        if (!wasLarge) countLargeAllocation(vm, 0, newSize);
+    }
+    else {
+        countAllocation(vm, 0, newSize);
+    }
+
+    if (newSize == 0) {
+        heapUnmapBuffer(pointer, oldSize);
+        return NULL;
+    }
+    if (wasLarge && isLarge) {
+        void* result = heapRemapBuffer(pointer, oldSize, newSize);
+        if (result == NULL) result = retryLargeAllocation(vm, pointer, oldSize, newSize);
+        return result;
+    }
+
+    void* result = isLarge ? heapMapBuffer(newSize) : malloc(newSize);
+    if (result == NULL) {
+        result = isLarge ? retryLargeAllocation(vm, NULL, 0, newSize) : retryAllocation(vm, NULL, newSize);
+    }
+    if (oldSize > 0) {
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        if (wasLarge) heapUnmapBuffer(pointer, oldSize);
+        else free(pointer);
+    }
+    return result;
+}
+
+void* reallocate(LoxVM* vm, void* pointer, size_t oldSize, size_t newSize) {
+    if (oldSize >= HEAP_LARGE_BUFFER || newSize >= HEAP_LARGE_BUFFER) {
+        return reallocateLarge(vm, pointer, oldSize, newSize);
+    }
+
+    countAllocation(vm, oldSize, newSize);
+
+    if (newSize == 0) {
+        free(pointer);
+        return NULL;
+    }
+
+    void* result = realloc(pointer, newSize);
+    if (result == NULL) result = retryAllocation(vm, pointer, newSize);
+    return result;
+}
+
+//the system is out of memory, what a full collection frees may be enough to go on,
+//unless a heap store is in progress and the concurrent collector cannot finish
+static void collectForRetry(LoxVM* vm) {
+    if (!vm->gcSuppressed && (vm->gcMode != GC_CONCURRENT || vm->heapLocks == 0)) {
+        collectGarbage(vm);
+        finishSweep(vm);
+        #ifdef __GLIBC__
+        malloc_trim(0);
+        #endif
+    }
+}
+
+static void outOfMemory(size_t newSize) {
+    fprintf(stderr, "Out of memory allocating %zu bytes.\n", newSize);
+    exit(1);
+}
+
+static void* retryAllocation(LoxVM* vm, void* pointer, size_t newSize) {
+    collectForRetry(vm);
+    void* result = realloc(pointer, newSize);
+    if (result == NULL) outOfMemory(newSize);
+    return result;
+}
+
+//the same for a large buffer, which has to be mapped or remapped again instead
+static void* retryLargeAllocation(LoxVM* vm, void* pointer, size_t oldSize, size_t newSize) {
+    collectForRetry(vm);
+    void* result = pointer != NULL ? heapRemapBuffer(pointer, oldSize, newSize) : heapMapBuffer(newSize);
+    if (result == NULL) outOfMemory(newSize);
+    return result;
+}
+
+//the same for an object, the collection may empty a page of its size class or give back
+//pages so the heap can get a new one
+static void* retryObjectAllocation(LoxVM* vm, size_t size) {
+    collectForRetry(vm);
+    void* result = heapAllocate(&vm->heap, size);
+    if (result == NULL) outOfMemory(size);
+    return result;
+}
+
+//at a safepoint the interpreter gives a heap over its limit one full collection to get back
+//under it, false if it is still over and the program has to stop with a runtime error
+bool enforceHeapLimit(LoxVM* vm) {
+    vm->heapLimitExceeded = false;
+    collectGarbage(vm);
+    finishSweep(vm);
+    return heapInUse(vm) <= vm->heapLimit;
+}
+
+//objects themselves come from the size-class heap rather than straight from malloc
+void* allocateObjectMemory(LoxVM* vm, size_t size, ObjType type) {
+    vm->gcStats.liveObjects[type]++;
+    vm->gcStats.liveBytes[type] += size;
+    vm->gcStats.youngObjects++;
+    countAllocation(vm, 0, size);
+    if (vm->heap.unsweptCount > 0) {
+        sweepBeforeAllocating(vm, size);
+        paceLazySweep(vm, size);
+    }
+    void* result = heapAllocate(&vm->heap, size);
+    if (result == NULL) result = retryObjectAllocation(vm, size);
+    return result;
+}
+
+void freeObjectMemory(LoxVM* vm, void* pointer, size_t size) {
+    ObjType type = ((LoxObject*)pointer)->type;
+    vm->gcStats.liveObjects[type]--;
+    vm->gcStats.liveBytes[type] -= size;
+    vm->gcStats.objectsFreed++;
+    countAllocation(vm, size, 0);
+    heapFree(&vm->heap, pointer, size);
+}
+
+static void pushGray(LoxVM* vm, LoxObject* object) {
+    if (vm->grayCapacity < vm->grayCount + 1) {
+        vm->grayCapacity = GrowCap(vm->grayCapacity);
+        vm->grayStack = (LoxObject**)realloc(vm->grayStack, sizeof(LoxObject*) * vm->grayCapacity);
+
+        if (vm->grayStack == NULL) exit(1);
+    }
+
+    vm->grayStack[vm->grayCount++] = object;
+}
+
+static void dequePush(GcDeque* deque, LoxObject* object);
+
+void markObject(LoxVM* vm, LoxObject* object){
+    if (object == NULL) return;
+    if (heapIsMarked(object)) return;
+
+    if (gcWorker != NULL || vm->gcConcurrentMark) {
+        //other markers may reach the same object, only the one that sets the bit traces it
+        if (!heapTryMark(object)) return;
+        dequePush(gcWorker != NULL ? &gcWorker->deque : &vm->gcMarker->worker.deque, object);
+        return;
+    }
+
+    #ifdef DEBUG_LOG_GC
+    printf("%p mark ", (void*)object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+    #endif
+
+    heapSetMarked(object);
+    pushGray(vm, object);
+}
+
+//add an old object to the remembered set so the next minor collection traces it again
+//during incremental marking the object is grayed again instead, it may already be black
+void rememberObject(LoxVM* vm, LoxObject* object) {
+    if (vm->gcPhase == GC_PHASE_MARK) {
+        if (heapIsMarked(object)) pushGray(vm, object);
+        return;
+    }
+
+    if (vm->gcMode != GC_GENERATIONAL) return;
+    if (object->isRemembered || !heapIsMarked(object)) return;
+
+    object->isRemembered = true;
+
+    if (vm->rememberedCapacity < vm->rememberedCount + 1) {
+        vm->rememberedCapacity = GrowCap(vm->rememberedCapacity);
+        vm->remembered = (LoxObject**)realloc(vm->remembered, sizeof(LoxObject*) * vm->rememberedCapacity);
+
+        if (vm->remembered == NULL) exit(1);
+    }
+
+    vm->remembered[vm->rememberedCount++] = object;
+}
+
+void markValue(LoxVM* vm, LoxValue value) {
+    if (IS_OBJ(value)) markObject(vm, AS_OBJ(value));
+}
+
+static void markArray(LoxVM* vm, LoxValueArray* array) {
+    for (int i = 0; i < array->count; i++) {
+        markValue(vm, array->values[i]);
+    }
+}
+
+//what a fiber that is not running holds on its stack, in its frames and in its open upvalues,
+//the running fiber's are in the VM and marked as roots instead
+void markFiber(LoxVM* vm, LoxObjFiber* fiber) {
+    for (LoxValue* slot = fiber->stack; slot < fiber->stackTop; slot++) {
+        markValue(vm, *slot);
+    }
+
+    for (int i = 0; i < fiber->frameCount; i++) {
+        markObject(vm, (LoxObject*)fiber->frames[i].closure);
+    }
+
+    for (LoxObjUpvalue* upvalue = fiber->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+        markObject(vm, (LoxObject*)upvalue);
+    }
+}
+
+static void blackenObject(LoxVM* vm, LoxObject* object){
+    #ifdef DEBUG_LOG_GC
+    printf("%p blacken ", (void*)object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+    #endif
+
+    switch (object->type){
+        case OBJ_BOUND_METHOD:{
+            LoxObjBoundMethod* bound = (LoxObjBoundMethod*)object;
+            markValue(vm, bound->receiver);
+            markObject(vm, (LoxObject*)bound->method);
+            break;
+        }
+        case OBJ_CLASS:{
+            LoxObjClass* klass = (LoxObjClass*)object;
+            markObject(vm, (LoxObject*)klass->name);
+            markTable(vm, &klass->methods);
+            break;
+        }
+        case OBJ_CLOSURE:{
+            LoxObjClosure* closure = (LoxObjClosure*)object;
+            markObject(vm, (LoxObject*)closure->function);
+            for (int i = 0; i < closure->upvalueCount; i++) {
+            markObject(vm, (LoxObject*)closure->upvalues[i]);
+            }
+            break;
+        }
+        case OBJ_FIBER:{
+            LoxObjFiber* fiber = (LoxObjFiber*)object;
+            markObject(vm, (LoxObject*)fiber->closure);
+            markObject(vm, (LoxObject*)fiber->resumer);
+            if (fiber != vm->fiber) markFiber(vm, fiber);
+            break;
+        }
+        case OBJ_FUNCTION:{
+            LoxObjFunction* function = (LoxObjFunction*)object;
+            markObject(vm, (LoxObject*)function->name);
+            markArray(vm, &function->chunk.constants);
+            if (function->superCache != NULL) {
+                for (int i = 0; i < function->chunk.constants.count; i++) {
+                    markObject(vm, (LoxObject*)function->superCache[i].klass);
+                    markObject(vm, (LoxObject*)function->superCache[i].method);
+                }
+            }
+            break;
+        }
+        case OBJ_INSTANCE:{
+            LoxObjInstance* instance = (LoxObjInstance*)object;
+            markObject(vm, (LoxObject*)instance->klass);
+            markTable(vm, &instance->fields);
+            break;
+        }
+        case OBJ_UPVALUE:
+            markValue(vm, ((LoxObjUpvalue*)object)->closed);
+            break;
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+            break;
+        }
+}
+
+static void freeObject(LoxVM* vm, LoxObject* object) {
+    #ifdef DEBUG_LOG_GC
+    printf("%p free type %d\n", (void*)object, object->type);
+    #endif
+
+    switch (object->type){
+        case OBJ_BOUND_METHOD:
+            FREE_OBJ(vm, LoxObjBoundMethod, object);
+            break;
+        case OBJ_CLASS:{
+            LoxObjClass* klass = (LoxObjClass*)object;
+            freeTable(vm, &klass->methods);
+            freeFrozenTable(vm, &klass->frozenMethods);
+            FreeArr(vm, LoxObjClosure*, klass->vtable, klass->vtableSize);
+            FREE_OBJ(vm, LoxObjClass, object);
+            break;
+        } 
+        case OBJ_CLOSURE:{
+            LoxObjClosure* closure = (LoxObjClosure*)object;
+            FreeArr(vm, LoxObjUpvalue*, closure->upvalues, closure->upvalueCount);
+            FREE_OBJ(vm, LoxObjClosure, object);
+            break;
+        }
+        case OBJ_FIBER:{
+            LoxObjFiber* fiber = (LoxObjFiber*)object;
+            FreeArr(vm, LoxValue, fiber->stack, fiber->stackCapacity);
+            FreeArr(vm, LoxCallFrame, fiber->frames, fiber->frameCapacity);
+            FREE_OBJ(vm, LoxObjFiber, object);
+            break;
+        }
+        case OBJ_FUNCTION:{
+            LoxObjFunction* function = (LoxObjFunction*)object;
+            FreeArr(vm, LoxSuperCache, function->superCache, function->chunk.constants.count);
+            freeChunk(vm, &function->chunk);
+            FREE_OBJ(vm, LoxObjFunction, object);
+            break;
+        }
+        case OBJ_INSTANCE:{
+            LoxObjInstance* instance = (LoxObjInstance*)object;
+            freeTable(vm, &instance->fields);
+            FREE_OBJ(vm, LoxObjInstance, object);
+            break;
+        }
+        case OBJ_NATIVE:
+            FREE_OBJ(vm, LoxObjNative, object);
+            break;
+        case OBJ_STRING:{
+            LoxObjString* string = (LoxObjString*)object;
+            FreeArr(vm, char, string->chars, string->length + 1);
+            FREE_OBJ(vm, LoxObjString, object);
+            break;
+        }
+        case OBJ_UPVALUE:
+            FREE_OBJ(vm, LoxObjUpvalue, object);
+            break;
+    }
+}
+
+static void markRoots(LoxVM* vm) {
+    for (LoxValue* slot = vm->stack; slot < vm->stackTop; slot++){
+        markValue(vm, *slot);
+    }
+
+    for (int i = 0; i < vm->frameCount; i++){
+        markObject(vm, (LoxObject*)vm->frames[i].closure);
+    }
+
+    for (LoxObjUpvalue* upvalue = vm->openUpvalues; upvalue != NULL; upvalue = upvalue->next){
+        markObject(vm, (LoxObject*)upvalue);
+    }
+
+    markObject(vm, (LoxObject*)vm->fiber);
+    markObject(vm, (LoxObject*)vm->mainFiber);
+    for (int i = 0; i < vm->fiberQueueCount; i++) {
+        markObject(vm, (LoxObject*)vm->fiberQueue[(vm->fiberQueueHead + i) % vm->fiberQueueCapacity]);
+    }
+    markEventLoop(vm, &vm->loop);
+
+    markTable(vm, &vm->globals);
+    markObject(vm, (LoxObject*)vm->initString);
+    for (int i = 0; i < vm->selectorCount; i++) {
+        markObject(vm, (LoxObject*)vm->selectorNames[i]);
+    }
+}
+
+static void traceReferencesParallel(LoxVM* vm);
+
+static void traceReferences(LoxVM* vm) {
+    if (vm->gcPool != NULL) {
+        traceReferencesParallel(vm);
+        return;
+    }
+
+    while (vm->grayCount > 0) {
+        LoxObject* obj = vm->grayStack[--vm->grayCount];
+        blackenObject(vm, obj);
+    }
+}
+
+static void clearRemembered(LoxVM* vm) {
+    for (int i = 0; i < vm->rememberedCount; i++) {
+        vm->remembered[i]->isRemembered = false;
+    }
+    vm->rememberedCount = 0;
+}
+
+static void traceRemembered(LoxVM* vm) {
+    for (int i = 0; i < vm->rememberedCount; i++) {
+        blackenObject(vm, vm->remembered[i]);
+    }
+    traceReferences(vm);
+}
+
+//drop the interned strings that were not marked and shrink the table if most of it is now empty,
+//the new entries are allocated in the middle of a collection, which must not start another one
+static void removeWhiteStrings(LoxVM* vm) {
+    tableRemoveWhite(vm, &vm->strings);
+
+    bool suppressed = vm->gcSuppressed;
+    vm->gcSuppressed = true;
+    tableShrink(vm, &vm->strings);
+    vm->gcSuppressed = suppressed;
+}
+
+//free every object on the page that is allocated but unmarked, a word of the bitmaps at a time
+//marks are left alone, they are cleared all at once when the next full marking starts
+static int sweepPage(LoxVM* vm, HeapPage* page) {
+    size_t before = vm->bytesAllocated;
+    int freed = 0;
+    for (int i = 0; i < HEAP_PAGE_WORDS; i++) {
+        uint64_t dead = page->allocBits[i] & ~page->markBits[i];
+        while (dead != 0) {
+            int bit = __builtin_ctzll(dead);
+            dead &= dead - 1;
+            freeObject(vm, (LoxObject*)heapCellAt(page, (size_t)i * 64 + bit));
+            freed++;
+        }
+    }
+    page->hasYoung = false;
+
+    //the limit set by a lazy collection counted this page's garbage as live
+    if (page->needsSweep) {
+        heapPageSwept(&vm->heap, page);
+        size_t drop = (size_t)((before - vm->bytesAllocated) * vm->gcGrowthFactor);
+        vm->nextGC = vm->nextGC > drop ? vm->nextGC - drop : 0;
+    }
+    return freed;
+}
+
+//marks stick between collections, so an unmarked object is one allocated since the last
+//collection that did not survive, and for a minor collection only pages allocated into are visited
+static void sweep(LoxVM* vm, bool youngOnly) {
+    for (HeapPage* page = heapFirstPage(&vm->heap); page != NULL; page = heapNextPage(&vm->heap, page)) {
+        if (youngOnly && !page->hasYoung) continue;
+        sweepPage(vm, page);
+    }
+    heapReleaseEmptyPages(&vm->heap);
+}
+
+//end a full collection without sweeping, each page is swept when the allocator next wants
+//a cell from it, so the pause depends on the live data and not on the size of the heap
+//large objects are few and hold the most memory, so they are still swept right away
+static void deferSweep(LoxVM* vm) {
+    for (HeapPage* page = heapFirstPage(&vm->heap); page != NULL; page = heapNextPage(&vm->heap, page)) {
+        if (page->sizeClass == HEAP_LARGE_CLASS) sweepPage(vm, page);
+        else heapDeferSweep(&vm->heap, page);
+    }
+    heapReleaseEmptyPages(&vm->heap);
+    vm->sweepCredit = 0;
+}
+
+static void sweepBeforeAllocating(LoxVM* vm, size_t size) {
+    HeapPage* page;
+    while ((page = heapUnsweptFor(&vm->heap, size)) != NULL) {
+        sweepPage(vm, page);
+    }
+}
+
+//also sweep pages no allocation has asked for yet, one for each share of the room left
+//before the next collection, so the sweep is normally over by halfway there
+static void paceLazySweep(LoxVM* vm, size_t size) {
+    vm->sweepCredit += size;
+    while (vm->heap.unsweptCount > 0) {
+        size_t room = vm->nextGC > vm->bytesAllocated ? vm->nextGC - vm->bytesAllocated : 0;
+        size_t share = room / vm->heap.unsweptCount / 2;
+        if (vm->sweepCredit < share) return;
+
+        HeapPage* page = heapTakeUnswept(&vm->heap);
+        if (page == NULL) return;
+        vm->sweepCredit -= share;
+        sweepPage(vm, page);
+    }
+}
+
+//sweep every page a lazy collection left behind
+void finishSweep(LoxVM* vm) {
+    HeapPage* page;
+    while ((page = heapTakeUnswept(&vm->heap)) != NULL) {
+        sweepPage(vm, page);
+    }
+    heapReleaseEmptyPages(&vm->heap);
+}
+
+static void initDeque(GcDeque* deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->items = NULL;
+    deque->head = 0;
+    deque->count = 0;
+    deque->capacity = 0;
+}
+
+static void dequePush(GcDeque* deque, LoxObject* object) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->capacity < deque->count + 1) {
+        int capacity = GrowCap(deque->capacity);
+        LoxObject** items = (LoxObject**)malloc(sizeof(LoxObject*) * capacity);
+        if (items == NULL) exit(1);
+
+        for (int i = 0; i < deque->count; i++) {
+            items[i] = deque->items[(deque->head + i) % deque->capacity];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+
+    deque->items[(deque->head + deque->count) % deque->capacity] = object;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static LoxObject* dequePop(GcDeque* deque) {
+    LoxObject* object = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        object = deque->items[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return object;
+}
+
+static LoxObject* dequeSteal(GcDeque* deque) {
+    LoxObject* object = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        object = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return object;
+}
+
+static LoxObject* stealWork(GcWorker* self) {
+    GcWorkerPool* pool = self->pool;
+    for (int i = 1; i < pool->count; i++) {
+        GcWorker* victim = &pool->workers[(self->index + i) % pool->count];
+        LoxObject* object = dequeSteal(&victim->deque);
+        if (object != NULL) return object;
+    }
+    return NULL;
+}
+
+static bool hasWork(GcWorkerPool* pool) {
+    for (int i = 0; i < pool->count; i++) {
+        GcDeque* deque = &pool->workers[i].deque;
+        pthread_mutex_lock(&deque->lock);
+        int count = deque->count;
+        pthread_mutex_unlock(&deque->lock);
+        if (count > 0) return true;
+    }
+    return false;
+}
+
+//drain this worker's deque, then steal, until every worker has run dry
+//a worker only goes idle with an empty deque and idle workers never push,
+//so once all of them are idle no gray object is left anywhere
+static void parallelMark(LoxVM* vm, GcWorker* self) {
+    GcWorkerPool* pool = self->pool;
+    gcWorker = self;
+
+    for (;;) {
+        LoxObject* object = dequePop(&self->deque);
+        if (object == NULL) object = stealWork(self);
+        if (object != NULL) {
+            blackenObject(vm, object);
+            continue;
+        }
+
+        atomic_fetch_add(&pool->idle, 1);
+        for (;;) {
+            if (atomic_load(&pool->idle) == pool->count) {
+                gcWorker = NULL;
+                return;
+            }
+            if (hasWork(pool)) {
+                atomic_fetch_sub(&pool->idle, 1);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void* gcWorkerMain(void* arg) {
+    GcWorker* self = (GcWorker*)arg;
+    GcWorkerPool* pool = self->pool;
+    LoxVM* vm = self->vm;
+    int seenEpoch = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->epoch == seenEpoch && !pool->shutdown) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seenEpoch = pool->epoch;
+        pthread_mutex_unlock(&pool->lock);
+
+        parallelMark(vm, self);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finished++;
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void startWorkerPool(LoxVM* vm, int count) {
+    GcWorkerPool* pool = (GcWorkerPool*)malloc(sizeof(GcWorkerPool));
+    if (pool == NULL) exit(1);
+
+    pool->count = count;
+    pool->workers = (GcWorker*)malloc(sizeof(GcWorker) * count);
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * count);
+    if (pool->workers == NULL || pool->threads == NULL) exit(1);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->epoch = 0;
+    pool->finished = 0;
+    pool->shutdown = false;
+    atomic_init(&pool->idle, 0);
+
+    for (int i = 0; i < count; i++) {
+        initDeque(&pool->workers[i].deque);
+        pool->workers[i].vm = vm;
+        pool->workers[i].index = i;
+        pool->workers[i].pool = pool;
+    }
+    for (int i = 1; i < count; i++) {
+        pthread_create(&pool->threads[i], NULL, gcWorkerMain, &pool->workers[i]);
+    }
+
+    vm->gcPool = pool;
+}
+
+static void stopWorkerPool(LoxVM* vm) {
+    GcWorkerPool* pool = vm->gcPool;
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        pthread_mutex_destroy(&pool->workers[i].deque.lock);
+        free(pool->workers[i].deque.items);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+    vm->gcPool = NULL;
+}
+
+//deal the gray roots out across the workers and mark with all of them
+static void traceReferencesParallel(LoxVM* vm) {
+    GcWorkerPool* pool = vm->gcPool;
+
+    for (int i = 0; i < vm->grayCount; i++) {
+        dequePush(&pool->workers[i % pool->count].deque, vm->grayStack[i]);
+    }
+    vm->grayCount = 0;
+    atomic_store(&pool->idle, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = 0;
+    pool->epoch++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    parallelMark(vm, &pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finished < pool->count - 1) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//trace from the marker's deque until it runs dry, in batches so stores are not held up long
+static void concurrentMark(LoxVM* vm, GcMarker* marker) {
+    for (;;) {
+        LoxObject* object = NULL;
+        pthread_mutex_lock(&marker->heapLock);
+        for (int i = 0; i < GC_MARK_BATCH; i++) {
+            object = dequePop(&marker->worker.deque);
+            if (object == NULL) break;
+            blackenObject(vm, object);
+        }
+        pthread_mutex_unlock(&marker->heapLock);
+
+        if (object == NULL || atomic_load(&marker->shutdown)) return;
+    }
+}
+
+static void* gcMarkerMain(void* arg) {
+    GcMarker* marker = (GcMarker*)arg;
+    LoxVM* vm = marker->worker.vm;
+    gcWorker = &marker->worker;
+    int seenEpoch = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&marker->lock);
+        while (marker->epoch == seenEpoch && !atomic_load(&marker->shutdown)) {
+            pthread_cond_wait(&marker->wake, &marker->lock);
+        }
+        seenEpoch = marker->epoch;
+        pthread_mutex_unlock(&marker->lock);
+        if (atomic_load(&marker->shutdown)) break;
+
+        concurrentMark(vm, marker);
+        atomic_store(&marker->done, true);
+    }
+    return NULL;
+}
+
+static void startMarker(LoxVM* vm) {
+    GcMarker* marker = (GcMarker*)malloc(sizeof(GcMarker));
+    if (marker == NULL) exit(1);
+
+    initDeque(&marker->worker.deque);
+    marker->worker.vm = vm;
+    marker->worker.index = 0;
+    marker->worker.pool = NULL;
+    pthread_mutex_init(&marker->heapLock, NULL);
+    pthread_mutex_init(&marker->lock, NULL);
+    pthread_cond_init(&marker->wake, NULL);
+    marker->epoch = 0;
+    atomic_init(&marker->done, true);
+    atomic_init(&marker->shutdown, false);
+
+    pthread_create(&marker->thread, NULL, gcMarkerMain, marker);
+    vm->gcMarker = marker;
+}
+
+static void stopMarker(LoxVM* vm) {
+    GcMarker* marker = vm->gcMarker;
+    if (marker == NULL) return;
+
+    pthread_mutex_lock(&marker->lock);
+    atomic_store(&marker->shutdown, true);
+    pthread_cond_signal(&marker->wake);
+    pthread_mutex_unlock(&marker->lock);
+    pthread_join(marker->thread, NULL);
+
+    pthread_mutex_destroy(&marker->worker.deque.lock);
+    free(marker->worker.deque.items);
+    pthread_mutex_destroy(&marker->heapLock);
+    pthread_mutex_destroy(&marker->lock);
+    pthread_cond_destroy(&marker->wake);
+    free(marker);
+    vm->gcMarker = NULL;
+    vm->gcConcurrentMark = false;
+}
+
+void acquireHeap(LoxVM* vm) {
+    pthread_mutex_lock(&vm->gcMarker->heapLock);
+}
+
+void releaseHeap(LoxVM* vm) {
+    pthread_mutex_unlock(&vm->gcMarker->heapLock);
+}
+
+static double gcClock() {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void recordPause(LoxVM* vm, double start) {
+    double pause = gcClock() - start;
+    vm->gcPauseTotal += pause;
+    if (pause > vm->gcPauseMax) vm->gcPauseMax = pause;
+
+    int bucket = 0;
+    double limit = 1e-6;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && pause >= limit) {
+        bucket++;
+        limit *= 2;
+    }
+    vm->gcPauseHistogram[bucket]++;
+}
+
+//blacken at most budget gray objects, true once the gray stack is empty
+static bool markStep(LoxVM* vm, int budget) {
+    while (vm->grayCount > 0 && budget-- > 0) {
+        LoxObject* obj = vm->grayStack[--vm->grayCount];
+        blackenObject(vm, obj);
+    }
+    return vm->grayCount == 0;
+}
+
+//stack slots and globals have no write barrier, so marking ends by
+//rescanning the roots in one short pause before sweeping can start
+static void finishMarking(LoxVM* vm) {
+    markRoots(vm);
+    traceReferences(vm);
+    removeWhiteStrings(vm);
+
+    //pages added from here on only hold black objects, so it does not matter if they are missed
+    vm->sweepPage = heapFirstPage(&vm->heap);
+    vm->gcPhase = GC_PHASE_SWEEP;
+}
+
+//sweep whole pages until roughly budget objects are freed, true once every page is swept
+static bool sweepStep(LoxVM* vm, int budget) {
+    while (budget > 0 && vm->sweepPage != NULL) {
+        budget -= 1 + sweepPage(vm, vm->sweepPage);
+        vm->sweepPage = heapNextPage(&vm->heap, vm->sweepPage);
+    }
+
+    if (vm->sweepPage != NULL) return false;
+    heapReleaseEmptyPages(&vm->heap);
+    return true;
+}
+
+static void incrementalSlice(LoxVM* vm, int budget) {
+    switch (vm->gcPhase) {
+        case GC_PHASE_IDLE:
+            #ifdef DEBUG_LOG_GC
+            printf("-- incremental gc begin\n");
+            #endif
+            heapClearMarks(&vm->heap);
+            vm->gcPhase = GC_PHASE_MARK;
+            markRoots(vm);
+            break;
+        case GC_PHASE_MARK:
+            if (markStep(vm, budget)) finishMarking(vm);
+            break;
+        case GC_PHASE_SWEEP:
+            if (sweepStep(vm, budget)) {
+                vm->gcPhase = GC_PHASE_IDLE;
+                vm->nextGC = nextCollectionAt(vm, vm->bytesAllocated);
+                setLargeLimit(vm);
+                vm->gcStats.collections++;
+                vm->gcStats.youngObjects = 0;
+                checkFragmentation(vm);
+                #ifdef DEBUG_LOG_GC
+                printf("-- incremental gc end, next at %zu\n", vm->nextGC);
+                #endif
+            }
+            break;
+    }
+}
+
+//one bounded slice of an incremental collection, run from the allocator
+static void incrementalStep(LoxVM* vm) {
+    double start = gcClock();
+    incrementalSlice(vm, vm->gcSliceBudget);
+    vm->bytesSinceGC = 0;
+    recordPause(vm, start);
+}
+
+//gray the roots and hand them to the marker thread, the program keeps running while it traces
+static void startConcurrentMark(LoxVM* vm) {
+    #ifdef DEBUG_LOG_GC
+    printf("-- concurrent gc begin\n");
+    #endif
+
+    GcMarker* marker = vm->gcMarker;
+    heapClearMarks(&vm->heap);
+    vm->gcPhase = GC_PHASE_MARK;
+    vm->gcConcurrentMark = true;
+    atomic_store(&marker->done, false);
+    markRoots(vm);
+
+    pthread_mutex_lock(&marker->lock);
+    marker->epoch++;
+    pthread_cond_signal(&marker->wake);
+    pthread_mutex_unlock(&marker->lock);
+}
+
+//once the marker is done, whatever the barrier shaded since and the roots are traced
+//here in a short pause, then the heap is swept in slices as for incremental mode
+static void finishConcurrentMark(LoxVM* vm) {
+    while (!atomic_load(&vm->gcMarker->done)) sched_yield();
+
+    vm->gcConcurrentMark = false;
+    LoxObject* object;
+    while ((object = dequePop(&vm->gcMarker->worker.deque)) != NULL) {
+        pushGray(vm, object);
+    }
+    finishMarking(vm);
+}
+
+//the allocator's part of a concurrent collection
+//force starts a cycle and sweeps without waiting for the thresholds, for stress testing
+static void concurrentStep(LoxVM* vm, bool force) {
+    //a heap store is in progress, the phase cannot change under it
+    if (vm->heapLocks > 0) return;
+
+    double start = gcClock();
+    switch (vm->gcPhase) {
+        case GC_PHASE_IDLE:
+            if (!force && vm->bytesAllocated <= vm->nextGC) return;
+            startConcurrentMark(vm);
+            break;
+        case GC_PHASE_MARK:
+            //the marker has fallen far behind the program, wait for it rather than grow the heap further
+            if (!atomic_load(&vm->gcMarker->done) &&
+                vm->bytesAllocated <= vm->nextGC * vm->gcGrowthFactor) return;
+            finishConcurrentMark(vm);
+            break;
+        case GC_PHASE_SWEEP:
+            if (!force && vm->bytesSinceGC <= GC_SLICE_BYTES) return;
+            incrementalSlice(vm, vm->gcSliceBudget);
+            break;
+    }
+    vm->bytesSinceGC = 0;
+    recordPause(vm, start);
+}
+
+void collectGarbage(LoxVM* vm) {
+    if (vm->gcMode == GC_INCREMENTAL || vm->gcMode == GC_CONCURRENT) {
+        //finish the cycle in progress, then run a whole new one without yielding
+        double start = gcClock();
+        if (vm->gcConcurrentMark) finishConcurrentMark(vm);
+        while (vm->gcPhase != GC_PHASE_IDLE) incrementalSlice(vm, INT_MAX);
+        do {
+            incrementalSlice(vm, INT_MAX);
+        } while (vm->gcPhase != GC_PHASE_IDLE);
+        vm->bytesSinceGC = 0;
+        recordPause(vm, start);
+        return;
+    }
+
+    #ifdef DEBUG_LOG_GC
+    printf("-- gc begin\n");
+    size_t before = vm->bytesAllocated;
+    #endif
+
+    double start = gcClock();
+    //the lazy sweep has to be over before its marks are thrown away
+    finishSweep(vm);
+    heapClearMarks(&vm->heap);
+    clearRemembered(vm);
+
+    markRoots(vm);
+    traceReferences(vm);
+    removeWhiteStrings(vm);
+    if (vm->gcLazySweep) {
+        deferSweep(vm);
+    }
+    else {
+        sweep(vm, false);
+    }
+
+
+    vm->nextGC = nextCollectionAt(vm, vm->bytesAllocated);
+    setLargeLimit(vm);
+    vm->gcStats.collections++;
+    vm->gcStats.youngObjects = 0;
+    vm->bytesSinceGC = 0;
+    recordPause(vm, start);
+    checkFragmentation(vm);
+
+    #ifdef DEBUG_LOG_GC
+    printf("-- gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm->bytesAllocated, before, vm->bytesAllocated, vm->nextGC);
+    #endif
+}
+
+//an object on a page being evacuated has left the address of its copy in its second word,
+//every object is at least two words in size so there is always room for it
+static LoxObject** forwardingSlot(LoxObject* object) {
+    return (LoxObject**)object + 1;
+}
+
+LoxObject* forwardObject(LoxObject* object) {
+    if (object == NULL || !heapPageOf(object)->evacuating) return object;
+    return *forwardingSlot(object);
+}
+
+LoxValue forwardValue(LoxValue value) {
+    if (!IS_OBJ(value)) return value;
+    return OBJ_VAL(forwardObject(AS_OBJ(value)));
+}
+
+#define FORWARD(type, pointer) ((pointer) = (type*)forwardObject((LoxObject*)(pointer)))
+
+//copy every object off the evacuating pages into free cells of the pages that stay,
+//the copy keeps the mark bit so the generational collector still sees it as old
+static void evacuate(LoxVM* vm) {
+    for (HeapPage* page = heapFirstPage(&vm->heap); page != NULL; page = heapNextPage(&vm->heap, page)) {
+        if (!page->evacuating) continue;
+
+        for (int i = 0; i < HEAP_PAGE_WORDS; i++) {
+            uint64_t live = page->allocBits[i];
+            while (live != 0) {
+                int bit = __builtin_ctzll(live);
+                live &= live - 1;
+                LoxObject* object = (LoxObject*)heapCellAt(page, (size_t)i * 64 + bit);
+                //the pages that stay were chosen to have a free cell for every object moved,
+                //so this never needs a new page and cannot fail
+                LoxObject* copy = (LoxObject*)heapAllocate(&vm->heap, page->cellSize);
+                memcpy(copy, object, page->cellSize);
+                if (heapIsMarked(object)) heapSetMarked(copy);
+                //a closed upvalue points at its own closed field, which moved along with it
+                if (object->type == OBJ_UPVALUE) {
+                    LoxObjUpvalue* upvalue = (LoxObjUpvalue*)object;
+                    if (upvalue->location == &upvalue->closed) {
+                        ((LoxObjUpvalue*)copy)->location = &((LoxObjUpvalue*)copy)->closed;
+                    }
+                }
+                *forwardingSlot(object) = copy;
+            }
+        }
+    }
+}
+
+//the references an object holds, the same ones blackenObject follows
+static void forwardFields(LoxVM* vm, LoxObject* object) {
+    switch (object->type) {
+        case OBJ_BOUND_METHOD:{
+            LoxObjBoundMethod* bound = (LoxObjBoundMethod*)object;
+            bound->receiver = forwardValue(bound->receiver);
+            FORWARD(LoxObjClosure, bound->method);
+            break;
+        }
+        case OBJ_CLASS:{
+            LoxObjClass* klass = (LoxObjClass*)object;
+            FORWARD(LoxObjString, klass->name);
+            forwardTable(&klass->methods);
+            forwardFrozenTable(&klass->frozenMethods);
+            for (int i = 0; i < klass->vtableSize; i++) {
+                FORWARD(LoxObjClosure, klass->vtable[i]);
+            }
+            FORWARD(LoxObjClosure, klass->initializer);
+            break;
+        }
+        case OBJ_CLOSURE:{
+            LoxObjClosure* closure = (LoxObjClosure*)object;
+            FORWARD(LoxObjFunction, closure->function);
+            for (int i = 0; i < closure->upvalueCount; i++) {
+                FORWARD(LoxObjUpvalue, closure->upvalues[i]);
+            }
+            break;
+        }
+        case OBJ_FIBER:{
+            LoxObjFiber* fiber = (LoxObjFiber*)object;
+            FORWARD(LoxObjClosure, fiber->closure);
+            FORWARD(LoxObjFiber, fiber->resumer);
+            if (fiber == vm->fiber) break;
+            for (LoxValue* slot = fiber->stack; slot < fiber->stackTop; slot++) {
+                *slot = forwardValue(*slot);
+            }
+            for (int i = 0; i < fiber->frameCount; i++) {
+                FORWARD(LoxObjClosure, fiber->frames[i].closure);
+            }
+            FORWARD(LoxObjUpvalue, fiber->openUpvalues);
+            break;
+        }
+        case OBJ_FUNCTION:{
+            LoxObjFunction* function = (LoxObjFunction*)object;
+            FORWARD(LoxObjString, function->name);
+            LoxValueArray* constants = &function->chunk.constants;
+            for (int i = 0; i < constants->count; i++) {
+                constants->values[i] = forwardValue(constants->values[i]);
+            }
+            if (function->superCache != NULL) {
+                for (int i = 0; i < constants->count; i++) {
+                    FORWARD(LoxObjClass, function->superCache[i].klass);
+                    FORWARD(LoxObjClosure, function->superCache[i].method);
+                }
+            }
+            break;
+        }
+        case OBJ_INSTANCE:{
+            LoxObjInstance* instance = (LoxObjInstance*)object;
+            FORWARD(LoxObjClass, instance->klass);
+            forwardTable(&instance->fields);
+            break;
+        }
+        case OBJ_UPVALUE:{
+            LoxObjUpvalue* upvalue = (LoxObjUpvalue*)object;
+            upvalue->closed = forwardValue(upvalue->closed);
+            //a closed upvalue's next link is stale, the object it names may be long gone
+            if (upvalue->location != &upvalue->closed) FORWARD(LoxObjUpvalue, upvalue->next);
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+            break;
+    }
+}
+
+static void forwardRoots(LoxVM* vm) {
+    for (LoxValue* slot = vm->stack; slot < vm->stackTop; slot++) {
+        *slot = forwardValue(*slot);
+    }
+
+    for (int i = 0; i < vm->frameCount; i++) {
+        FORWARD(LoxObjClosure, vm->frames[i].closure);
+    }
+
+    FORWARD(LoxObjUpvalue, vm->openUpvalues);
+    FORWARD(LoxObjFiber, vm->fiber);
+    FORWARD(LoxObjFiber, vm->mainFiber);
+    for (int i = 0; i < vm->fiberQueueCount; i++) {
+        int index = (vm->fiberQueueHead + i) % vm->fiberQueueCapacity;
+        FORWARD(LoxObjFiber, vm->fiberQueue[index]);
+    }
+    forwardEventLoop(&vm->loop);
+    forwardTable(&vm->globals);
+    forwardTable(&vm->strings);
+    FORWARD(LoxObjString, vm->initString);
+    for (int i = 0; i < vm->selectorCount; i++) {
+        FORWARD(LoxObjString, vm->selectorNames[i]);
+    }
+
+    for (int i = 0; i < vm->rememberedCount; i++) {
+        vm->remembered[i] = forwardObject(vm->remembered[i]);
+    }
+}
+
+//a full collection, then the emptiest pages of each size class are emptied into the rest
+//and handed back, objects move so this only runs where the interpreter asks for it, between
+//instructions with every reference the program holds on the VM's stack or in the heap
+void compactHeap(LoxVM* vm) {
+    collectGarbage(vm);
+    //with the sweep over, every allocated cell holds a live object
+    finishSweep(vm);
+
+    double start = gcClock();
+    int pages = heapSelectEvacuation(&vm->heap);
+    if (pages > 0) {
+        evacuate(vm);
+        forwardRoots(vm);
+        for (HeapPage* page = heapFirstPage(&vm->heap); page != NULL; page = heapNextPage(&vm->heap, page)) {
+            if (page->evacuating) continue;
+            for (int i = 0; i < HEAP_PAGE_WORDS; i++) {
+                uint64_t live = page->allocBits[i];
+                while (live != 0) {
+                    int bit = __builtin_ctzll(live);
+                    live &= live - 1;
+                    forwardFields(vm, (LoxObject*)heapCellAt(page, (size_t)i * 64 + bit));
+                }
+            }
+        }
+        heapReleaseEvacuated(&vm->heap);
+        vm->gcStats.compactions++;
+        recordPause(vm, start);
+    }
+
+    #ifdef DEBUG_LOG_GC
+    printf("-- compacted %d pages, %d left\n", pages, vm->heap.pageCount);
+    #endif
+    vm->gcCompactRequested = false;
+}
+
+//after a full collection, ask for a compaction once the small object pages are mostly holes
+static void checkFragmentation(LoxVM* vm) {
+    if (vm->gcCompactThreshold <= 0 || vm->heap.pageCount < GC_COMPACT_MIN_PAGES) return;
+    if (heapOccupancy(&vm->heap) * 100 < vm->gcCompactThreshold) vm->gcCompactRequested = true;
+}
+
+//minor collection, roots and the remembered set are traced but old objects are never visited
+void collectYoungGarbage(LoxVM* vm) {
+    #ifdef DEBUG_LOG_GC
+    printf("-- minor gc begin\n");
+    size_t before = vm->bytesAllocated;
+    #endif
+
+    double start = gcClock();
+    long freedBefore = vm->gcStats.objectsFreed;
+    markRoots(vm);
+    traceRemembered(vm);
+    clearRemembered(vm);
+    removeWhiteStrings(vm);
+    sweep(vm, true);
+
+    //every young object is either freed or now marked, that is promoted to the old generation
+    long freed = vm->gcStats.objectsFreed - freedBefore;
+    vm->gcStats.minorCollections++;
+    vm->gcStats.minorCandidates += vm->gcStats.youngObjects;
+    vm->gcStats.promoted += vm->gcStats.youngObjects - freed;
+    vm->gcStats.youngObjects = 0;
+
+    vm->bytesSinceGC = 0;
+    recordPause(vm, start);
+
+    #ifdef DEBUG_LOG_GC
+    printf("-- minor gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu) next at %zu\n", before - vm->bytesAllocated, before, vm->bytesAllocated, vm->nextGC);
+    #endif
+}
+
+void freeObjects(LoxVM* vm) {
+    //the marker may still be tracing these
+    stopMarker(vm);
+    finishSweep(vm);
+    //with every mark cleared, sweeping frees everything
+    heapClearMarks(&vm->heap);
+    sweep(vm, false);
+
+    stopWorkerPool(vm);
+    free(vm->grayStack);
+    free(vm->remembered);
+    freeHeap(&vm->heap);
+}
+
+//a byte count with an optional K, M or G suffix
+static bool parseSize(const char* text, size_t* size) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0) return false;
+    switch (*end) {
+        case 'k': case 'K': value *= 1024; end++; break;
+        case 'm': case 'M': value *= 1024 * 1024; end++; break;
+        case 'g': case 'G': value *= 1024.0 * 1024 * 1024; end++; break;
+    }
+    if (*end != '\0') return false;
+    *size = (size_t)value;
+    return true;
+}
+
+//the collector's heap policy, set with --name=value on the command line or
+//through the environment variable listed next to each name
+static const char* gcOptionNames[][2] = {
+    {"gc-initial", "LOX_GC_INITIAL"},
+    {"gc-growth", "LOX_GC_GROWTH"},
+    {"gc-min-interval", "LOX_GC_MIN_INTERVAL"},
+    {"gc-max-interval", "LOX_GC_MAX_INTERVAL"},
+    {"heap-limit", "LOX_HEAP_LIMIT"},
+    {"gc-stats", "LOX_GC_STATS"},
+};
+
+//false if the option is unknown or its value makes no sense
+bool setGcOption(LoxVM* vm, const char* name, const char* value) {
+    if (strcmp(name, "gc-growth") == 0) {
+        char* end;
+        double factor = strtod(value, &end);
+        if (end == value || *end != '\0' || factor < 1) return false;
+        vm->gcGrowthFactor = factor;
+        return true;
+    }
+
+    if (strcmp(name, "gc-stats") == 0) {
+        vm->gcStatsPath = value;
+        return true;
+    }
+
+    size_t size;
+    if (!parseSize(value, &size)) return false;
+    if (strcmp(name, "gc-initial") == 0) vm->nextGC = size;
+    else if (strcmp(name, "gc-min-interval") == 0) vm->gcMinInterval = size;
+    else if (strcmp(name, "gc-max-interval") == 0) vm->gcMaxInterval = size;
+    else if (strcmp(name, "heap-limit") == 0) vm->heapLimit = size;
+    else return false;
+    return true;
+}
+
+//pick the collector and its tuning from the environment
+void configureGarbageCollector(LoxVM* vm) {
+    vm->gcGrowthFactor = GC_HEAP_GROW_FACTOR;
+    vm->gcMinInterval = 0;
+    vm->gcMaxInterval = SIZE_MAX;
+    vm->heapLimit = 0;
+    vm->heapLimitExceeded = false;
+    for (size_t i = 0; i < sizeof(gcOptionNames) / sizeof(gcOptionNames[0]); i++) {
+        const char* value = getenv(gcOptionNames[i][1]);
+        if (value != NULL && !setGcOption(vm, gcOptionNames[i][0], value)) {
+            fprintf(stderr, "Invalid %s '%s'.\n", gcOptionNames[i][1], value);
+        }
+    }
+
+    const char* mode = getenv("LOX_GC_MODE");
+    if (mode != NULL) {
+        if (strcmp(mode, "full") == 0) vm->gcMode = GC_FULL;
+        else if (strcmp(mode, "generational") == 0) vm->gcMode = GC_GENERATIONAL;
+        else if (strcmp(mode, "incremental") == 0) vm->gcMode = GC_INCREMENTAL;
+        else if (strcmp(mode, "concurrent") == 0) vm->gcMode = GC_CONCURRENT;
+        else fprintf(stderr, "Unknown LOX_GC_MODE '%s'.\n", mode);
+    }
+
+    vm->gcSliceBudget = GC_SLICE_BUDGET;
+    const char* budget = getenv("LOX_GC_SLICE_BUDGET");
+    if (budget != NULL && atoi(budget) > 0) vm->gcSliceBudget = atoi(budget);
+
+    //the flags are numbers like the other settings, so 0 or an empty value leaves them off
+    const char* pauses = getenv("LOX_GC_PAUSES");
+    vm->gcReportPauses = pauses != NULL && atoi(pauses) > 0;
+
+    //percentage of occupied cells below which a full collection asks for a compaction, off unless set
+    const char* compact = getenv("LOX_GC_COMPACT");
+    if (compact != NULL) vm->gcCompactThreshold = atoi(compact);
+
+    //only the stop-the-world modes sweep lazily, the others already sweep in slices
+    const char* lazySweep = getenv("LOX_GC_LAZY_SWEEP");
+    vm->gcLazySweep = lazySweep != NULL && atoi(lazySweep) > 0 &&
+                     (vm->gcMode == GC_FULL || vm->gcMode == GC_GENERATIONAL);
+
+    //marking stays on one thread unless asked, which keeps collections deterministic
+    vm->gcThreads = 1;
+    const char* threads = getenv("LOX_GC_THREADS");
+    if (threads != NULL && atoi(threads) > 0) vm->gcThreads = atoi(threads);
+    if (vm->gcThreads > 1) startWorkerPool(vm, vm->gcThreads);
+    if (vm->gcMode == GC_CONCURRENT) startMarker(vm);
+}
+
+void printGcPauses(LoxVM* vm) {
+    long count = 0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) count += vm->gcPauseHistogram[i];
+
+    fprintf(stderr, "gc pauses: %ld, total %.3f ms, max %.3f ms\n",
+            count, vm->gcPauseTotal * 1000, vm->gcPauseMax * 1000);
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (vm->gcPauseHistogram[i] == 0) continue;
+        fprintf(stderr, "  < %8ld us: %ld\n", 1L << i, vm->gcPauseHistogram[i]);
+    }
+}
+
+//indexed by ObjType
+const char* gcTypeNames[OBJ_TYPE_COUNT] = {
+    "boundMethod", "class", "closure", "fiber", "function", "instance", "native", "string", "upvalue",
+};
+
+//share of the objects minor collections looked at that survived them
+double gcPromotionRate(LoxVM* vm) {
+    if (vm->gcStats.minorCandidates == 0) return 0;
+    return (double)vm->gcStats.promoted / vm->gcStats.minorCandidates;
+}
+
+void writeGcStats(LoxVM* vm, const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open \"%s\" for the gc statistics.\n", path);
+        return;
+    }
+
+    GcStats* stats = &vm->gcStats;
+    fprintf(file, "{\n");
+    fprintf(file, "  \"collections\": %ld,\n", stats->collections);
+    fprintf(file, "  \"minorCollections\": %ld,\n", stats->minorCollections);
+    fprintf(file, "  \"compactions\": %ld,\n", stats->compactions);
+    fprintf(file, "  \"heapBytes\": %zu,\n", vm->bytesAllocated + vm->largeBytesAllocated);
+    fprintf(file, "  \"totalAllocated\": %zu,\n", stats->totalAllocated);
+    fprintf(file, "  \"totalFreed\": %zu,\n", stats->totalFreed);
+    fprintf(file, "  \"objectsFreed\": %ld,\n", stats->objectsFreed);
+    fprintf(file, "  \"promoted\": %ld,\n", stats->promoted);
+    fprintf(file, "  \"promotionRate\": %.4f,\n", gcPromotionRate(vm));
+    fprintf(file, "  \"pauseTotalMs\": %.3f,\n", vm->gcPauseTotal * 1000);
+    fprintf(file, "  \"pauseMaxMs\": %.3f,\n", vm->gcPauseMax * 1000);
+
+    //bucket i counts pauses under 2^i microseconds
+    fprintf(file, "  \"pauseHistogramUs\": {");
+    bool first = true;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (vm->gcPauseHistogram[i] == 0) continue;
+        fprintf(file, "%s\"%ld\": %ld", first ? "" : ", ", 1L << i, vm->gcPauseHistogram[i]);
+        first = false;
+    }
+    fprintf(file, "},\n");
+
+    fprintf(file, "  \"live\": {\n");
+    for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+        fprintf(file, "    \"%s\": {\"count\": %ld, \"bytes\": %zu}%s\n", gcTypeNames[i],
+                stats->liveObjects[i], stats->liveBytes[i], i < OBJ_TYPE_COUNT - 1 ? "," : "");
+    }
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    if (file != stderr) fclose(file);
+}
@@ -1,28 +1,81 @@
-#ifndef lox_memory_h
-#define lox_memory_h
-
-#include "common.h"
-#include "LoxObject.h"
-
-#define ALLOCATE(type, count) \
-    (type*)reallocate(NULL, 0, sizeof(type) * (count))
-
-#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
-
-#define GrowCap(capacity) \
-    ((capacity) < 8 ? 8 : (capacity) * 2)
-
-#define GrowArr(type, pointer, oldCount, newCount) \
-    (type*)reallocate(pointer, sizeof(type) * (oldCount), \
-        sizeof(type) * (newCount))
-
-#define FreeArr(type, pointer, oldCount) \
-    reallocate(pointer, sizeof(type) * (oldCount), 0)
-
-void* reallocate(void* pointer, size_t oldSize, size_t newSize);
-void markObject(LoxObject* object);
-void markValue(LoxValue value);
-void collectGarbage();
-void freeObjects();
-
+#ifndef lox_memory_h
+#define lox_memory_h
+
+#include "common.h"
+#include "LoxObject.h"
+#include "LoxVM.h"
+
+#define ALLOCATE(vm, type, count) \
+    (type*)reallocate(vm, NULL, 0, sizeof(type) * (count))
+
+#define FREE(vm, type, pointer) reallocate(vm, pointer, sizeof(type), 0)
+
+#define FREE_OBJ(vm, type, pointer) freeObjectMemory(vm, pointer, sizeof(type))
+
+#define GrowCap(capacity) \
+    ((capacity) < 8 ? 8 : (capacity) * 2)
+
+#define GrowArr(vm, type, pointer, oldCount, newCount) \
+    (type*)reallocate(vm, pointer, sizeof(type) * (oldCount), \
+        sizeof(type) * (newCount))
+
+#define FreeArr(vm, type, pointer, oldCount) \
+    reallocate(vm, pointer, sizeof(type) * (oldCount), 0)
+
+void* reallocate(LoxVM* vm, void* pointer, size_t oldSize, size_t newSize);
+void* allocateObjectMemory(LoxVM* vm, size_t size, ObjType type);
+void freeObjectMemory(LoxVM* vm, void* pointer, size_t size);
+void markObject(LoxVM* vm, LoxObject* object);
+void markValue(LoxVM* vm, LoxValue value);
+void markFiber(LoxVM* vm, LoxObjFiber* fiber);
+void rememberObject(LoxVM* vm, LoxObject* object);
+void collectGarbage(LoxVM* vm);
+void collectYoungGarbage(LoxVM* vm);
+void finishSweep(LoxVM* vm);
+void compactHeap(LoxVM* vm);
+bool enforceHeapLimit(LoxVM* vm);
+bool setGcOption(LoxVM* vm, const char* name, const char* value);
+LoxObject* forwardObject(LoxObject* object);
+LoxValue forwardValue(LoxValue value);
+void freeObjects(LoxVM* vm);
+void configureGarbageCollector(LoxVM* vm);
+void printGcPauses(LoxVM* vm);
+double gcPromotionRate(LoxVM* vm);
+void writeGcStats(LoxVM* vm, const char* path);
+
+extern const char* gcTypeNames[OBJ_TYPE_COUNT];
+void acquireHeap(LoxVM* vm);
+void releaseHeap(LoxVM* vm);
+
+//call after storing value into a field, table or upvalue owned by owner
+//an old object pointing at a young one has to be traced by the next minor collection,
+//and while incremental marking is running a stored white object is shaded gray
+static inline void writeBarrier(LoxVM* vm, LoxObject* owner, LoxValue value) {
+    if (vm->gcMode == GC_GENERATIONAL) {
+        if (!owner->isRemembered && heapIsMarked(owner) &&
+            IS_OBJ(value) && !heapIsMarked(AS_OBJ(value))) {
+            rememberObject(vm, owner);
+        }
+    }
+    else if (vm->gcMode == GC_INCREMENTAL && vm->gcPhase == GC_PHASE_MARK) {
+        markValue(vm, value);
+    }
+}
+
+//call with the value a heap store is about to overwrite
+//concurrent marking keeps everything reachable when it started, so a dropped reference is shaded
+static inline void deleteBarrier(LoxVM* vm, LoxValue value) {
+    if (vm->gcConcurrentMark) markValue(vm, value);
+}
+
+//stores into objects the marker thread may be tracing go between these
+//the lock is only taken while it runs, and a collection never starts or ends inside the pair
+static inline void lockHeap(LoxVM* vm) {
+    if (vm->heapLocks++ == 0 && vm->gcConcurrentMark) acquireHeap(vm);
+}
+
+static inline void unlockHeap(LoxVM* vm) {
+    if (--vm->heapLocks == 0 && vm->gcConcurrentMark) releaseHeap(vm);
+}
+
 #endif
\ No newline at end of file